@@ -0,0 +1,12 @@
+// Call-heavy workload for the optimizer: naive recursive Fibonacci.
+// Compare the optimization levels with bench/opt-levels.sh.
+
+fn fib(n : Int) : Int {
+  if (n < 2) { return n; }
+  return fib(n - 1) + fib(n - 2);
+}
+
+fn main() : Int {
+  print fib(35);
+  return 0;
+}
@@ -0,0 +1,23 @@
+# /usr/bin/sh
+# Emit a synthetic NeeiLang program with N functions (default 10000) on
+# stdout, for benchmarking the front-end:
+#   sh bench/gen-corpus.sh 50000 > big.nl && bin/neeilang --stats big.nl
+#   sh bench/gen-corpus.sh 400000 > huge.nl && bin/neeilang --stats --stop-after=lex huge.nl
+n=${1:-10000}
+
+awk -v n="$n" 'BEGIN {
+  for (i = 0; i < n; i++) {
+    printf "fn f%d(alpha : Int, beta : Int) : Int {\n", i
+    printf "  var total = alpha * %d + beta;\n", i
+    printf "  for (var idx = 0; idx < beta; idx = idx + 1) {\n"
+    printf "    if (total > 1000) {\n"
+    printf "      total = total - alpha;\n"
+    printf "    } else {\n"
+    printf "      total = total + idx * 2;\n"
+    printf "    }\n"
+    printf "  }\n"
+    printf "  return total;\n"
+    printf "}\n\n"
+  }
+  printf "fn main() : Int {\n  print f0(1, 2);\n  return 0;\n}\n"
+}'
@@ -0,0 +1,39 @@
+// Method-call-heavy workload. Counter.add is never overridden, so its
+// calls are devirtualized (see src/class-hierarchy.h) and, from -O2 on,
+// inlined. Shape.area is overridden, so those calls stay virtual.
+
+class Counter {
+  total : Int;
+  init() { this.total = 0; return this; }
+  add(n : Int) : Int {
+    this.total = this.total + n;
+    return this.total;
+  }
+}
+
+class Shape {
+  init() { return this; }
+  area() : Int { return 0; }
+}
+
+class Square < Shape {
+  side : Int;
+  init() { this.side = 3; return this; }
+  area() : Int { return this.side * this.side; }
+}
+
+fn main() : Int {
+  var counter = Counter.init();
+  for (var i = 0; i < 50000000; i = i + 1) {
+    counter.add(i);
+  }
+  print counter.total;
+
+  var shape : Shape = Square.init();
+  var sum = 0;
+  for (var j = 0; j < 1000; j = j + 1) {
+    sum = sum + shape.area();
+  }
+  print sum;
+  return 0;
+}
@@ -0,0 +1,43 @@
+# /usr/bin/sh
+# Compare the run time of NeeiLang programs at each optimization level.
+# Each program is compiled with -O0..-O3 into a native executable and run
+# a few times; the best wall time in milliseconds is reported. Run from
+# the build directory:
+#   sh ../bench/opt-levels.sh                       # the functional tests
+#   sh ../bench/opt-levels.sh ../bench/*.nl
+# Output from the programs is discarded; runs of the functional tests
+# themselves take about a millisecond, so they mostly show the levels
+# don't change behaviour.
+runs=${RUNS:-5}
+src_dir=$(dirname "$0")/..
+programs=${*:-$src_dir/test/functional/*.nl.splat}
+build=$(pwd)
+tmp=$(mktemp -d)
+
+now_ms() { echo $(($(date +%s%N) / 1000000)); }
+
+printf "%-32s %8s %8s %8s %8s\n" program -O0 -O1 -O2 -O3
+for program in $programs; do
+  printf "%-32s" "$(basename "$program")"
+  case $program in /*) ;; *) program=$build/$program ;; esac
+  for level in 0 1 2 3; do
+    (cd "$tmp" &&
+     "$build/bin/neeilang" -O$level --emit=exe "$program" > /dev/null 2>&1)
+    if [ $? -ne 0 ]; then
+      printf " %8s" fail
+      continue
+    fi
+    best=
+    i=0
+    while [ $i -lt $runs ]; do
+      start=$(now_ms)
+      "$tmp/a.out" > /dev/null 2>&1
+      ms=$(($(now_ms) - start))
+      if [ -z "$best" ] || [ $ms -lt $best ]; then best=$ms; fi
+      i=$((i + 1))
+    done
+    printf " %8s" $best
+  done
+  printf "\n"
+done
+rm -rf "$tmp"
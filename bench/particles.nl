@@ -0,0 +1,40 @@
+// Field-by-field workload for structure-of-arrays layout. Each step only
+// reads and writes the position and velocity of every particle, a third
+// of what each element holds. See bench/soa.sh, which also runs this with
+// the array declared `soa`.
+
+struct Particle {
+  x : Int;
+  y : Int;
+  vx : Int;
+  vy : Int;
+  mass : Int;
+  charge : Int;
+  age : Int;
+  alive : Bool;
+}
+
+fn main() : Int {
+  var ps : Particle[1000000];
+  for (var i = 0; i < ps.size; i = i + 1) {
+    ps[i].vx = i - 500000;
+    ps[i].vy = 3;
+    ps[i].mass = 1;
+  }
+
+  for (var step = 0; step < 200; step = step + 1) {
+    for (var i = 0; i < ps.size; i = i + 1) {
+      ps[i].x = ps[i].x + ps[i].vx;
+    }
+    for (var i = 0; i < ps.size; i = i + 1) {
+      ps[i].y = ps[i].y + ps[i].vy;
+    }
+  }
+
+  var sum = 0;
+  for (var i = 0; i < ps.size; i = i + 1) {
+    sum = sum + ps[i].y * ps[i].mass;
+  }
+  print sum;
+  return 0;
+}
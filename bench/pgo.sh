@@ -0,0 +1,50 @@
+# /usr/bin/sh
+# Compare plain vtable dispatch with profile-guided devirtualization.
+# Each program is compiled into a native executable three times: as is,
+# with --profile-generate (and run once to write its profile), and with
+# --profile-use. The plain and profile-guided executables are run a few
+# times each; the best wall time in milliseconds is reported. Run from
+# the build directory:
+#   sh ../bench/pgo.sh                  # bench/virtual-calls.nl
+#   sh ../bench/pgo.sh program.nl ...
+# OPT sets the optimization level (default -O2).
+runs=${RUNS:-5}
+opt=${OPT:--O2}
+src_dir=$(dirname "$0")/..
+programs=${*:-$src_dir/bench/virtual-calls.nl}
+build=$(pwd)
+tmp=$(mktemp -d)
+
+now_ms() { echo $(($(date +%s%N) / 1000000)); }
+
+best_ms() {
+  best=
+  i=0
+  while [ $i -lt $runs ]; do
+    start=$(now_ms)
+    "$1" > /dev/null 2>&1
+    ms=$(($(now_ms) - start))
+    if [ -z "$best" ] || [ $ms -lt $best ]; then best=$ms; fi
+    i=$((i + 1))
+  done
+  echo $best
+}
+
+printf "%-32s %8s %8s\n" program vtable pgo
+for program in $programs; do
+  printf "%-32s" "$(basename "$program")"
+  case $program in /*) ;; *) program=$build/$program ;; esac
+  (cd "$tmp" &&
+   "$build/bin/neeilang" $opt --emit=exe -o plain "$program" &&
+   "$build/bin/neeilang" $opt --emit=exe -o instrumented \
+     --profile-generate=profile "$program" &&
+   ./instrumented &&
+   "$build/bin/neeilang" $opt --emit=exe -o guided \
+     --profile-use=profile "$program") > /dev/null 2>&1
+  if [ $? -ne 0 ]; then
+    printf " %8s\n" fail
+    continue
+  fi
+  printf " %8s %8s\n" $(best_ms "$tmp/plain") $(best_ms "$tmp/guided")
+done
+rm -rf "$tmp"
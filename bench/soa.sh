@@ -0,0 +1,48 @@
+# /usr/bin/sh
+# Compare arrays of structs stored element by element with the same
+# arrays declared `soa`, stored field by field. Each program is compiled
+# into a native executable as is, and again with every `: Struct[` array
+# declaration of the structs it declares rewritten to `: soa Struct[`.
+# Both are run a few times; the best wall time in milliseconds is
+# reported. Run from the build directory:
+#   sh ../bench/soa.sh                  # bench/particles.nl
+#   sh ../bench/soa.sh program.nl ...
+# OPT sets the optimization level (default -O2).
+runs=${RUNS:-5}
+opt=${OPT:--O2}
+src_dir=$(dirname "$0")/..
+programs=${*:-$src_dir/bench/particles.nl}
+build=$(pwd)
+tmp=$(mktemp -d)
+
+now_ms() { echo $(($(date +%s%N) / 1000000)); }
+
+best_ms() {
+  best=
+  i=0
+  while [ $i -lt $runs ]; do
+    start=$(now_ms)
+    "$1" > /dev/null 2>&1
+    ms=$(($(now_ms) - start))
+    if [ -z "$best" ] || [ $ms -lt $best ]; then best=$ms; fi
+    i=$((i + 1))
+  done
+  echo $best
+}
+
+printf "%-32s %8s %8s\n" program aos soa
+for program in $programs; do
+  printf "%-32s" "$(basename "$program")"
+  case $program in /*) ;; *) program=$build/$program ;; esac
+  structs=$(sed -n 's/^struct \([A-Za-z_]*\).*/\1/p' "$program" | paste -sd'|')
+  sed -E "s/: ($structs)\[/: soa \1[/g" "$program" > "$tmp/soa.nl"
+  (cd "$tmp" &&
+   "$build/bin/neeilang" $opt --emit=exe -o aos "$program" &&
+   "$build/bin/neeilang" $opt --emit=exe -o soa soa.nl) > /dev/null 2>&1
+  if [ $? -ne 0 ] || [ -z "$structs" ]; then
+    printf " %8s\n" fail
+    continue
+  fi
+  printf " %8s %8s\n" $(best_ms "$tmp/aos") $(best_ms "$tmp/soa")
+done
+rm -rf "$tmp"
@@ -0,0 +1,62 @@
+// Allocation-heavy workload for the garbage collector: builds and drops
+// many SimpleVectors (see test/functional/vector.nl.splat) while keeping
+// only a few alive. Memory use should level off rather than grow with
+// the number of rounds:
+//   NL_GC_STATS=1 lli -load=lib/libnlrt.so out.bc
+
+class SimpleVector {
+  arr : Int[2];
+  size : Int;
+  capacity : Int;
+
+  init() {
+    var arrInit : Int[2];
+    this.arr = arrInit;
+    this.size = 0;
+    this.capacity = 2;
+    return this;
+  }
+
+  push(e : Int) : Void {
+    if (this.size == this.capacity) {
+      this.capacity = this.capacity * 2;
+      var new_arr : Int[this.capacity];
+      for (var i = 0; i < this.size; i = i + 1) {
+        new_arr[i] = this.arr[i];
+      }
+      this.arr = new_arr;
+    }
+    this.arr[this.size] = e;
+    this.size = this.size + 1;
+    return;
+  }
+
+  get(i : Int) : Int {
+    return this.arr[i];
+  }
+}
+
+fn fill(n : Int) : SimpleVector {
+  var vec = SimpleVector.init();
+  for (var i = 0; i < n; i = i + 1) {
+    vec.push(i);
+  }
+  return vec;
+}
+
+fn main() : Int {
+  var rounds = 100000;
+  var kept = fill(1);
+  var total = 0;
+
+  for (var r = 0; r < rounds; r = r + 1) {
+    var vec = fill(1000);
+    total = total + vec.get(r - (r / 1000) * 1000);
+    if (r - (r / 10) * 10 == 0) {
+      kept = vec;
+    }
+  }
+
+  print total + kept.get(999);
+  return 0;
+}
@@ -0,0 +1,40 @@
+// Virtual-call-heavy workload for profile-guided devirtualization.
+// Shape.area has several implementations, so class hierarchy analysis
+// can't devirtualize its calls, but 99 in every 100 of them are made on
+// a Square. See bench/pgo.sh.
+
+class Shape {
+  init() { return this; }
+  area() : Int { return 0; }
+}
+
+class Square < Shape {
+  side : Int;
+  init() { this.side = 3; return this; }
+  area() : Int { return this.side * this.side; }
+}
+
+class Rect < Shape {
+  width : Int;
+  height : Int;
+  init() { this.width = 2; this.height = 5; return this; }
+  area() : Int { return this.width * this.height; }
+}
+
+fn main() : Int {
+  var square : Shape = Square.init();
+  var rect : Shape = Rect.init();
+  var sum = 0;
+  var j = 0;
+  for (var i = 0; i < 50000000; i = i + 1) {
+    var shape = square;
+    j = j + 1;
+    if (j == 100) {
+      shape = rect;
+      j = 0;
+    }
+    sum = sum + shape.area();
+  }
+  print sum;
+  return 0;
+}
@@ -1,8 +1,8 @@
 # /usr/bin/sh
-bin/neeilang "$1" &> output.ll
+bin/neeilang --emit=exe -o a.out "$1" &> nl_stderr.txt
 if [ $? -eq 0 ]; then
-  lli out.bc
+  ./a.out
 else
-  cat output.ll
+  cat nl_stderr.txt
   echo "NL: Compilation failure"
-fi
\ No newline at end of file
+fi
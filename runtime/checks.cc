@@ -0,0 +1,19 @@
+#include <cstdio>
+#include <cstdlib>
+
+#include "nlrt.h"
+
+/*
+Failure paths for the run-time checks generated code makes. They are
+kept out of line so that the checks themselves stay a compare and a
+branch.
+*/
+
+void nl_index_error(int64_t index, int64_t size, int32_t line) {
+  // Keep what the program printed before it went wrong.
+  nl_print_flush();
+  fprintf(stderr,
+          "NL: [line %d] array index %lld is out of bounds for size %lld\n",
+          line, (long long)index, (long long)size);
+  abort();
+}
@@ -0,0 +1,342 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "nlrt.h"
+
+/*
+A precise, non-moving mark-sweep collector.
+
+Small objects are bump-allocated from 256 KiB chunks (see nl_nursery);
+larger ones are allocated individually and linked into a list. Either
+way, an nl_alloc_header in front of each object records its type, so
+the objects in a chunk can be walked in address order. The mark bit
+lives in the GC byte at the start of the NL object header. Chunks are
+aligned to their size, and marking an object also flags its chunk, so
+the sweep frees chunks with nothing live in them without walking them.
+
+Roots are the slots of the shadow stack frames pushed by generated code;
+references held only in registers are spilled to frame slots by the
+backend before anything can allocate. Objects the backend allocated in
+stack frames (see NL_GC_ON_STACK) are traced, but not otherwise managed.
+
+Since objects never move, a chunk can only be reused once everything in
+it is dead. That is the common case for short-lived objects, which die
+together with their neighbours.
+
+A collection is triggered when the heap has doubled since the last one,
+which keeps the steady-state footprint of a program within a constant
+factor of its live data.
+*/
+
+nl_gc_frame *nl_gc_top_frame = nullptr;
+nl_alloc_region nl_nursery = {nullptr, nullptr};
+
+namespace {
+
+const size_t CHUNK_SIZE = 256 * 1024;
+const size_t LARGE_OBJECT_SIZE = CHUNK_SIZE / 8;
+const size_t MAX_FREE_CHUNKS = 16;
+
+const uint8_t MARK_BIT = 1;
+const uint64_t MIN_THRESHOLD = 4 * CHUNK_SIZE;
+
+struct Chunk {
+  Chunk *next;
+  char *end;         // Of the allocated objects.
+  uint64_t has_live; // Set by marking.
+  alignas(16) char data[CHUNK_SIZE - 32];
+};
+
+struct LargeObject {
+  LargeObject *next;
+  uint64_t bytes;
+  nl_alloc_header header;
+};
+
+Chunk *chunks = nullptr;      // In use, excluding the nursery's.
+Chunk *free_chunks = nullptr; // Empty and zeroed.
+size_t num_free_chunks = 0;
+Chunk *nursery_chunk = nullptr;
+LargeObject *large_objects = nullptr;
+
+uint64_t heap_bytes = 0;
+uint64_t threshold = MIN_THRESHOLD;
+
+// Grey objects: marked, but not yet traced. Grown with realloc so the
+// runtime doesn't need the C++ standard library.
+void **mark_stack = nullptr;
+size_t mark_stack_size = 0;
+size_t mark_stack_capacity = 0;
+
+uint64_t num_collections = 0;
+uint64_t total_bytes = 0;
+uint64_t peak_heap_bytes = 0;
+
+uint8_t &gc_byte(void *obj) { return *static_cast<uint8_t *>(obj); }
+
+nl_alloc_header *header_of(void *obj) {
+  return static_cast<nl_alloc_header *>(obj) - 1;
+}
+
+/* Bytes taken by an allocation, header included. */
+uint64_t alloc_size(const nl_type_info *type, uint64_t count) {
+  const uint64_t bytes =
+      sizeof(nl_alloc_header) + type->size + count * type->elem_size;
+  return (bytes + 7) & ~uint64_t(7);
+}
+
+bool is_large(uint64_t bytes) { return bytes > LARGE_OBJECT_SIZE; }
+
+Chunk *chunk_of(void *obj) {
+  return reinterpret_cast<Chunk *>(reinterpret_cast<uintptr_t>(obj) &
+                                   ~uintptr_t(CHUNK_SIZE - 1));
+}
+
+[[noreturn]] void out_of_memory() {
+  fprintf(stderr, "NL: out of memory\n");
+  abort();
+}
+
+void mark(void *obj) {
+  if (!obj || (gc_byte(obj) & MARK_BIT)) {
+    return;
+  }
+  // Only roots can refer to stack objects (anything stored in the heap
+  // escapes), so they can't be reached twice through a cycle.
+  if (!(gc_byte(obj) & NL_GC_ON_STACK)) {
+    gc_byte(obj) |= MARK_BIT;
+
+    const nl_alloc_header *header = header_of(obj);
+    if (!is_large(alloc_size(header->type, header->count))) {
+      chunk_of(obj)->has_live = 1;
+    }
+  }
+
+  if (mark_stack_size == mark_stack_capacity) {
+    mark_stack_capacity = mark_stack_capacity ? 2 * mark_stack_capacity : 256;
+    mark_stack = static_cast<void **>(
+        realloc(mark_stack, mark_stack_capacity * sizeof(void *)));
+    if (!mark_stack) {
+      out_of_memory();
+    }
+  }
+  mark_stack[mark_stack_size++] = obj;
+}
+
+void trace(void *obj) {
+  const nl_alloc_header *header = header_of(obj);
+  const nl_type_info *type = header->type;
+  char *base = static_cast<char *>(obj);
+
+  for (uint32_t i = 0; i < type->num_ptrs; i++) {
+    mark(*reinterpret_cast<void **>(base + type->ptr_offsets[i]));
+  }
+
+  if (type->elems_are_ptrs) {
+    void **elems = reinterpret_cast<void **>(base + type->size);
+    for (uint64_t i = 0; i < header->count; i++) {
+      mark(elems[i]);
+    }
+  }
+}
+
+void mark_roots() {
+  for (nl_gc_frame *f = nl_gc_top_frame; f; f = f->prev) {
+    void **roots = reinterpret_cast<void **>(f + 1);
+    for (uint64_t i = 0; i < f->num_roots; i++) {
+      mark(roots[i]);
+    }
+  }
+}
+
+/* Clears the marks in a chunk. Returns whether anything in it was live. */
+bool sweep_chunk(Chunk *c) {
+  if (!c->has_live) {
+    return false;
+  }
+  c->has_live = 0;
+
+  char *p = c->data;
+  while (p < c->end) {
+    nl_alloc_header *header = reinterpret_cast<nl_alloc_header *>(p);
+    gc_byte(header + 1) &= ~MARK_BIT;
+    p += alloc_size(header->type, header->count);
+  }
+  return true;
+}
+
+void release_chunk(Chunk *c) {
+  heap_bytes -= CHUNK_SIZE;
+  if (num_free_chunks == MAX_FREE_CHUNKS) {
+    free(c);
+    return;
+  }
+  memset(c->data, 0, c->end - c->data);
+  c->end = c->data;
+  c->next = free_chunks;
+  free_chunks = c;
+  num_free_chunks++;
+}
+
+void sweep() {
+  Chunk **link = &chunks;
+  while (Chunk *c = *link) {
+    if (sweep_chunk(c)) {
+      link = &c->next;
+    } else {
+      *link = c->next;
+      release_chunk(c);
+    }
+  }
+
+  // The nursery chunk stays put; if it's all garbage, start it over.
+  if (nursery_chunk) {
+    nursery_chunk->end = nl_nursery.cursor;
+    if (!sweep_chunk(nursery_chunk)) {
+      total_bytes += nursery_chunk->end - nursery_chunk->data;
+      memset(nursery_chunk->data, 0, nursery_chunk->end - nursery_chunk->data);
+      nursery_chunk->end = nursery_chunk->data;
+      nl_nursery.cursor = nursery_chunk->data;
+    }
+  }
+
+  LargeObject **link_large = &large_objects;
+  while (LargeObject *o = *link_large) {
+    void *obj = &o->header + 1;
+    if (gc_byte(obj) & MARK_BIT) {
+      gc_byte(obj) &= ~MARK_BIT;
+      link_large = &o->next;
+    } else {
+      *link_large = o->next;
+      heap_bytes -= o->bytes;
+      free(o);
+    }
+  }
+}
+
+void print_stats() {
+  if (nursery_chunk) {
+    total_bytes += nl_nursery.cursor - nursery_chunk->data;
+  }
+  fprintf(stderr,
+          "NL GC: %llu collections, %llu KiB allocated, %llu KiB peak heap, "
+          "%llu KiB heap at exit\n",
+          (unsigned long long)num_collections,
+          (unsigned long long)total_bytes / 1024,
+          (unsigned long long)peak_heap_bytes / 1024,
+          (unsigned long long)heap_bytes / 1024);
+}
+
+/* Collects if the heap is about to outgrow the threshold. Only code that
+ keeps a shadow stack can be collected, since otherwise the roots aren't
+ known. */
+void maybe_collect(uint64_t bytes) {
+  static bool stats_registered = false;
+  if (!stats_registered) {
+    stats_registered = true;
+    if (getenv("NL_GC_STATS")) {
+      atexit(print_stats);
+    }
+  }
+
+  if (heap_bytes + bytes > threshold && nl_gc_top_frame) {
+    nl_gc_collect();
+  }
+}
+
+void grow_heap(uint64_t bytes) {
+  heap_bytes += bytes;
+  if (heap_bytes > peak_heap_bytes) {
+    peak_heap_bytes = heap_bytes;
+  }
+}
+
+/* Retires the nursery chunk and points the nursery at an empty one. */
+void refill_nursery() {
+  if (nursery_chunk) {
+    nursery_chunk->end = nl_nursery.cursor;
+    total_bytes += nursery_chunk->end - nursery_chunk->data;
+    nursery_chunk->next = chunks;
+    chunks = nursery_chunk;
+    nursery_chunk = nullptr;
+  }
+
+  maybe_collect(CHUNK_SIZE);
+
+  Chunk *c = free_chunks;
+  if (c) {
+    free_chunks = c->next;
+    num_free_chunks--;
+  } else {
+    c = static_cast<Chunk *>(aligned_alloc(CHUNK_SIZE, sizeof(Chunk)));
+    if (!c) {
+      out_of_memory();
+    }
+    memset(c, 0, sizeof(Chunk));
+    c->end = c->data;
+  }
+  grow_heap(CHUNK_SIZE);
+
+  nursery_chunk = c;
+  nl_nursery.cursor = c->data;
+  nl_nursery.limit = c->data + sizeof(c->data);
+}
+
+void *init_header(char *p, const nl_type_info *type, uint64_t count) {
+  nl_alloc_header *header = reinterpret_cast<nl_alloc_header *>(p);
+  header->type = type;
+  header->count = count;
+  return header + 1;
+}
+
+void *allocate_large(const nl_type_info *type, uint64_t count,
+                     uint64_t bytes) {
+  maybe_collect(bytes);
+
+  LargeObject *o = static_cast<LargeObject *>(
+      calloc(1, sizeof(LargeObject) - sizeof(nl_alloc_header) + bytes));
+  if (!o) {
+    out_of_memory();
+  }
+  o->next = large_objects;
+  o->bytes = bytes;
+  large_objects = o;
+  grow_heap(bytes);
+  total_bytes += bytes;
+
+  return init_header(reinterpret_cast<char *>(&o->header), type, count);
+}
+
+} // namespace
+
+void *nl_alloc(const nl_type_info *type, int32_t count) {
+  if (count < 0) {
+    fprintf(stderr, "NL: negative array size %d\n", count);
+    abort();
+  }
+
+  const uint64_t bytes = alloc_size(type, count);
+  if (is_large(bytes)) {
+    return allocate_large(type, count, bytes);
+  }
+
+  if (static_cast<uint64_t>(nl_nursery.limit - nl_nursery.cursor) < bytes) {
+    refill_nursery();
+  }
+  char *p = nl_nursery.cursor;
+  nl_nursery.cursor += bytes;
+  return init_header(p, type, count);
+}
+
+void nl_gc_collect() {
+  num_collections++;
+
+  mark_roots();
+  while (mark_stack_size > 0) {
+    trace(mark_stack[--mark_stack_size]);
+  }
+  sweep();
+
+  threshold = 2 * heap_bytes > MIN_THRESHOLD ? 2 * heap_bytes : MIN_THRESHOLD;
+}
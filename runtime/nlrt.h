@@ -0,0 +1,107 @@
+#ifndef _NL_RUNTIME_NLRT_H_
+#define _NL_RUNTIME_NLRT_H_
+
+/*
+The NeeiLang runtime: the services compiled NL programs call into. Code
+generated by the LLVM backend links against (or, under lli, loads) this
+library, so everything here has C linkage and a layout that the backend
+mirrors by hand. See src/backends/llvm/object.h for the object layout.
+*/
+
+#include <cstdint>
+
+#define NL_RT_EXPORT extern "C" __attribute__((visibility("default")))
+
+/* Describes where a heap type keeps its references, so the collector can
+trace it precisely. One is emitted per class and per array type.
+
+For objects, size is the whole object and ptr_offsets lists the byte
+offsets of fields that refer to other heap objects. Arrays are allocated
+as a header of size bytes immediately followed by their elements; when
+elems_are_ptrs is set, every element is a reference. */
+struct nl_type_info {
+  uint64_t size;
+  uint64_t elem_size; // 0 for objects.
+  uint32_t num_ptrs;
+  uint32_t elems_are_ptrs;
+  const uint64_t *ptr_offsets;
+};
+
+/* A function's shadow stack frame. Every function that keeps references
+in locals pushes one on entry and pops it before returning; the
+num_roots slots that follow the frame hold those references (or null). */
+struct nl_gc_frame {
+  nl_gc_frame *prev;
+  uint64_t num_roots;
+};
+
+/* Set in the GC byte (the first byte of an NL object) of objects that
+the backend allocated in a stack frame, because they can't outlive it.
+The collector traces them, but never marks or frees them. */
+const uint8_t NL_GC_ON_STACK = 2;
+
+/* The innermost shadow stack frame. Code that never pushes frames (such
+as the x86-64 backend's) still allocates, but is never collected. */
+NL_RT_EXPORT nl_gc_frame *nl_gc_top_frame;
+
+/* Precedes every heap object. Allocations are 8-byte aligned and their
+size, header included, is rounded up to a multiple of 8. */
+struct nl_alloc_header {
+  const nl_type_info *type;
+  uint64_t count; // Array elements; 0 for objects.
+};
+
+/* The bump-pointer region small objects are carved from. Allocation
+fast paths are inlined by the backends:
+
+  header = cursor; if (header + bytes <= limit) cursor += bytes;
+  else call nl_alloc
+
+and the region is always zeroed up to limit, so they needn't clear the
+object. NL programs have a single thread, which owns the region. */
+struct nl_alloc_region {
+  char *cursor;
+  char *limit;
+};
+NL_RT_EXPORT nl_alloc_region nl_nursery;
+
+/* Returns a zeroed object of the given type, or, for array types, a
+zeroed array of count elements whose header the caller fills in. This
+is the slow path behind the inline fast path, and may collect. */
+NL_RT_EXPORT void *nl_alloc(const nl_type_info *type, int32_t count);
+
+/* Collects garbage now. */
+NL_RT_EXPORT void nl_gc_collect();
+
+/* Reports an array access at the given source line with an index outside
+[0, size) and aborts. Called from bounds checks the backends emit. */
+NL_RT_EXPORT __attribute__((noreturn)) void
+nl_index_error(int64_t index, int64_t size, int32_t line);
+
+/* Print statements: each prints a value and a newline to stdout. Output
+is buffered until nl_print_flush, a full buffer, or exit. Ints and Bools
+are printed as 64-bit integers. */
+NL_RT_EXPORT void nl_print_int(int64_t value);
+NL_RT_EXPORT void nl_print_float(double value);
+NL_RT_EXPORT void nl_print_str(const char *value);
+NL_RT_EXPORT void nl_print_flush();
+
+/* Describes the virtual call sites of a program built with
+--profile-generate, which are numbered, and its classes. The runtime
+counts, per site, the classes whose vtable the site found in its
+receiver, and writes the counts to path at exit. */
+struct nl_profile {
+  const char *path;
+  const char *const *site_methods; // "Class.method", by site.
+  const char *const *class_names;
+  const void *const *vtables; // Of the classes, in the same order.
+  void *counts;               // Set up by the runtime on the first call.
+  uint32_t num_sites;
+  uint32_t num_classes;
+};
+
+/* Counts a call at site on an object whose vtable is given. */
+NL_RT_EXPORT void nl_profile_call(nl_profile *profile, uint32_t site,
+                                  const void *vtable);
+
+#endif // _NL_RUNTIME_NLRT_H_
@@ -0,0 +1,114 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+
+#include "nlrt.h"
+
+/*
+The output of print statements. Each value is formatted straight into a
+buffer, which is written out when it fills up and at exit, rather than
+going through printf and a write per line. Only Floats are formatted by
+libc, to get its rounding.
+
+When stdout is a terminal, every line is written as soon as it's
+printed, as stdio would.
+*/
+
+namespace {
+
+const size_t BUFFER_SIZE = 64 * 1024;
+
+// Room for any formatted value that isn't a String.
+const size_t MAX_NUMBER_LEN = 512;
+
+struct OutputBuffer {
+  char data[BUFFER_SIZE];
+  size_t len = 0;
+  bool initialized = false;
+  bool line_buffered = false;
+};
+
+thread_local OutputBuffer out;
+
+void write_all(const char *data, size_t len) {
+  while (len > 0) {
+    ssize_t written = write(STDOUT_FILENO, data, len);
+    if (written < 0) {
+      return; // Nowhere left to report it.
+    }
+    data += written;
+    len -= written;
+  }
+}
+
+void flush_at_exit() { nl_print_flush(); }
+
+void reserve(size_t len) {
+  if (!out.initialized) {
+    out.initialized = true;
+    out.line_buffered = isatty(STDOUT_FILENO);
+    atexit(flush_at_exit);
+  }
+  if (out.len + len > BUFFER_SIZE) {
+    nl_print_flush();
+  }
+}
+
+void end_line() {
+  out.data[out.len++] = '\n';
+  if (out.line_buffered) {
+    nl_print_flush();
+  }
+}
+
+} // namespace
+
+void nl_print_int(int64_t value) {
+  reserve(MAX_NUMBER_LEN);
+  // Digits are produced backwards; negate through uint64_t so INT64_MIN
+  // works too.
+  char digits[20];
+  size_t n = 0;
+  uint64_t magnitude = value < 0 ? -static_cast<uint64_t>(value) : value;
+  do {
+    digits[n++] = '0' + magnitude % 10;
+    magnitude /= 10;
+  } while (magnitude > 0);
+
+  if (value < 0) {
+    out.data[out.len++] = '-';
+  }
+  while (n > 0) {
+    out.data[out.len++] = digits[--n];
+  }
+  end_line();
+}
+
+void nl_print_float(double value) {
+  reserve(MAX_NUMBER_LEN);
+  int len = snprintf(out.data + out.len, MAX_NUMBER_LEN, "%f", value);
+  if (len > 0) {
+    out.len += static_cast<size_t>(len) < MAX_NUMBER_LEN ? len
+                                                         : MAX_NUMBER_LEN - 1;
+  }
+  end_line();
+}
+
+void nl_print_str(const char *value) {
+  size_t len = strlen(value);
+  if (len >= BUFFER_SIZE) {
+    reserve(BUFFER_SIZE); // Flushes what came before.
+    write_all(value, len);
+  } else {
+    reserve(len + 1);
+    memcpy(out.data + out.len, value, len);
+    out.len += len;
+  }
+  end_line();
+}
+
+void nl_print_flush() {
+  write_all(out.data, out.len);
+  out.len = 0;
+}
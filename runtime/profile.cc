@@ -0,0 +1,120 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "nlrt.h"
+
+/*
+Call-site profiling for profile-guided devirtualization. Programs built
+with --profile-generate call nl_profile_call before each virtual call,
+and the counts are written out as text when the program exits:
+
+  # site method receiver count
+  0 Shape.area Square 99000
+  0 Shape.area Rect 1000
+
+A later compile with --profile-use reads them back (see
+src/backends/llvm/profile.cc).
+
+The program's nl_profile may be gone by the time exit handlers run (lli
+and the JIT free the program's memory first), so everything needed to
+write the counts is copied into the runtime's own.
+*/
+
+namespace {
+
+struct Counts {
+  Counts *next;
+  char *path;
+  char **site_methods;
+  char **class_names;
+  const void **vtables;
+  uint64_t *rows; // num_sites rows of num_classes counts.
+  uint32_t num_sites;
+  uint32_t num_classes;
+};
+
+Counts *all_counts = nullptr;
+
+void *checked_calloc(size_t n, size_t size) {
+  void *p = calloc(n > 0 ? n : 1, size);
+  if (!p) {
+    fprintf(stderr, "NL: out of memory\n");
+    abort();
+  }
+  return p;
+}
+
+char *copy_string(const char *s) {
+  char *copy = static_cast<char *>(checked_calloc(strlen(s) + 1, 1));
+  return strcpy(copy, s);
+}
+
+void write_counts() {
+  for (Counts *c = all_counts; c; c = c->next) {
+    FILE *out = fopen(c->path, "w");
+    if (!out) {
+      fprintf(stderr, "NL: could not write profile '%s'\n", c->path);
+      continue;
+    }
+    fprintf(out, "# site method receiver count\n");
+    for (uint32_t site = 0; site < c->num_sites; site++) {
+      const uint64_t *row = c->rows + (uint64_t)site * c->num_classes;
+      for (uint32_t k = 0; k < c->num_classes; k++) {
+        if (row[k] > 0) {
+          fprintf(out, "%u %s %s %llu\n", site, c->site_methods[site],
+                  c->class_names[k], (unsigned long long)row[k]);
+        }
+      }
+    }
+    fclose(out);
+  }
+}
+
+Counts *start_counting(const nl_profile *profile) {
+  Counts *c = static_cast<Counts *>(checked_calloc(1, sizeof(Counts)));
+  c->path = copy_string(profile->path);
+  c->num_sites = profile->num_sites;
+  c->num_classes = profile->num_classes;
+  c->site_methods =
+      static_cast<char **>(checked_calloc(c->num_sites, sizeof(char *)));
+  for (uint32_t site = 0; site < c->num_sites; site++) {
+    c->site_methods[site] = copy_string(profile->site_methods[site]);
+  }
+  c->class_names =
+      static_cast<char **>(checked_calloc(c->num_classes, sizeof(char *)));
+  c->vtables = static_cast<const void **>(
+      checked_calloc(c->num_classes, sizeof(void *)));
+  for (uint32_t k = 0; k < c->num_classes; k++) {
+    c->class_names[k] = copy_string(profile->class_names[k]);
+    c->vtables[k] = profile->vtables[k];
+  }
+  c->rows = static_cast<uint64_t *>(
+      checked_calloc((uint64_t)c->num_sites * c->num_classes, 8));
+
+  if (!all_counts) {
+    atexit(write_counts);
+  }
+  c->next = all_counts;
+  all_counts = c;
+  return c;
+}
+
+} // namespace
+
+void nl_profile_call(nl_profile *profile, uint32_t site, const void *vtable) {
+  if (!profile->counts) {
+    profile->counts = start_counting(profile);
+  }
+  Counts *c = static_cast<Counts *>(profile->counts);
+
+  // Programs have few classes, so a linear search is fine for a profiling
+  // build.
+  uint64_t *row = c->rows + (uint64_t)site * c->num_classes;
+  for (uint32_t k = 0; k < c->num_classes; k++) {
+    if (c->vtables[k] == vtable) {
+      row[k]++;
+      return;
+    }
+  }
+}
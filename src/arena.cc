@@ -0,0 +1,37 @@
+#include <cstdint>
+
+#include "arena.h"
+
+Arena::~Arena() {
+  // Destroy in reverse creation order, like automatic objects.
+  for (auto it = finalizers.rbegin(); it != finalizers.rend(); ++it) {
+    it->destroy(it->obj);
+  }
+}
+
+void *Arena::allocate(size_t size, size_t align) {
+  uintptr_t aligned = (reinterpret_cast<uintptr_t>(cursor) + align - 1) &
+                      ~(uintptr_t)(align - 1);
+
+  if (!cursor || aligned + size > reinterpret_cast<uintptr_t>(end)) {
+    // Oversized requests get a dedicated slab so that they don't
+    // waste the remainder of the current one.
+    size_t slab_size = size + align > SLAB_SIZE ? size + align : SLAB_SIZE;
+    slabs.emplace_back(new char[slab_size]);
+    reserved += slab_size;
+
+    char *slab = slabs.back().get();
+    aligned = (reinterpret_cast<uintptr_t>(slab) + align - 1) &
+              ~(uintptr_t)(align - 1);
+
+    if (slab_size != SLAB_SIZE) {
+      used += size;
+      return reinterpret_cast<void *>(aligned);
+    }
+    end = slab + slab_size;
+  }
+
+  cursor = reinterpret_cast<char *>(aligned + size);
+  used += size;
+  return reinterpret_cast<void *>(aligned);
+}
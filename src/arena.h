@@ -0,0 +1,60 @@
+#ifndef _NL_ARENA_H_
+#define _NL_ARENA_H_
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/*
+ * Bump-pointer arena. Objects are carved out of large slabs so that
+ * consecutively created objects (e.g. AST nodes) sit next to each other
+ * in memory, and everything is released in one go when the arena dies.
+ * Objects never move, so pointers into the arena stay valid for its
+ * whole lifetime.
+ */
+class Arena {
+public:
+  Arena() = default;
+  Arena(const Arena &) = delete;
+  Arena &operator=(const Arena &) = delete;
+  ~Arena();
+
+  template <typename T, typename... Args> T *make(Args &&... args) {
+    T *obj = new (allocate(sizeof(T), alignof(T)))
+        T(std::forward<Args>(args)...);
+    if constexpr (!std::is_trivially_destructible_v<T>) {
+      finalizers.push_back(
+          {obj, [](void *p) { static_cast<T *>(p)->~T(); }});
+    }
+    num_objects++;
+    return obj;
+  }
+
+  void *allocate(size_t size, size_t align);
+
+  size_t objects() const { return num_objects; }
+  size_t bytes_used() const { return used; }
+  size_t bytes_reserved() const { return reserved; }
+
+private:
+  static const size_t SLAB_SIZE = 64 * 1024;
+
+  struct Finalizer {
+    void *obj;
+    void (*destroy)(void *);
+  };
+
+  std::vector<std::unique_ptr<char[]>> slabs;
+  std::vector<Finalizer> finalizers;
+  char *cursor = nullptr;
+  char *end = nullptr;
+
+  size_t num_objects = 0;
+  size_t used = 0;
+  size_t reserved = 0;
+};
+
+#endif // _NL_ARENA_H_
@@ -0,0 +1,246 @@
+#include <utility>
+
+#include "array-bounds.h"
+
+#include "arrays.h"
+#include "expr.h"
+#include "primitives.h"
+
+void ArrayBounds::analyze_program(const std::vector<Stmt *> &program) {
+  analyze(program);
+}
+
+void ArrayBounds::analyze(const std::vector<Stmt *> &stmts) {
+  for (size_t i = 0; i < stmts.size(); i++) {
+    Loop loop;
+    if (i + 1 < stmts.size() &&
+        induction_loop(stmts[i], stmts[i + 1], loop)) {
+      analyze(stmts[i]);
+      loops.push_back(loop);
+      analyze(stmts[++i]);
+
+      Loop &done = loops.back();
+      if (!done.invalidated) {
+        for (const Expr *access : done.accesses) {
+          proven[access] = 1;
+          eliminated++;
+        }
+      }
+      loops.pop_back();
+      continue;
+    }
+    analyze(stmts[i]);
+  }
+}
+
+void ArrayBounds::analyze(const Stmt *stmt) { stmt->accept(this); }
+
+void ArrayBounds::analyze(const Expr *expr) { expr->accept(this); }
+
+/* Matches
+     var i = <non-negative Int literal>;
+     while (i < a.size) { ...; i = i + 1; }
+   (or a.size > i), where a is an array variable. The body is checked as
+   it is analyzed. Since i only grows by one, from a value below a.size,
+   it can't overflow. */
+bool ArrayBounds::induction_loop(const Stmt *init, const Stmt *stmt,
+                                 Loop &result) {
+  const auto *var = dynamic_cast<const VarStmt *>(init);
+  const auto *loop = dynamic_cast<const WhileStmt *>(stmt);
+  if (!var || !loop || !var->expression) {
+    return false;
+  }
+
+  const auto *start = dynamic_cast<const NumLiteral *>(var->expression);
+  if (!start || start->nil || start->has_decimal_point() ||
+      start->value[0] == '-') {
+    return false;
+  }
+
+  const auto *cond = dynamic_cast<const Binary *>(loop->condition);
+  if (!cond || (cond->op.type != LESS && cond->op.type != GREATER)) {
+    return false;
+  }
+  const Expr *lhs = &cond->left, *rhs = &cond->right;
+  if (cond->op.type == GREATER) {
+    std::swap(lhs, rhs);
+  }
+  const auto *index = dynamic_cast<const Variable *>(lhs);
+  const auto *size = dynamic_cast<const Get *>(rhs);
+  if (!index || index->name.id != var->name.id || !size ||
+      size->name.id != ID_SIZE) {
+    return false;
+  }
+  const auto *array = dynamic_cast<const Variable *>(&size->callee);
+  NLType array_type = expr_types.get(&size->callee);
+  if (!array || !array_type || !array_type->is_array_type()) {
+    return false;
+  }
+
+  // The increment must come last, so no access sees i + 1.
+  const auto *body = dynamic_cast<const BlockStmt *>(loop->body);
+  if (!body || body->block_contents.empty()) {
+    return false;
+  }
+  const auto *last =
+      dynamic_cast<const ExprStmt *>(body->block_contents.back());
+  const auto *incr =
+      last ? dynamic_cast<const Assignment *>(last->expression) : nullptr;
+  if (!incr || incr->name.id != index->name.id) {
+    return false;
+  }
+  const auto *sum = dynamic_cast<const Binary *>(&incr->value);
+  if (!sum || sum->op.type != PLUS) {
+    return false;
+  }
+  const auto *addend = dynamic_cast<const Variable *>(&sum->left);
+  const auto *one = dynamic_cast<const NumLiteral *>(&sum->right);
+  if (!addend || addend->name.id != index->name.id || !one ||
+      one->value != "1") {
+    return false;
+  }
+
+  result.index = index->name.id;
+  result.array = array->name.id;
+  result.increment = incr;
+  return true;
+}
+
+/* Any other write to, or redeclaration of, a loop's index or array
+   voids what is known about it. */
+void ArrayBounds::write(Ident var, const Expr *by) {
+  for (Loop &loop : loops) {
+    if ((var == loop.index && by != loop.increment) || var == loop.array) {
+      loop.invalidated = true;
+    }
+  }
+}
+
+/* Only one-dimensional accesses are matched: the induction loops bound
+   their index by the array's size, which is the product of its extents. */
+void ArrayBounds::access(const Expr *access, const Expr &array,
+                         const std::vector<const Expr *> &indices) {
+  checks++;
+  if (indices.size() != 1) {
+    return;
+  }
+  const auto *a = dynamic_cast<const Variable *>(&array);
+  const auto *i = dynamic_cast<const Variable *>(indices[0]);
+  if (!a || !i) {
+    return;
+  }
+  for (auto loop = loops.rbegin(); loop != loops.rend(); ++loop) {
+    if (loop->array == a->name.id && loop->index == i->name.id) {
+      loop->accesses.push_back(access);
+      return;
+    }
+  }
+}
+
+void ArrayBounds::visit(const BlockStmt *stmt) {
+  analyze(stmt->block_contents);
+}
+
+void ArrayBounds::visit(const ExprStmt *stmt) { analyze(stmt->expression); }
+
+void ArrayBounds::visit(const PrintStmt *stmt) {
+  if (stmt->expression) {
+    analyze(stmt->expression);
+  }
+}
+
+void ArrayBounds::visit(const VarStmt *stmt) {
+  for (const Expr *dim : stmt->tp.dims) {
+    analyze(dim);
+  }
+  if (stmt->expression) {
+    analyze(stmt->expression);
+  }
+  write(stmt->name.id, nullptr);
+}
+
+void ArrayBounds::visit(const ClassStmt *stmt) { analyze(stmt->methods); }
+
+void ArrayBounds::visit(const IfStmt *stmt) {
+  analyze(stmt->condition);
+  analyze(stmt->then_branch);
+  if (stmt->else_branch) {
+    analyze(stmt->else_branch);
+  }
+}
+
+void ArrayBounds::visit(const WhileStmt *stmt) {
+  analyze(stmt->condition);
+  analyze(stmt->body);
+}
+
+void ArrayBounds::visit(const FuncStmt *stmt) { analyze(stmt->body); }
+
+void ArrayBounds::visit(const ReturnStmt *stmt) {
+  if (stmt->value) {
+    analyze(stmt->value);
+  }
+}
+
+void ArrayBounds::visit(const Unary *expr) { analyze(&expr->right); }
+
+void ArrayBounds::visit(const Binary *expr) {
+  analyze(&expr->left);
+  analyze(&expr->right);
+}
+
+void ArrayBounds::visit(const Grouping *expr) { analyze(&expr->expression); }
+
+void ArrayBounds::visit(const StrLiteral *) {}
+void ArrayBounds::visit(const NumLiteral *) {}
+void ArrayBounds::visit(const BoolLiteral *) {}
+void ArrayBounds::visit(const Variable *) {}
+void ArrayBounds::visit(const SentinelExpr *) {}
+void ArrayBounds::visit(const This *) {}
+
+void ArrayBounds::visit(const Assignment *expr) {
+  analyze(&expr->value);
+  write(expr->name.id, expr);
+}
+
+void ArrayBounds::visit(const Logical *expr) {
+  analyze(&expr->left);
+  analyze(&expr->right);
+}
+
+void ArrayBounds::visit(const Call *expr) {
+  analyze(&expr->callee);
+  for (const Expr *arg : expr->args) {
+    analyze(arg);
+  }
+}
+
+void ArrayBounds::visit(const Get *expr) { analyze(&expr->callee); }
+
+void ArrayBounds::visit(const Set *expr) {
+  analyze(&expr->callee);
+  analyze(&expr->value);
+}
+
+void ArrayBounds::visit(const GetIndex *expr) {
+  std::vector<const Expr *> indices;
+  const Expr *array =
+      Arrays::element_access(expr->callee, expr->index, indices);
+  analyze(array);
+  for (const Expr *index : indices) {
+    analyze(index);
+  }
+  access(expr, *array, indices);
+}
+
+void ArrayBounds::visit(const SetIndex *expr) {
+  std::vector<const Expr *> indices;
+  const Expr *array =
+      Arrays::element_access(expr->callee, expr->index, indices);
+  analyze(array);
+  for (const Expr *index : indices) {
+    analyze(index);
+  }
+  analyze(&expr->value);
+  access(expr, *array, indices);
+}
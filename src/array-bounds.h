@@ -0,0 +1,73 @@
+#ifndef _NL_ARRAY_BOUNDS_H_
+#define _NL_ARRAY_BOUNDS_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "expr-map.h"
+#include "expr-types.h"
+#include "stmt.h"
+#include "visitor.h"
+
+/*
+ * Bounds check elimination. The backends check every array access
+ * against the array's size, except those this pass proves in bounds.
+ *
+ * The proof is a range analysis of induction loops, which is what for
+ * loops are desugared into:
+ *
+ *   { var i = <literal >= 0>;
+ *     while (i < a.size) { ...; i = i + 1; } }
+ *
+ * If neither i nor a is assigned or redeclared elsewhere in the loop, i
+ * is within [0, a.size) throughout the body, and so is every a[i] in it.
+ *
+ * Runs after type checking. The result is a side table of the element
+ * accesses (outermost GetIndex or SetIndex) that need no check.
+ */
+class ArrayBounds : public ExprVisitor<void>, public StmtVisitor<void> {
+public:
+  explicit ArrayBounds(const ExprTypes &expr_types) : expr_types(expr_types) {}
+
+  void analyze_program(const std::vector<Stmt *> &program);
+
+  /* Whether an indexing expression is known to be within its array. */
+  bool in_bounds(const Expr *access) const {
+    return proven.get(access) != 0;
+  }
+
+  size_t num_checks() const { return checks; }
+  size_t num_eliminated() const { return eliminated; }
+
+  OVERRIDE_EXPR_VISITOR_FNS(void)
+  OVERRIDE_STMT_VISITOR_FNS(void)
+
+private:
+  const ExprTypes &expr_types;
+
+  // An induction loop being analyzed: index stays in [0, array.size) in
+  // its body unless either variable is written to there.
+  struct Loop {
+    Ident index;
+    Ident array;
+    const Expr *increment; // The one write to index allowed.
+    bool invalidated = false;
+    std::vector<const Expr *> accesses; // array[index], to prove if valid.
+  };
+  std::vector<Loop> loops;
+
+  ExprMap<uint8_t> proven; // Not bool: ExprMap hands out references.
+  size_t checks = 0;
+  size_t eliminated = 0;
+
+  void analyze(const std::vector<Stmt *> &stmts);
+  void analyze(const Stmt *stmt);
+  void analyze(const Expr *expr);
+  bool induction_loop(const Stmt *init, const Stmt *loop, Loop &result);
+  void write(Ident var, const Expr *by);
+  void access(const Expr *access, const Expr &array,
+              const std::vector<const Expr *> &indices);
+};
+
+#endif // _NL_ARRAY_BOUNDS_H_
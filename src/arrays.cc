@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <cstdlib>
 
 #include "arrays.h"
@@ -7,6 +8,26 @@ namespace Arrays {
 NLType next_enclosed_type(NLType t) {
   assert(t->dims > 0 && "t is not a valid array Type");
   return t->dims == 1 ? t->underlying_type
-                      : Primitives::Array(t->underlying_type, t->dims - 1);
+                      : Primitives::Array(t->underlying_type, t->dims - 1,
+                                          t->soa);
+}
+
+NLType elem_type(NLType t) {
+  assert(t->dims > 0 && "t is not a valid array Type");
+  return t->underlying_type;
+}
+
+const Expr *element_access(const Expr &callee, const Expr &index,
+                           std::vector<const Expr *> &indices) {
+  indices = {&index};
+  const Expr *array = &callee;
+  // Elements are never arrays themselves, so an indexed GetIndex is always
+  // one more dimension of the same access.
+  while (const auto *outer = dynamic_cast<const GetIndex *>(array)) {
+    indices.push_back(&outer->index);
+    array = &outer->callee;
+  }
+  std::reverse(indices.begin(), indices.end());
+  return array;
 }
 } // namespace Arrays
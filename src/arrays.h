@@ -1,11 +1,29 @@
 #ifndef _NL_ARRAYS_H_
 #define _NL_ARRAYS_H_
 
+#include <vector>
+
+#include "expr.h"
 #include "nltype.h"
 #include "type.h"
 
+/*
+ * Arrays of any number of dimensions are a single row-major allocation of
+ * their elements. a[i][j] is parsed as GetIndex(GetIndex(a, i), j), but
+ * addresses one element of a: a[i] on its own isn't a value.
+ */
 namespace Arrays {
+/* The type of a[i] while a is being indexed. */
 NLType next_enclosed_type(NLType t);
-}
+
+/* The type of a's elements, whatever its number of dimensions. */
+NLType elem_type(NLType t);
+
+/* Given the callee and index of the outermost GetIndex or SetIndex of an
+   element access, returns the array being indexed and fills in the
+   indices, outermost first. */
+const Expr *element_access(const Expr &callee, const Expr &index,
+                           std::vector<const Expr *> &indices);
+} // namespace Arrays
 
 #endif // _NL_ARRAYS_H_
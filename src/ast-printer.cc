@@ -42,7 +42,7 @@ std::string AstPrinter::visit(const PrintStmt *stmt) {
 
 std::string AstPrinter::visit(const VarStmt *stmt) {
   ostringstream out;
-  OUT << "<Var name=" << stmt->name.lexeme << " type=" << stmt->tp.name.lexeme;
+  OUT << "<Var name=" << stmt->name.lexeme() << " type=" << stmt->tp.name.lexeme();
   if (stmt->expression) {
     out << " initializer=" << print(stmt->expression);
   }
@@ -53,16 +53,17 @@ std::string AstPrinter::visit(const VarStmt *stmt) {
 
 std::string AstPrinter::visit(const ClassStmt *stmt) {
   ostringstream out;
-  OUT << "<Class " << stmt->name.lexeme << std::endl;
+  OUT << (stmt->is_struct ? "<Struct " : "<Class ") << stmt->name.lexeme()
+      << std::endl;
   if (stmt->superclass) {
-    out << "  superclass=" << stmt->superclass->lexeme << std::endl;
+    out << "  superclass=" << stmt->superclass->lexeme() << std::endl;
   }
   nest++;
   OUT << "fields: " << std::endl;
   nest++;
   for (size_t i = 0; i < stmt->fields.size(); i++) {
-    OUT << stmt->fields[i].lexeme
-        << " type : " << stmt->field_types[i].name.lexeme;
+    OUT << stmt->fields[i].lexeme()
+        << " type : " << stmt->field_types[i].name.lexeme();
     out << " ";
   }
   nest--;
@@ -118,13 +119,13 @@ std::string AstPrinter::visit(const WhileStmt *stmt) {
 
 std::string AstPrinter::visit(const FuncStmt *stmt) {
   ostringstream out;
-  out << "<Function name='" << stmt->name.lexeme << "'  returns='"
-      << stmt->return_type.name.lexeme << "'"
+  out << "<Function name='" << stmt->name.lexeme() << "'  returns='"
+      << stmt->return_type.name.lexeme() << "'"
       << "  args=( ";
 
   for (size_t i = 0; i < stmt->parameters.size(); i++) {
-    OUT << stmt->parameters[i].lexeme << ":"
-        << stmt->parameter_types[i].name.lexeme << " ";
+    OUT << stmt->parameters[i].lexeme() << ":"
+        << stmt->parameter_types[i].name.lexeme() << " ";
   }
   out << ") Body=" << std::endl;
 
@@ -149,14 +150,14 @@ std::string AstPrinter::visit(const ReturnStmt *stmt) {
 }
 
 std::string AstPrinter::visit(const Binary *expr) {
-  return parenthesize((expr->op).lexeme, &(expr->left), &(expr->right));
+  return parenthesize((expr->op).lexeme(), &(expr->left), &(expr->right));
 }
 
 std::string AstPrinter::visit(const Call *expr) { return "Call"; }
 
-std::string AstPrinter::visit(const Get *expr) { return "Get " + expr->name.lexeme; }
+std::string AstPrinter::visit(const Get *expr) { return "Get " + expr->name.lexeme(); }
 
-std::string AstPrinter::visit(const Set *expr) { return "Set " + expr->name.lexeme; }
+std::string AstPrinter::visit(const Set *expr) { return "Set " + expr->name.lexeme(); }
 
 std::string AstPrinter::visit(const GetIndex *expr) {
   return "<GetIndex " + print(&expr->callee) + "[" + print(&expr->index) + "]>";
@@ -170,7 +171,7 @@ std::string AstPrinter::visit(const SetIndex *expr) {
 std::string AstPrinter::visit(const This *expr) { return "This"; }
 
 std::string AstPrinter::visit(const Assignment *expr) {
-  return "<Assignment var=" + expr->name.lexeme +
+  return "<Assignment var=" + expr->name.lexeme() +
          " value=" + print(&expr->value) + ">";
 }
 
@@ -203,15 +204,15 @@ std::string AstPrinter::visit(const Grouping *expr) {
 }
 
 std::string AstPrinter::visit(const Unary *expr) {
-  return parenthesize((expr->op).lexeme, &(expr->right));
+  return parenthesize((expr->op).lexeme(), &(expr->right));
 }
 
 std::string AstPrinter::visit(const Variable *expr) {
-  return expr->name.lexeme;
+  return expr->name.lexeme();
 }
 
 std::string AstPrinter::visit(const Logical *expr) {
-  return parenthesize(expr->op.lexeme, &expr->left, &expr->right);
+  return parenthesize(expr->op.lexeme(), &expr->left, &expr->right);
 }
 
 std::string AstPrinter::parenthesize(std::string name, const Expr *expr) {
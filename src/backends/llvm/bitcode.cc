@@ -1,6 +1,7 @@
 #include <system_error>
 
 #include "backends/llvm/codegen.h"
+#include "pass-timer.h"
 
 #include "llvm/Bitcode/BitcodeWriter.h"
 #include "llvm/Support/FileSystem.h"
@@ -23,10 +24,34 @@
  *
  * 1) as -o assembled out.s
  * 2) ld -macosx_version_min 10.11.0 -o executable assembled -lSystem
+ *
+ * `--emit=asm|obj|exe` does this without llc; see target.cc.
  */
-void CodeGen::write_bitcode() {
+bool CodeGen::write_bitcode(const std::string &path) {
+  PassTimer timer("Bitcode output");
   std::error_code EC;
-  llvm::raw_fd_ostream os("out.bc", EC, llvm::sys::fs::F_None);
+  llvm::raw_fd_ostream os(path, EC, llvm::sys::fs::F_None);
+  if (EC) {
+    llvm::errs() << "Could not write '" << path << "': " << EC.message()
+                 << "\n";
+    return false;
+  }
   llvm::WriteBitcodeToFile(*module, os);
   os.flush();
+  return true;
+}
+
+/* Textual IR, as lli and llc also accept. */
+bool CodeGen::write_ir(const std::string &path) {
+  PassTimer timer("IR output");
+  std::error_code EC;
+  llvm::raw_fd_ostream os(path, EC, llvm::sys::fs::F_None);
+  if (EC) {
+    llvm::errs() << "Could not write '" << path << "': " << EC.message()
+                 << "\n";
+    return false;
+  }
+  module->print(os, nullptr);
+  os.flush();
+  return true;
 }
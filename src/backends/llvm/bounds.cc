@@ -0,0 +1,48 @@
+/*
+ * Array bounds checks. Every element access compares each of its indices
+ * with the array's extent in that dimension first, unless ArrayBounds
+ * (src/array-bounds.h) has proven it in bounds. A single unsigned compare
+ * catches negative indices too. Failing checks call into the runtime,
+ * which reports the access and aborts.
+ */
+
+#include "backends/llvm/codegen.h"
+
+#include "llvm/IR/DerivedTypes.h"
+#include "llvm/IR/MDBuilder.h"
+
+static llvm::FunctionCallee index_error_callee;
+
+void CodeGen::init_bounds_checks() {
+  llvm::Type *i64 = llvm::Type::getInt64Ty(ctx);
+  llvm::Type *i32 = llvm::Type::getInt32Ty(ctx);
+  index_error_callee = module->getOrInsertFunction(
+      "nl_index_error", llvm::FunctionType::get(llvm::Type::getVoidTy(ctx),
+                                                {i64, i64, i32}, false));
+  if (auto *fn = llvm::dyn_cast<llvm::Function>(
+          index_error_callee.getCallee())) {
+    fn->setDoesNotReturn();
+    fn->addFnAttr(llvm::Attribute::Cold);
+  }
+}
+
+void CodeGen::emit_bounds_check(Value *index, Value *bound,
+                                const Token &bracket) {
+  llvm::Function *fn = builder->GetInsertBlock()->getParent();
+  llvm::BasicBlock *fail = llvm::BasicBlock::Create(ctx, "index_error", fn);
+  llvm::BasicBlock *ok = llvm::BasicBlock::Create(ctx, "index_ok", fn);
+
+  Value *in_bounds = builder->CreateICmpULT(index, bound, "in_bounds");
+  builder->CreateCondBr(in_bounds, ok, fail,
+                        llvm::MDBuilder(ctx).createBranchWeights(2000, 1));
+
+  builder->SetInsertPoint(fail);
+  llvm::Type *i64 = llvm::Type::getInt64Ty(ctx);
+  builder->CreateCall(index_error_callee,
+                      {builder->CreateSExt(index, i64),
+                       builder->CreateSExt(bound, i64),
+                       builder->getInt32(bracket.line)});
+  builder->CreateUnreachable();
+
+  builder->SetInsertPoint(ok);
+}
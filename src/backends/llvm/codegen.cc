@@ -8,6 +8,7 @@
 #include "arrays.h"
 #include "expr.h"
 #include "object.h"
+#include "pass-timer.h"
 #include "primitives.h"
 #include "stmt.h"
 #include "type-builder.h"
@@ -26,9 +27,7 @@
 
 using llvm::AllocaInst;
 using llvm::BasicBlock;
-using llvm::CallInst;
 using llvm::Constant;
-using llvm::ConstantExpr;
 using llvm::ConstantFP;
 using llvm::ConstantInt;
 using llvm::Function;
@@ -53,16 +52,27 @@ Value *CodeGen::get_int32(int value) {
 }
 
 void CodeGen::generate(const std::vector<Stmt *> &program) {
-  sm.reset();
-  globals_only_pass = true;
-  emit(program);
+  {
+    PassTimer timer("Global declarations");
+    sm.reset();
+    globals_only_pass = true;
+    emit(program);
+  }
 
-  // First pass will have collected enough type info to build vtables
-  build_vtables();
+  {
+    PassTimer timer("Vtable emission");
+    // First pass will have collected enough type info to build vtables
+    build_vtables();
+  }
 
+  PassTimer timer("IR emission");
   sm.reset();
   globals_only_pass = false;
   emit(program);
+
+  if (profile) {
+    emit_profile();
+  }
 }
 
 void CodeGen::emit(const std::vector<Stmt *> &stmts) {
@@ -71,24 +81,41 @@ void CodeGen::emit(const std::vector<Stmt *> &stmts) {
   }
 }
 
-void CodeGen::emit(const Stmt *stmt) { stmt->accept(this); }
+void CodeGen::emit(const Stmt *stmt) {
+  // References produced by the last statement's expressions are dead.
+  gc_frame.temps_used = 0;
+  stmt->accept(this);
+}
 
 Value *CodeGen::emit(const Expr *expr) {
+  // Expressions whose value is known (literals included) are emitted as it.
+  if (KnownValue known = consts.value(expr)) {
+    return expr_values[expr] = emit_known(known);
+  }
   expr->accept(this);
   Value *val = expr_values[expr];
   return val;
 }
 
+Value *CodeGen::emit_known(KnownValue known) {
+  switch (known.kind) {
+  case KnownValue::FLOAT:
+    return ConstantFP::get(ctx, llvm::APFloat(known.float_value));
+  case KnownValue::BOOL:
+    return known.int_value ? ConstantInt::getTrue(ctx)
+                           : ConstantInt::getFalse(ctx);
+  default:
+    return get_int32(known.int_value);
+  }
+}
+
 void CodeGen::visit(const Unary *expr) {
   auto r = emit(&expr->right);
-  auto nl_type = expr_types[expr];
+  auto nl_type = expr_types.get(expr);
   if (nl_type == Primitives::Float()) {
-    Value *m1 = ConstantFP::get(ctx, llvm::APFloat(-1.0));
-    expr_values[expr] = builder->CreateFMul(m1, r, "negtmp");
+    expr_values[expr] = builder->CreateFNeg(r, "negtmp");
   } else if (nl_type == Primitives::Int()) {
-    llvm::Type *int_type = llvm::IntegerType::get(ctx, 32);
-    Value *m1 = ConstantInt::get(int_type, -1);
-    expr_values[expr] = builder->CreateMul(m1, r, "negtmp");
+    expr_values[expr] = builder->CreateNeg(r, "negtmp");
   }
 }
 
@@ -96,8 +123,8 @@ void CodeGen::visit(const Binary *expr) {
   Value *l = emit(&expr->left);
   Value *r = emit(&expr->right);
 
-  NLType l_ty = expr_types[&expr->left];
-  NLType r_ty = expr_types[&expr->right];
+  NLType l_ty = expr_types.get(&expr->left);
+  NLType r_ty = expr_types.get(&expr->right);
 
   // Cast Int to Float for comparisons.
   if (l_ty == Primitives::Float() && r_ty == Primitives::Int()) {
@@ -127,22 +154,22 @@ void CodeGen::visit(const Binary *expr) {
   case GREATER: {
     expr_values[expr] =
         NUMERIC_BINOP(l_ty, builder->CreateFCmpUGT(l, r, "cmp_gt_tmp"),
-                      builder->CreateICmpUGT(l, r, "cmp_gt_tmp")) return;
+                      builder->CreateICmpSGT(l, r, "cmp_gt_tmp")) return;
   }
   case GREATER_EQUAL: {
     expr_values[expr] =
         NUMERIC_BINOP(l_ty, builder->CreateFCmpUGE(l, r, "cmp_ge_tmp"),
-                      builder->CreateICmpUGE(l, r, "cmp_ge_tmp")) return;
+                      builder->CreateICmpSGE(l, r, "cmp_ge_tmp")) return;
   }
   case LESS: {
     expr_values[expr] =
         NUMERIC_BINOP(l_ty, builder->CreateFCmpULT(l, r, "cmp_lt_tmp"),
-                      builder->CreateICmpULT(l, r, "cmp_lt_tmp")) return;
+                      builder->CreateICmpSLT(l, r, "cmp_lt_tmp")) return;
   }
   case LESS_EQUAL: {
     expr_values[expr] =
         NUMERIC_BINOP(l_ty, builder->CreateFCmpULE(l, r, "cmp_lte_tmp"),
-                      builder->CreateICmpULE(l, r, "cmp_lte_tmp")) return;
+                      builder->CreateICmpSLE(l, r, "cmp_lte_tmp")) return;
   }
   case EQUAL_EQUAL: {
     // Use 'ordered and equal' here - 'ordered' means that
@@ -176,9 +203,9 @@ void CodeGen::visit(const Binary *expr) {
 }
 
 void CodeGen::visit(const NumLiteral *expr) {
-  if (expr_types[expr] == Primitives::Float()) {
+  if (expr_types.get(expr) == Primitives::Float()) {
     expr_values[expr] = ConstantFP::get(ctx, llvm::APFloat(expr->as_double()));
-  } else if (expr_types[expr] == Primitives::Int()) {
+  } else if (expr_types.get(expr) == Primitives::Int()) {
     llvm::IntegerType *int_type = llvm::IntegerType::get(ctx, 32);
     expr_values[expr] =
         ConstantInt::get(int_type, llvm::StringRef(expr->value), 10);
@@ -190,7 +217,7 @@ void CodeGen::visit(const Grouping *expr) {
 }
 
 void CodeGen::visit(const StrLiteral *expr) {
-  expr_values[expr] = builder->CreateGlobalStringPtr(expr->value);
+  expr_values[expr] = intern_string(expr->value);
 }
 
 void CodeGen::visit(const BoolLiteral *expr) {
@@ -198,26 +225,79 @@ void CodeGen::visit(const BoolLiteral *expr) {
       expr->value ? ConstantInt::getTrue(ctx) : ConstantInt::getFalse(ctx);
 }
 
+/* and/or only evaluate their right operand if the left one doesn't decide
+ the result:
+
+   entry:         l = left; br l, logical_rhs, logical_done  (or: swapped)
+   logical_rhs:   r = right; br logical_done
+   logical_done:  phi [l, entry], [r, logical_rhs]
+*/
 void CodeGen::visit(const Logical *expr) {
-  // TODO: Implement short-circuit semantics here.
-  Value *l = emit(&expr->left);
-  Value *r = emit(&expr->right);
+  Function *func = builder->GetInsertBlock()->getParent();
+  BasicBlock *rhs = BasicBlock::Create(ctx, "logical_rhs", func);
+  BasicBlock *done = BasicBlock::Create(ctx, "logical_done", func);
 
-  if (!l || !r)
+  Value *l = emit(&expr->left);
+  if (!l)
     return;
+  BasicBlock *short_circuit = builder->GetInsertBlock();
+  if (expr->op.type == AND) {
+    builder->CreateCondBr(l, rhs, done);
+  } else {
+    builder->CreateCondBr(l, done, rhs);
+  }
 
-  switch (expr->op.type) {
-  case AND: {
-    expr_values[expr] = builder->CreateAnd(l, r, "and_tmp");
+  builder->SetInsertPoint(rhs);
+  Value *r = emit(&expr->right);
+  if (!r)
+    return;
+  BasicBlock *rhs_end = builder->GetInsertBlock();
+  builder->CreateBr(done);
+
+  builder->SetInsertPoint(done);
+  llvm::PHINode *result = builder->CreatePHI(l->getType(), 2,
+                                             expr->op.type == AND ? "and_tmp"
+                                                                  : "or_tmp");
+  result->addIncoming(l, short_circuit);
+  result->addIncoming(r, rhs_end);
+  expr_values[expr] = result;
+}
+
+/* Branches to if_true or if_false on a Bool condition. and/or (and !)
+ become branches themselves, rather than values that are then tested. */
+void CodeGen::emit_cond_br(const Expr *cond, BasicBlock *if_true,
+                           BasicBlock *if_false) {
+  if (KnownValue known = consts.value(cond)) {
+    builder->CreateBr(known.int_value ? if_true : if_false);
     return;
   }
-  case OR: {
-    expr_values[expr] = builder->CreateOr(l, r, "or_tmp");
+  if (const auto *group = dynamic_cast<const Grouping *>(cond)) {
+    emit_cond_br(&group->expression, if_true, if_false);
     return;
   }
-  default: {
+  if (const auto *unary = dynamic_cast<const Unary *>(cond)) {
+    if (unary->op.type == BANG) {
+      emit_cond_br(&unary->right, if_false, if_true);
+      return;
+    }
+  }
+  if (const auto *logical = dynamic_cast<const Logical *>(cond)) {
+    Function *func = builder->GetInsertBlock()->getParent();
+    BasicBlock *rhs = BasicBlock::Create(
+        ctx, logical->op.type == AND ? "and_rhs" : "or_rhs", func);
+    if (logical->op.type == AND) {
+      emit_cond_br(&logical->left, rhs, if_false);
+    } else {
+      emit_cond_br(&logical->left, if_true, rhs);
+    }
+    builder->SetInsertPoint(rhs);
+    emit_cond_br(&logical->right, if_true, if_false);
     return;
   }
+
+  Value *value = emit(cond);
+  if (value) {
+    builder->CreateCondBr(value, if_true, if_false);
   }
 }
 
@@ -232,49 +312,48 @@ static Value *emit_default_val(llvm::LLVMContext &ctx, NLType t) {
   return nullptr;
 }
 
-Value *CodeGen::emit_num_elems(const std::vector<const Expr *> dims) {
-  if (dims.empty()) {
+Value *CodeGen::emit_num_elems(const std::vector<Value *> &extents) {
+  if (extents.empty()) {
     return get_int32(0);
   }
   Value *total_elems = get_int32(1);
   // TODO: check that each dim is > 0.
-  for (const Expr *expr : dims) {
-    Value *val = emit(expr);
-    total_elems = builder->CreateMul(total_elems, val, "arr_size_mul");
+  for (Value *extent : extents) {
+    total_elems = builder->CreateMul(total_elems, extent, "arr_size_mul");
   }
   return total_elems;
 }
 
 Value *CodeGen::emit_array_init(NLType nl_type,
-                                const std::vector<const Expr *> dims) {
+                                const std::vector<const Expr *> dims,
+                                uint32_t stack_elems) {
   llvm::Type *hdr_type =
       llvm::cast<llvm::PointerType>(tb.to_llvm(nl_type))->getElementType();
-  Constant *alloc_size = ConstantExpr::getSizeOf(hdr_type);
-
-  // Allocate the array header struct
-  llvm::Instruction *malloc_hdr = CallInst::CreateMalloc(
-      builder->GetInsertBlock(), llvm::Type::getInt64Ty(ctx), hdr_type,
-      alloc_size, nullptr, nullptr, "arr_init_malloc");
-  builder->Insert(malloc_hdr);
 
-  Value *array_size = emit_num_elems(dims);
+  std::vector<Value *> extents;
+  for (const Expr *expr : dims) {
+    extents.push_back(emit(expr));
+  }
+  Value *array_size = emit_num_elems(extents);
 
-  // Allocate the elements
-  llvm::Type *inner_elem_type = tb.to_llvm(Arrays::next_enclosed_type(nl_type));
-  alloc_size = ConstantExpr::getSizeOf(inner_elem_type);
-  llvm::Instruction *malloc_elems = CallInst::CreateMalloc(
-      builder->GetInsertBlock(), llvm::Type::getInt64Ty(ctx), inner_elem_type,
-      alloc_size, array_size, nullptr, "arr_elems_malloc");
-  builder->Insert(malloc_elems);
+  // Elements are allocated right after the array header, in one block
+  // whatever the number of dimensions.
+  Value *malloc_hdr = stack_elems ? emit_stack_alloc(nl_type, stack_elems)
+                                  : emit_alloc(nl_type, array_size);
 
   // Set elems ptr
-  Value *arr_elems_ptr = builder->CreateGEP(
-      malloc_hdr, {get_int32(0), get_int32(NL_ARR_ELEMS_IDX)});
-
-  builder->CreateStore(
-      builder->CreateBitCast(malloc_elems,
-                             llvm::PointerType::get(inner_elem_type, 0)),
-      arr_elems_ptr, "store_arr_size");
+  llvm::Type *inner_elem_type = tb.to_llvm(Arrays::elem_type(nl_type));
+  Value *elems = builder->CreateInBoundsGEP(hdr_type, malloc_hdr, get_int32(1));
+  if (nl_type->soa) {
+    emit_soa_columns(nl_type, malloc_hdr, elems, array_size);
+  } else {
+    Value *arr_elems_ptr = builder->CreateGEP(
+        malloc_hdr, {get_int32(0), get_int32(NL_ARR_ELEMS_IDX)});
+    builder->CreateStore(
+        builder->CreateBitCast(elems,
+                               llvm::PointerType::get(inner_elem_type, 0)),
+        arr_elems_ptr);
+  }
 
   // Set array size
   Value *arr_size_ptr = builder->CreateGEP(
@@ -283,13 +362,43 @@ Value *CodeGen::emit_array_init(NLType nl_type,
 
   builder->CreateStore(array_size, arr_size_ptr, "store_arr_size");
 
+  // Set extents and row-major strides
+  if (dims.size() > 1) {
+    Value *stride = get_int32(1);
+    for (size_t i = dims.size(); i-- > 0;) {
+      builder->CreateStore(
+          extents[i], builder->CreateGEP(malloc_hdr,
+                                         {get_int32(0),
+                                          get_int32(NL_ARR_EXTENTS_IDX),
+                                          get_int32(i)}));
+      builder->CreateStore(
+          stride, builder->CreateGEP(malloc_hdr,
+                                     {get_int32(0),
+                                      get_int32(NL_ARR_STRIDES_IDX),
+                                      get_int32(i)}));
+      stride = builder->CreateMul(stride, extents[i], "arr_stride");
+    }
+  }
+
   return malloc_hdr;
 }
 
+Value *CodeGen::emit_array_size(Value *array) {
+  return builder->CreateLoad(
+      builder->CreateGEP(array, {get_int32(0), get_int32(NL_ARR_SIZE_IDX)}),
+      "arr_size");
+}
+
+/* Loads a dimension's extent or stride from a multi-dimensional array. */
+Value *CodeGen::emit_array_field(Value *array, int field, size_t dim) {
+  return builder->CreateLoad(builder->CreateGEP(
+      array, {get_int32(0), get_int32(field), get_int32(dim)}));
+}
+
 void CodeGen::visit(const VarStmt *stmt) {
   // TODO: Handle global variables.
-  const std::string varname = stmt->name.lexeme;
-  NLType nl_type = sm.current().typetab->get(varname);
+  const std::string varname = stmt->name.lexeme();
+  NLType nl_type = sm.types.get(stmt->name.id);
   llvm::Type *ll_type = tb.to_llvm(nl_type);
 
   assert(builder->GetInsertBlock() && builder->GetInsertBlock()->getParent() &&
@@ -301,11 +410,15 @@ void CodeGen::visit(const VarStmt *stmt) {
   } else {
     init = emit_default_val(ctx, nl_type);
     if (!init) {
-      init = nl_type->is_array_type() ? emit_array_init(nl_type, stmt->tp.dims)
-                                      : llvm::UndefValue::get(ll_type);
+      init = nl_type->is_array_type()
+                 ? emit_array_init(nl_type, stmt->tp.dims,
+                                   escapes.stack_array_size(stmt))
+                 : Constant::getNullValue(ll_type);
     }
   }
-  AllocaInst *alloca = entry_block_alloca(fn, varname, ll_type);
+  AllocaInst *alloca = is_gc_ref(nl_type)
+                           ? gc_root_slot(varname, ll_type)
+                           : entry_block_alloca(fn, varname, ll_type);
   // Bitcast to match variable type.
   builder->CreateStore(builder->CreateBitCast(init, ll_type), alloca);
 
@@ -313,7 +426,7 @@ void CodeGen::visit(const VarStmt *stmt) {
 }
 
 void CodeGen::visit(const Variable *expr) {
-  const std::string varname = expr->name.lexeme;
+  const std::string varname = expr->name.lexeme();
 
   // HACK
   if (module->getFunction(varname)) {
@@ -332,20 +445,11 @@ void CodeGen::visit(const Variable *expr) {
 
 void CodeGen::visit(const Assignment *expr) {
   llvm::Value *value = emit(&expr->value);
-  const std::string varname = expr->name.lexeme;
+  const std::string varname = expr->name.lexeme();
   builder->CreateStore(value, named_vals->get(varname));
   expr_values[expr] = value;
 }
 
-static bool is_initializer(const std::string &fn) {
-  const std::string init("_init");
-  if (fn.length() >= init.length()) {
-    return (0 == fn.compare(fn.length() - init.length(), init.length(), init));
-  } else {
-    return false;
-  }
-}
-
 void CodeGen::visit(const Call *expr) {
   Value *callee = emit(&expr->callee);
   assert(callee->getType()->isPointerTy() &&
@@ -357,20 +461,20 @@ void CodeGen::visit(const Call *expr) {
 
   std::vector<Value *> args;
 
-  // Initializers are special :)
+  // Initializers are special :) They're called on the class, methods on
+  // an object.
   std::string fn_name = callee->getName();
-  if (is_initializer(fn_name)) {
+  const bool initializer =
+      expr->callee.is_object_field() &&
+      expr_types.get(&static_cast<const Get &>(expr->callee).callee) ==
+          Primitives::Class();
+  if (initializer) {
     const std::string classname = fn_name.substr(0, fn_name.find("_init"));
-    auto nl_type = sm.current().typetab->get(classname);
-    PointerType *ll_type = llvm::cast<PointerType>(tb.to_llvm(nl_type));
-    llvm::Type *ll_element_type = ll_type->getElementType();
-
-    Constant *alloc_size = ConstantExpr::getSizeOf(ll_element_type);
-    llvm::Instruction *malloc_instr = CallInst::CreateMalloc(
-        builder->GetInsertBlock(), llvm::Type::getInt64Ty(ctx), ll_element_type,
-        alloc_size, nullptr, nullptr, "malloced_" + classname);
-
-    builder->Insert(malloc_instr);
+    auto nl_type = sm.types.get(Interner::intern(classname));
+    // Rooted, since evaluating the initializer's args may collect.
+    Value *malloc_instr = gc_root_temp(escapes.on_stack(expr)
+                                           ? emit_stack_alloc(nl_type)
+                                           : emit_alloc(nl_type));
 
     args.push_back(malloc_instr); // 'this' pointer.
 
@@ -390,7 +494,7 @@ void CodeGen::visit(const Call *expr) {
   }
 
   // Possibly a method call
-  if (!is_initializer(fn_name) && expr->callee.is_object_field()) {
+  if (!initializer && expr->callee.is_object_field()) {
     // Bitcast 'this' to the right type and supply it as first arg.
     llvm::FunctionType *ll_fn_type = llvm::cast<llvm::FunctionType>(
         llvm::cast<PointerType>(callee->getType())->getElementType());
@@ -398,7 +502,7 @@ void CodeGen::visit(const Call *expr) {
         builder->CreateBitCast(last_deref_obj, ll_fn_type->params()[0]));
   }
 
-  NLType nltype = expr_types[&expr->callee];
+  NLType nltype = expr_types.get(&expr->callee);
   assert(nltype->is_function_type() && "Callee is not a function");
   std::vector<NLType> arg_types = nltype->functype->arg_types;
 
@@ -410,19 +514,25 @@ void CodeGen::visit(const Call *expr) {
   }
 
   // Cannot attach a name ("calltmp") to void values, so no name here.
-  expr_values[expr] = builder->CreateCall(callee, args);
+  GuardedCall guard = guarded_calls.get(&expr->callee);
+  expr_values[expr] = guard.target
+                          ? emit_guarded_call(guard, callee, args)
+                          : builder->CreateCall(callee, args);
+  if (is_gc_ref(expr_types.get(expr)) && expr != returned_call) {
+    gc_root_temp(expr_values[expr]);
+  }
 }
 
 void CodeGen::visit(const Get *expr) {
-  auto field_name = expr->name.lexeme;
+  auto field_name = expr->name.lexeme();
 
-  NLType callee_nltype = expr_types[&expr->callee];
+  NLType callee_nltype = expr_types.get(&expr->callee);
   assert(callee_nltype && "NL Type of callee unknown");
 
   // Initializers / static fields
   if (callee_nltype == Primitives::Class()) {
     const Variable *callee = static_cast<const Variable *>(&expr->callee);
-    const std::string class_name = callee->name.lexeme;
+    const std::string class_name = callee->name.lexeme();
 
     if (field_name == "init") {
       expr_values[expr] = module->getFunction(class_name + "_init");
@@ -430,26 +540,51 @@ void CodeGen::visit(const Get *expr) {
     return;
   }
 
+  // Fields of soa array elements are read straight from their column.
+  if (soa_element(&expr->callee)) {
+    expr_values[expr] = builder->CreateLoad(
+        emit_field_ptr(&expr->callee, expr->name), "load_" + field_name);
+    return;
+  }
+
   Value *callee = emit(&expr->callee);
+  if (callee_nltype->is_array_type()) {
+    expr_values[expr] = emit_array_size(callee); // The only array field.
+    return;
+  }
+
+  // Structs are values, with no header before their fields.
+  if (callee_nltype->is_struct) {
+    expr_values[expr] = builder->CreateExtractValue(
+        callee, callee_nltype->field_idx(expr->name.id), field_name);
+    return;
+  }
+
   last_deref_obj = callee;
   llvm::Type *int64PtrTy = llvm::Type::getInt64PtrTy(ctx);
   llvm::Type *int64PtrPtrTy = PointerType::getUnqual(int64PtrTy);
 
   // Virtual method call
-  if (callee_nltype->has_method(field_name)) {
+  if (callee_nltype->has_method(expr->name.id)) {
+    // Monomorphic calls (see class-hierarchy.h) skip the vtable.
+    if (const Type *impl = cha.direct_target(expr)) {
+      expr_values[expr] = get_virtual_method(impl, field_name);
+      return;
+    }
 
     llvm::Type *ll_vt_type =
         module->getTypeByName("__vtable_t_" + callee_nltype->name);
     llvm::Type *fn_type =
-        tb.to_llvm(callee_nltype->get_method(field_name), callee_nltype);
+        tb.to_llvm(callee_nltype->get_method(expr->name.id), callee_nltype);
 
-    const int method_idx = callee_nltype->method_idx(field_name);
+    const int method_idx = callee_nltype->method_idx(expr->name.id);
     auto vtable_ptr_ptr = builder->CreateGEP(
         last_deref_obj, {get_int32(0), get_int32(NL_OBJ_VT_IDX)});
 
     // Load the method pointer from this object's vtable
     llvm::Value *vtable_ptr =
         builder->CreateLoad(int64PtrPtrTy, vtable_ptr_ptr);
+    profile_call_site(expr, callee_nltype, vtable_ptr);
     vtable_ptr =
         builder->CreateBitCast(vtable_ptr, PointerType::getUnqual(ll_vt_type));
     llvm::Value *vt_entry =
@@ -463,33 +598,60 @@ void CodeGen::visit(const Get *expr) {
 
   // Instance fields
   const int field_idx =
-      obj_header_size(ctx) + callee_nltype->field_idx(field_name);
+      obj_header_size(ctx) + callee_nltype->field_idx(expr->name.id);
   expr_values[expr] = builder->CreateLoad(
       builder->CreateGEP(callee, {get_int32(0), get_int32(field_idx)},
                          "fieldaccess_" + field_name),
       "load_" + field_name);
+  if (is_gc_ref(expr_types.get(expr))) {
+    gc_root_temp(expr_values[expr]);
+  }
 }
 
 void CodeGen::visit(const Set *expr) {
-  auto field_name = expr->name.lexeme;
-  NLType callee_nltype = expr_types[&expr->callee];
-  assert(callee_nltype && "NL Type of callee unknown");
+  assert(expr_types.get(&expr->callee) && "NL Type of callee unknown");
 
-  Value *callee = emit(&expr->callee);
+  // A struct's field is set where the struct is stored.
+  Value *elem_ptr = emit_field_ptr(&expr->callee, expr->name);
   Value *value = emit(&expr->value);
 
   assert(value && "Set value cannot be null");
 
-  const int field_idx =
-      obj_header_size(ctx) + callee_nltype->field_idx(field_name);
-  Value *elem_ptr =
-      builder->CreateGEP(callee, {get_int32(0), get_int32(field_idx)},
-                         "fieldaccess_" + field_name);
-
   // Instance fields / methods
   expr_values[expr] = builder->CreateStore(value, elem_ptr);
 }
 
+/* The address of an object's or a struct's field. Structs are reached
+ through the variable, field or array element that holds them. */
+Value *CodeGen::emit_field_ptr(const Expr *callee, const Token &field) {
+  NLType nl_type = expr_types.get(callee);
+  int field_idx = nl_type->field_idx(field.id);
+  if (const GetIndex *element = soa_element(callee)) {
+    return emit_soa_column_ptr(element, field_idx);
+  }
+  if (!nl_type->is_struct) {
+    field_idx += obj_header_size(ctx);
+  }
+  Value *obj = nl_type->is_struct ? emit_struct_ptr(callee) : emit(callee);
+  return builder->CreateGEP(obj, {get_int32(0), get_int32(field_idx)},
+                            "fieldaccess_" + field.lexeme());
+}
+
+Value *CodeGen::emit_struct_ptr(const Expr *lvalue) {
+  if (const auto *group = dynamic_cast<const Grouping *>(lvalue)) {
+    return emit_struct_ptr(&group->expression);
+  }
+  if (const auto *var = dynamic_cast<const Variable *>(lvalue)) {
+    return named_vals->get(var->name.lexeme());
+  }
+  if (const auto *get = dynamic_cast<const Get *>(lvalue)) {
+    return emit_field_ptr(&get->callee, get->name);
+  }
+  const auto *index = dynamic_cast<const GetIndex *>(lvalue);
+  assert(index && "Struct is not stored anywhere (see TypeChecker)");
+  return emit_element_ptr(index, index->callee, index->index, index->bracket);
+}
+
 void CodeGen::visit(const This *expr) {
   expr_values[expr] = builder->CreateLoad(named_vals->get("this"), "this");
 }
@@ -505,35 +667,27 @@ void CodeGen::visit(const BlockStmt *stmt) {
 void CodeGen::visit(const PrintStmt *stmt) {
   if (stmt->expression) {
     Value *value = emit(stmt->expression);
-    call_printf(value, expr_types[stmt->expression]);
+    emit_print(value, expr_types.get(stmt->expression));
   }
 }
 
-/* Fetches the correct implementation of method that should be used
- for dynamic dispatch with type. Note that NL doesn't allow name reuse
- within a class, so the method name alone suffices here. However, it can
- be mangled to allow such behavior in the future. */
-llvm::Function *CodeGen::get_virtual_method(NLType type,
+/* Fetches the implementation of method defined by impl_class, which the
+ type's layout says fills that vtable slot. Note that NL doesn't allow name
+ reuse within a class, so the method name alone suffices here. However, it
+ can be mangled to allow such behavior in the future. */
+llvm::Function *CodeGen::get_virtual_method(const Type *impl_class,
                                             const std::string &method) {
-  NLType curr = type; // Curr is self or parent
-  for (NLType curr = type; curr != nullptr; curr = curr->supertype) {
-    for (llvm::Function *f : methods[curr]) {
-      // TODO: Extract method name building into a function.
-      std::string method_name = curr->name + "_" + method;
-      if (f->getName() == method_name) {
-        return f;
-      }
-    }
-  }
+  // TODO: Extract method name building into a function.
+  llvm::Function *f = module->getFunction(impl_class->name + "_" + method);
 
   // Unreachable, if type-checked correctly
-  assert(false && "Virtual method impl not found");
-  return nullptr;
+  assert(f && "Virtual method impl not found");
+  return f;
 }
 
 void CodeGen::visit(const ClassStmt *stmt) {
-  std::string classname = stmt->name.lexeme;
-  auto nl_type = sm.current().typetab->get(classname);
+  std::string classname = stmt->name.lexeme();
+  auto nl_type = sm.types.get(stmt->name.id);
   assert(nl_type && "NLType for class not found");
 
   if (globals_only_pass) {
@@ -558,8 +712,10 @@ void CodeGen::build_vtables() {
 
     std::vector<llvm::FunctionType *> fn_types;
     std::vector<llvm::Constant *> method_ptrs;
-    for (auto m : nl_type->get_methods()) {
-      llvm::Function *vm = get_virtual_method(nl_type, m->name);
+    const auto &vtable = nl_type->get_methods();
+    for (size_t i = 0; i < vtable.size(); i++) {
+      llvm::Function *vm =
+          get_virtual_method(nl_type->method_owner(i), vtable[i]->name);
       fn_types.push_back(vm->getFunctionType());
       method_ptrs.push_back(llvm::cast<llvm::Constant>(vm));
     }
@@ -574,22 +730,23 @@ void CodeGen::build_vtables() {
 }
 
 void CodeGen::visit(const IfStmt *stmt) {
-  Value *cond = emit(stmt->condition);
-  if (!cond)
-    return;
-  cond = builder->CreateICmpNE(cond, ConstantInt::getFalse(ctx), "ifcond");
-
   Function *func = builder->GetInsertBlock()->getParent();
   BasicBlock *br_then = BasicBlock::Create(ctx, "then", func);
   BasicBlock *br_else = BasicBlock::Create(ctx, "else");
   BasicBlock *merge = BasicBlock::Create(ctx, "ifcont");
 
-  builder->CreateCondBr(cond, br_then, br_else);
+  emit_cond_br(stmt->condition, br_then, br_else);
   bool merge_occurs =
       false; // FIXME: Replace with hasNPredecessorsOrMore in LLVM 10.
 
+  // A known condition leaves the other branch empty and unreachable.
+  KnownValue known = consts.value(stmt->condition);
   builder->SetInsertPoint(br_then);
-  emit(stmt->then_branch);
+  if (!known || known.int_value) {
+    emit(stmt->then_branch);
+  } else {
+    sm.skip(consts.scopes_in(stmt->then_branch));
+  }
   // If this BB is already terminated (for example, via a
   // return), do not terminate it again via a branch as it
   // generates incorrect IR.
@@ -600,7 +757,9 @@ void CodeGen::visit(const IfStmt *stmt) {
 
   func->getBasicBlockList().push_back(br_else);
   builder->SetInsertPoint(br_else);
-  if (stmt->else_branch) {
+  if (known && known.int_value) {
+    sm.skip(consts.scopes_in(stmt->else_branch));
+  } else if (stmt->else_branch) {
     emit(stmt->else_branch);
   }
   // All BBs must be terminated (incl. fall-thru's) to pass verification.
@@ -623,11 +782,13 @@ void CodeGen::visit(const WhileStmt *stmt) {
 
   builder->CreateBr(check_cond);
   builder->SetInsertPoint(check_cond);
-  Value *cond = emit(stmt->condition);
-  builder->CreateCondBr(cond, loop, post_loop);
+  emit_cond_br(stmt->condition, loop, post_loop);
 
   builder->SetInsertPoint(loop);
-  if (stmt->body) {
+  KnownValue known = consts.value(stmt->condition);
+  if (known && !known.int_value) {
+    sm.skip(consts.scopes_in(stmt->body));
+  } else if (stmt->body) {
     emit(stmt->body);
   }
 
@@ -636,24 +797,25 @@ void CodeGen::visit(const WhileStmt *stmt) {
 }
 
 void CodeGen::visit(const FuncStmt *stmt) {
-  std::string fn_name = stmt->name.lexeme;
+  std::string fn_name = stmt->name.lexeme();
   std::string orig_fn_name = fn_name;
 
   if (encl_class) {
     fn_name = encl_class->name + "_" + fn_name;
   }
-  if (globals_only_pass) {
-    std::shared_ptr<FuncType> nl_functype;
-    if (encl_class) {
-      nl_functype = encl_class->get_method(stmt->name.lexeme);
-    } else {
-      auto key = TypeTableUtil::fn_key(stmt->name.lexeme);
-      nl_functype = sm.current().typetab->get(key)->functype;
-    }
 
-    assert(nl_functype != nullptr &&
-           "Cannot codegen function: FuncType not found.");
+  std::shared_ptr<FuncType> nl_functype;
+  if (encl_class) {
+    nl_functype = encl_class->get_method(stmt->name.id);
+  } else {
+    auto key = TypeTableUtil::fn_key(stmt->name.id);
+    nl_functype = sm.types.get(key)->functype;
+  }
 
+  assert(nl_functype != nullptr &&
+         "Cannot codegen function: FuncType not found.");
+
+  if (globals_only_pass) {
     FunctionType *ft = tb.to_llvm(nl_functype, encl_class);
     Function *f =
         Function::Create(ft, Function::ExternalLinkage, fn_name, module.get());
@@ -674,19 +836,29 @@ void CodeGen::visit(const FuncStmt *stmt) {
   builder->SetInsertPoint(entry);
 
   std::vector<std::string> arg_names;
-  if (encl_class)
+  std::vector<NLType> arg_nltypes;
+  if (encl_class) {
     arg_names.push_back("this");
+    arg_nltypes.push_back(encl_class);
+  }
   for (auto &tok : stmt->parameters) {
-    arg_names.push_back(tok.lexeme);
+    arg_names.push_back(tok.lexeme());
+  }
+  for (NLType t : nl_functype->arg_types) {
+    arg_nltypes.push_back(t);
   }
 
   enter_scope();
+  GcFrame prev_gc_frame = std::move(gc_frame);
+  gc_frame = GcFrame();
 
   int arg_idx = 0;
   for (auto &arg : func->args()) {
     arg.setName(arg_names[arg_idx]);
     llvm::AllocaInst *alloca =
-        entry_block_alloca(func, arg.getName(), arg_types[arg_idx]);
+        is_gc_ref(arg_nltypes[arg_idx])
+            ? gc_root_slot(arg.getName(), arg_types[arg_idx])
+            : entry_block_alloca(func, arg.getName(), arg_types[arg_idx]);
     arg_idx++;
 
     builder->CreateStore(&arg, alloca);
@@ -698,6 +870,9 @@ void CodeGen::visit(const FuncStmt *stmt) {
   emit(stmt->body);
   encl_fn = prev_encl_fn;
   /* TODO: Here check that there is a return in all predecessors */
+  emit_gc_frame(func);
+  mark_tail_calls(func);
+  gc_frame = std::move(prev_gc_frame);
   exit_scope();
 
   llvm::verifyFunction(*func);
@@ -705,45 +880,105 @@ void CodeGen::visit(const FuncStmt *stmt) {
 
 void CodeGen::visit(const ReturnStmt *stmt) {
   if (stmt->value) {
+    // A returned call may become a tail call (see tail-calls.cc), so its
+    // result isn't rooted: nothing follows it here.
+    const Expr *value = stmt->value;
+    while (const auto *group = dynamic_cast<const Grouping *>(value)) {
+      value = &group->expression;
+    }
+    returned_call = dynamic_cast<const Call *>(value);
+    Value *result = emit(stmt->value);
+    returned_call = nullptr;
     // Bitcast to allow polymorphism in return type
     llvm::Value *val =
-        builder->CreateBitCast(emit(stmt->value), encl_fn->getReturnType());
+        builder->CreateBitCast(result, encl_fn->getReturnType());
     builder->CreateRet(val);
   } else {
     builder->CreateRetVoid();
   }
 }
 
-void CodeGen::visit(const GetIndex *expr) {
-  Value *callee = emit(&expr->callee);
-  Value *index = emit(&expr->index);
+/* Emits the array and indices of an element access, checks them, and
+ returns the address of the element: a single GEP at the sum of each
+ index times its dimension's stride. */
+Value *CodeGen::emit_element_ptr(const Expr *access, const Expr &callee,
+                                 const Expr &index, const Token &bracket) {
+  Value *array;
+  Value *offset = emit_element_offset(access, callee, index, bracket, array);
 
   std::vector<Value *> elems_field_idx = {get_int32(0),
                                           get_int32(NL_ARR_ELEMS_IDX)};
   llvm::Value *elems =
-      builder->CreateLoad(builder->CreateGEP(callee, elems_field_idx));
+      builder->CreateLoad(builder->CreateGEP(array, elems_field_idx));
+
+  std::vector<Value *> elem_idx = {offset};
+  return builder->CreateGEP(elems, elem_idx);
+}
+
+/* Emits and checks an element access, returning the element's position
+ among the array's elements, and setting array. */
+Value *CodeGen::emit_element_offset(const Expr *access, const Expr &callee,
+                                    const Expr &index, const Token &bracket,
+                                    Value *&array) {
+  std::vector<const Expr *> indices;
+  const Expr *array_expr = Arrays::element_access(callee, index, indices);
+  array = emit(array_expr);
+  std::vector<Value *> index_vals;
+  for (const Expr *expr : indices) {
+    index_vals.push_back(emit(expr));
+  }
+
+  const bool checked = !bounds.in_bounds(access);
+  Value *offset = index_vals.back();
+  if (index_vals.size() == 1) {
+    if (checked) {
+      emit_bounds_check(offset, emit_array_size(array), bracket);
+    }
+  } else {
+    for (size_t i = 0; i < index_vals.size(); i++) {
+      if (checked) {
+        emit_bounds_check(index_vals[i],
+                          emit_array_field(array, NL_ARR_EXTENTS_IDX, i),
+                          bracket);
+      }
+    }
+    // The last dimension's stride is 1.
+    for (size_t i = 0; i + 1 < index_vals.size(); i++) {
+      Value *scaled = builder->CreateMul(
+          index_vals[i], emit_array_field(array, NL_ARR_STRIDES_IDX, i));
+      offset = builder->CreateAdd(offset, scaled, "elem_offset");
+    }
+  }
+  return offset;
+}
 
-  std::vector<Value *> elem_idx = {index};
-  auto elem = builder->CreateGEP(elems, elem_idx);
+void CodeGen::visit(const GetIndex *expr) {
+  if (expr_types.get(&expr->callee)->soa) {
+    expr_values[expr] = emit_soa_load(expr);
+    return;
+  }
+
+  auto elem =
+      emit_element_ptr(expr, expr->callee, expr->index, expr->bracket);
 
-  NLType callee_nltype = Arrays::next_enclosed_type(expr_types[&expr->callee]);
+  NLType callee_nltype = expr_types.get(expr);
   llvm::Type *callee_lltype = tb.to_llvm(callee_nltype);
 
   expr_values[expr] = builder->CreateLoad(callee_lltype, elem, "array_deref");
+  if (is_gc_ref(callee_nltype)) {
+    gc_root_temp(expr_values[expr]);
+  }
 }
 
 void CodeGen::visit(const SetIndex *expr) {
-  Value *callee = emit(&expr->callee);
-  Value *index = emit(&expr->index);
-  Value *val = emit(&expr->value);
-
-  std::vector<Value *> elems_field_idx = {get_int32(0),
-                                          get_int32(NL_ARR_ELEMS_IDX)};
-  llvm::Value *elems =
-      builder->CreateLoad(builder->CreateGEP(callee, elems_field_idx));
+  if (expr_types.get(&expr->callee)->soa) {
+    expr_values[expr] = emit_soa_store(expr);
+    return;
+  }
 
-  std::vector<Value *> elem_idx = {index};
-  auto elem = builder->CreateGEP(elems, elem_idx);
+  auto elem =
+      emit_element_ptr(expr, expr->callee, expr->index, expr->bracket);
+  Value *val = emit(&expr->value);
 
   expr_values[expr] = builder->CreateStore(val, elem, "array_store");
 }
@@ -1,14 +1,20 @@
 #ifndef _NL_BACKENDS_LLVM_CODEGEN_H_
 #define _NL_BACKENDS_LLVM_CODEGEN_H_
 
+#include <cstdint>
 #include <map>
 #include <memory>
 #include <string>
 #include <vector>
 
+#include "array-bounds.h"
 #include "cactus-table.h"
+#include "class-hierarchy.h"
+#include "constant-folding.h"
+#include "escape-analysis.h"
 #include "expr-types.h"
 #include "expr.h"
+#include "options.h"
 #include "scope-manager.h"
 #include "type-builder.h"
 #include "visitor.h"
@@ -20,6 +26,7 @@
 #include "llvm/IR/LLVMContext.h"
 #include "llvm/IR/Module.h"
 #include "llvm/IR/Value.h"
+#include "llvm/Target/TargetMachine.h"
 
 using llvm::Value;
 using NamedValueTable = CactusTable<std::string, llvm::AllocaInst *>;
@@ -28,28 +35,54 @@ class CodeGen : public AbstractCodegen,
                 public ExprVisitor<>,
                 public StmtVisitor<> {
 public:
-  explicit CodeGen(ScopeManager &sm, ExprTypes expr_types)
-      : sm(sm), expr_types(expr_types), tb(TypeBuilder(ctx)) {
+  explicit CodeGen(ScopeManager &sm, const ExprTypes &expr_types,
+                   const ConstantFolding &consts, const ClassHierarchy &cha,
+                   const ArrayBounds &bounds, const EscapeAnalysis &escapes)
+      : sm(sm), expr_types(expr_types), consts(consts), cha(cha),
+        bounds(bounds), escapes(escapes), tb(TypeBuilder(ctx)) {
     sm.reset(); // Go to initial (global) scope.
     module = llvm::make_unique<llvm::Module>("neeilang.main_module", ctx);
     builder = llvm::make_unique<llvm::IRBuilder<>>(ctx);
-    init_libc();
+    init_print();
+    init_gc();
+    init_bounds_checks();
   }
 
   void generate(const std::vector<Stmt *> &program);
 
   void print() { module->print(llvm::errs(), nullptr); }
-  void write_bitcode();
+  void optimize(unsigned level); // See optimizer.cc
+
+  // Writes the module in the requested form (see target.cc). Returns
+  // false, having reported why, if that failed.
+  bool write_output(Options::Emit emit, std::string path);
+
+  // Compiles the module in-process and calls its main (see jit.cc).
+  // Returns false, having reported why, if it couldn't be run.
+  bool run_jit(bool lazy, int &status);
+
+  // Profile-guided devirtualization (see profile.cc). Both must be called
+  // before generate(). use_profile returns false, having reported why, if
+  // the profile couldn't be read.
+  void instrument_calls(const std::string &profile_path);
+  bool use_profile(const std::string &path);
 
   OVERRIDE_EXPR_VISITOR_FNS(void)
   OVERRIDE_STMT_VISITOR_FNS(void)
 
 private:
   ScopeManager &sm;
-  ExprTypes expr_types; // Typing information from type-checker
-  std::map<const Expr *, Value *> expr_values;
+  const ExprTypes &expr_types; // Typing information from type-checker
+  const ConstantFolding &consts; // Expressions with known values
+  const ClassHierarchy &cha;    // Monomorphic method calls
+  const ArrayBounds &bounds;    // Accesses that need no bounds check
+  const EscapeAnalysis &escapes; // Allocations that can go on the stack
+  ExprMap<Value *> expr_values;
   Value *last_deref_obj; // Last dereferenced object
-  llvm::LLVMContext ctx;
+  // Held by pointer so that run_jit() can hand it over with the module.
+  std::unique_ptr<llvm::LLVMContext> owned_ctx =
+      llvm::make_unique<llvm::LLVMContext>();
+  llvm::LLVMContext &ctx = *owned_ctx;
   std::unique_ptr<llvm::IRBuilder<>> builder = nullptr;
   TypeBuilder tb;
   std::unique_ptr<llvm::Module> module =
@@ -58,27 +91,112 @@ private:
   NLType encl_class = nullptr;
   llvm::Function *encl_fn = nullptr;
   bool globals_only_pass = true; // Only codegen global classes and functions
-  Value *emit_array_init(NLType nl_type, const std::vector<const Expr *> dims);
-  Value *emit_num_elems(const std::vector<const Expr *> dims);
+  void emit_cond_br(const Expr *cond, llvm::BasicBlock *if_true,
+                    llvm::BasicBlock *if_false);
+  Value *emit_array_init(NLType nl_type, const std::vector<const Expr *> dims,
+                         uint32_t stack_elems = 0);
+  Value *emit_array_size(Value *array);
+  Value *emit_array_field(Value *array, int field, size_t dim);
+  Value *emit_num_elems(const std::vector<Value *> &extents);
+  Value *emit_element_ptr(const Expr *access, const Expr &callee,
+                          const Expr &index, const Token &bracket);
+  Value *emit_element_offset(const Expr *access, const Expr &callee,
+                             const Expr &index, const Token &bracket,
+                             Value *&array);
+  Value *emit_field_ptr(const Expr *callee, const Token &field);
+  Value *emit_struct_ptr(const Expr *lvalue);
 
   Value *codegen(Expr *expr);
   void enter_scope();
   void exit_scope();
 
-  // libc bindings.
-  void init_libc();
-  void call_printf(llvm::Value *value, NLType t);
+  // Print statements and string literals (see print.cc).
+  std::map<std::string, llvm::Constant *> string_pool;
+  void init_print();
+  void emit_print(Value *value, NLType t);
+  llvm::Constant *intern_string(const std::string &s);
 
   void emit(const std::vector<Stmt *> &stmts);
   void emit(const Stmt *stmt);
   Value *emit(const Expr *expr);
 
   Value *get_int32(int value);
+  Value *emit_known(KnownValue known);
+
+  // Garbage collection (see gc.cc).
+  struct GcFrame {
+    std::vector<llvm::AllocaInst *> slots; // Of the current function.
+    std::vector<llvm::AllocaInst *> temps; // Slots for expression results.
+    size_t temps_used = 0;                 // By the current statement.
+  };
+  GcFrame gc_frame;
+  std::map<NLType, llvm::Constant *> type_infos;
+  void init_gc();
+  bool is_gc_ref(NLType t);
+  llvm::Constant *type_info(NLType t);
+  Value *emit_alloc(NLType t, Value *num_elems = nullptr);
+  Value *emit_stack_alloc(NLType t, uint32_t num_elems = 0);
+  llvm::AllocaInst *gc_root_slot(const std::string &name, llvm::Type *type);
+  Value *gc_root_temp(Value *ref);
+  void emit_gc_frame(llvm::Function *fn);
+
+  // Structure-of-arrays layout (see soa.cc).
+  const GetIndex *soa_element(const Expr *expr);
+  void emit_soa_columns(NLType t, Value *array, Value *elems,
+                        Value *num_elems);
+  Value *emit_soa_column_ptr(const GetIndex *element, int field_idx);
+  Value *emit_soa_load(const GetIndex *element);
+  Value *emit_soa_store(const SetIndex *element);
+
+  // Tail calls (see tail-calls.cc).
+  const Call *returned_call = nullptr; // By the return being emitted.
+  static llvm::CallInst *tail_call(llvm::Instruction *ret);
+  void mark_tail_calls(llvm::Function *fn);
+
+  // Array bounds checks (see bounds.cc).
+  void init_bounds_checks();
+  void emit_bounds_check(Value *index, Value *bound, const Token &bracket);
+
+  // Output (see bitcode.cc and target.cc).
+  unsigned opt_level = 0;
+  std::unique_ptr<llvm::TargetMachine> host_machine;
+  llvm::TargetMachine *target_machine();
+  bool write_bitcode(const std::string &path);
+  bool write_ir(const std::string &path);
+  bool write_native(const std::string &path, bool assembly);
+  bool link_executable(const std::string &path);
 
   // Virtual methods
   std::map<NLType, std::vector<llvm::Function *>> methods;
-  llvm::Function *get_virtual_method(NLType type, const std::string &method);
+  llvm::Function *get_virtual_method(const Type *impl_class,
+                                     const std::string &method);
   void build_vtables();
+
+  // Call-site profiles (see profile.cc). Virtual call sites are numbered
+  // in the order they are emitted, which is the same in every compile of
+  // a program.
+  struct SiteProfile {
+    std::string method; // "Class.method"
+    std::map<std::string, uint64_t> receivers;
+  };
+  struct GuardedCall {
+    Value *vtable = nullptr; // The receiver's.
+    const Type *receiver = nullptr;
+    llvm::Function *target = nullptr; // The receiver's implementation.
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+  };
+  uint32_t num_call_sites = 0;
+  llvm::GlobalVariable *profile = nullptr; // When instrumenting.
+  std::string profile_path;
+  std::vector<std::string> site_methods;
+  std::vector<SiteProfile> site_profiles; // When using a profile.
+  bool profile_stale = false;
+  ExprMap<GuardedCall> guarded_calls; // Keyed by the method's Get.
+  void profile_call_site(const Get *expr, NLType static_type, Value *vtable);
+  Value *emit_guarded_call(const GuardedCall &guard, Value *callee,
+                           const std::vector<Value *> &args);
+  void emit_profile();
 };
 
 #endif // _NL_BACKENDS_LLVM_CODEGEN_H_
@@ -0,0 +1,317 @@
+/*
+ * Code generation for the garbage collector in runtime/: allocation
+ * through the runtime, per-type tracing info, and shadow stack frames.
+ *
+ * Allocation bumps the runtime's nursery pointer inline, and only calls
+ * into the runtime when the nursery chunk is full (or for big arrays).
+ * What EscapeAnalysis finds can't outlive its function is allocated in
+ * the function's frame instead.
+ *
+ * Every local that holds a reference lives in a slot of its function's
+ * shadow stack frame rather than in an alloca of its own, and so does
+ * each reference an expression produces (allocations, call results,
+ * field and element loads) until its statement is done. Together, the
+ * frames of all active calls are exactly the collector's roots.
+ */
+
+#include <vector>
+
+#include "arrays.h"
+#include "backends/llvm/codegen.h"
+#include "backends/llvm/object.h"
+#include "primitives.h"
+
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/DerivedTypes.h"
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/MDBuilder.h"
+
+// Arrays longer than this are allocated by the runtime, which also
+// rejects negative lengths.
+static const int INLINE_ALLOC_MAX_ELEMS = 4096;
+
+// Mirrors NL_GC_ON_STACK in runtime/nlrt.h.
+static const uint8_t GC_ON_STACK = 2;
+
+static llvm::FunctionCallee alloc_callee;
+static llvm::GlobalVariable *gc_top_frame;
+static llvm::GlobalVariable *nursery;
+static llvm::StructType *type_info_type;
+static llvm::StructType *alloc_header_type;
+static llvm::StructType *alloc_region_type;
+
+void CodeGen::init_gc() {
+  llvm::Type *i8_ptr = llvm::Type::getInt8PtrTy(ctx);
+  llvm::Type *i64 = llvm::Type::getInt64Ty(ctx);
+  llvm::Type *i32 = llvm::Type::getInt32Ty(ctx);
+
+  // Mirrors struct nl_type_info in runtime/nlrt.h.
+  type_info_type = llvm::StructType::create(
+      ctx, {i64, i64, i32, i32, llvm::PointerType::getUnqual(i64)},
+      "__nl_type_info");
+  llvm::Type *type_info_ptr = llvm::PointerType::getUnqual(type_info_type);
+
+  // Mirrors struct nl_alloc_header and nl_alloc_region.
+  alloc_header_type =
+      llvm::StructType::create(ctx, {type_info_ptr, i64}, "__nl_alloc_header");
+  alloc_region_type =
+      llvm::StructType::create(ctx, {i8_ptr, i8_ptr}, "__nl_alloc_region");
+  nursery = llvm::cast<llvm::GlobalVariable>(
+      module->getOrInsertGlobal("nl_nursery", alloc_region_type));
+
+  alloc_callee = module->getOrInsertFunction(
+      "nl_alloc",
+      llvm::FunctionType::get(i8_ptr, {type_info_ptr, i32}, false));
+
+  // Defined by the runtime; frames are linked through it as i8*.
+  gc_top_frame = llvm::cast<llvm::GlobalVariable>(
+      module->getOrInsertGlobal("nl_gc_top_frame", i8_ptr));
+}
+
+bool CodeGen::is_gc_ref(NLType t) {
+  if (t->is_array_type()) {
+    return true;
+  }
+  return !t->is_function_type() && !t->is_struct && t != Primitives::Int() &&
+         t != Primitives::Float() && t != Primitives::Bool() &&
+         t != Primitives::String() && t != Primitives::Void() &&
+         t != Primitives::Class() && t != Primitives::TypeError();
+}
+
+llvm::Constant *CodeGen::type_info(NLType t) {
+  auto it = type_infos.find(t);
+  if (it != type_infos.end()) {
+    return it->second;
+  }
+
+  llvm::Type *i64 = llvm::Type::getInt64Ty(ctx);
+  llvm::Type *i32 = llvm::Type::getInt32Ty(ctx);
+  llvm::StructType *layout = llvm::cast<llvm::StructType>(
+      llvm::cast<llvm::PointerType>(tb.to_llvm(t))->getElementType());
+
+  llvm::Constant *elem_size = llvm::ConstantInt::get(i64, 0);
+  bool elems_are_ptrs = false;
+  std::vector<llvm::Constant *> ptr_offsets;
+  if (t->is_array_type()) {
+    NLType elem_type = Arrays::elem_type(t);
+    elem_size = llvm::ConstantExpr::getSizeOf(tb.to_llvm(elem_type));
+    elems_are_ptrs = is_gc_ref(elem_type);
+  } else {
+    const std::vector<Field> &fields = t->get_fields();
+    for (size_t i = 0; i < fields.size(); i++) {
+      if (is_gc_ref(fields[i].type)) {
+        ptr_offsets.push_back(llvm::ConstantExpr::getOffsetOf(
+            layout, obj_header_size(ctx) + i));
+      }
+    }
+  }
+
+  llvm::Constant *offsets_ptr =
+      llvm::ConstantPointerNull::get(llvm::PointerType::getUnqual(i64));
+  if (!ptr_offsets.empty()) {
+    llvm::ArrayType *offsets_type =
+        llvm::ArrayType::get(i64, ptr_offsets.size());
+    auto offsets = new llvm::GlobalVariable(
+        *module, offsets_type, true, llvm::GlobalValue::PrivateLinkage,
+        llvm::ConstantArray::get(offsets_type, ptr_offsets),
+        "__gc_offsets_" + t->name);
+    llvm::Constant *zero = llvm::ConstantInt::get(i32, 0);
+    offsets_ptr = llvm::ConstantExpr::getInBoundsGetElementPtr(
+        offsets_type, offsets, std::vector<llvm::Constant *>{zero, zero});
+  }
+
+  llvm::Constant *info = llvm::ConstantStruct::get(
+      type_info_type,
+      {llvm::ConstantExpr::getSizeOf(layout), elem_size,
+       llvm::ConstantInt::get(i32, ptr_offsets.size()),
+       llvm::ConstantInt::get(i32, elems_are_ptrs), offsets_ptr});
+  auto gv = new llvm::GlobalVariable(*module, type_info_type, true,
+                                     llvm::GlobalValue::PrivateLinkage, info,
+                                     "__typeinfo_" + t->name);
+  type_infos[t] = gv;
+  return gv;
+}
+
+/* Emits the nursery fast path, falling back to nl_alloc:
+
+   bytes = align8(header + size [+ num_elems * elem_size])
+   if (cursor + bytes <= limit) { obj = cursor + header; cursor += bytes; }
+   else obj = nl_alloc(type_info, num_elems)
+*/
+Value *CodeGen::emit_alloc(NLType t, Value *num_elems) {
+  llvm::Type *i8 = llvm::Type::getInt8Ty(ctx);
+  llvm::Type *i8_ptr = llvm::Type::getInt8PtrTy(ctx);
+  llvm::Type *i64 = llvm::Type::getInt64Ty(ctx);
+  llvm::Function *fn = builder->GetInsertBlock()->getParent();
+  llvm::MDNode *likely = llvm::MDBuilder(ctx).createBranchWeights(2000, 1);
+
+  llvm::BasicBlock *bump = llvm::BasicBlock::Create(ctx, "alloc_bump", fn);
+  llvm::BasicBlock *fast = llvm::BasicBlock::Create(ctx, "alloc_fast", fn);
+  llvm::BasicBlock *slow = llvm::BasicBlock::Create(ctx, "alloc_slow", fn);
+  llvm::BasicBlock *done = llvm::BasicBlock::Create(ctx, "alloc_done", fn);
+
+  llvm::Type *layout =
+      llvm::cast<llvm::PointerType>(tb.to_llvm(t))->getElementType();
+  Value *bytes = llvm::ConstantExpr::getAdd(
+      llvm::ConstantExpr::getSizeOf(alloc_header_type),
+      llvm::ConstantExpr::getSizeOf(layout));
+  Value *count = num_elems ? num_elems : get_int32(0);
+
+  if (num_elems) {
+    Value *small = builder->CreateICmpULE(
+        num_elems, get_int32(INLINE_ALLOC_MAX_ELEMS), "alloc_small");
+    builder->CreateCondBr(small, bump, slow, likely);
+    builder->SetInsertPoint(bump);
+
+    llvm::Type *elem_type = tb.to_llvm(Arrays::elem_type(t));
+    bytes = builder->CreateAdd(
+        bytes, builder->CreateMul(builder->CreateZExt(num_elems, i64),
+                                  llvm::ConstantExpr::getSizeOf(elem_type)));
+  } else {
+    builder->CreateBr(bump);
+    builder->SetInsertPoint(bump);
+  }
+
+  bytes = builder->CreateAnd(
+      builder->CreateAdd(bytes, llvm::ConstantInt::get(i64, 7)),
+      llvm::ConstantInt::get(i64, ~uint64_t(7)), "alloc_bytes");
+  Value *cursor_ptr = builder->CreateStructGEP(alloc_region_type, nursery, 0);
+  Value *limit_ptr = builder->CreateStructGEP(alloc_region_type, nursery, 1);
+  Value *cursor = builder->CreateLoad(i8_ptr, cursor_ptr, "nursery_cursor");
+  Value *next = builder->CreateGEP(i8, cursor, bytes, "nursery_next");
+  Value *fits = builder->CreateICmpULE(
+      next, builder->CreateLoad(i8_ptr, limit_ptr, "nursery_limit"));
+  builder->CreateCondBr(fits, fast, slow, likely);
+
+  // The nursery is kept zeroed, so only the header needs writing.
+  builder->SetInsertPoint(fast);
+  builder->CreateStore(next, cursor_ptr);
+  Value *header = builder->CreateBitCast(
+      cursor, llvm::PointerType::getUnqual(alloc_header_type));
+  builder->CreateStore(type_info(t),
+                       builder->CreateStructGEP(alloc_header_type, header, 0));
+  builder->CreateStore(builder->CreateZExt(count, i64),
+                       builder->CreateStructGEP(alloc_header_type, header, 1));
+  Value *fast_obj = builder->CreateBitCast(
+      builder->CreateGEP(alloc_header_type, header, get_int32(1)), i8_ptr);
+  builder->CreateBr(done);
+
+  builder->SetInsertPoint(slow);
+  Value *slow_obj =
+      builder->CreateCall(alloc_callee, {type_info(t), count}, "nl_alloc");
+  builder->CreateBr(done);
+
+  builder->SetInsertPoint(done);
+  llvm::PHINode *obj = builder->CreatePHI(i8_ptr, 2, "alloc_" + t->name);
+  obj->addIncoming(fast_obj, fast);
+  obj->addIncoming(slow_obj, slow);
+  return builder->CreateBitCast(obj, tb.to_llvm(t));
+}
+
+/* Allocates an object (or an array of num_elems elements) in the stack
+   frame, behind a header like a heap object's. The slot is reused each
+   time the allocation runs, so it's cleared here rather than once. The
+   collector traces such objects when they're reachable, but seeing
+   GC_ON_STACK in their GC byte, never marks or frees them. */
+Value *CodeGen::emit_stack_alloc(NLType t, uint32_t num_elems) {
+  llvm::Type *layout =
+      llvm::cast<llvm::PointerType>(tb.to_llvm(t))->getElementType();
+  std::vector<llvm::Type *> fields = {alloc_header_type, layout};
+  if (num_elems) {
+    fields.push_back(llvm::ArrayType::get(
+        tb.to_llvm(Arrays::elem_type(t)), num_elems));
+  }
+  llvm::StructType *slot_type = llvm::StructType::get(ctx, fields);
+
+  llvm::Function *fn = builder->GetInsertBlock()->getParent();
+  llvm::IRBuilder<> entry(&fn->getEntryBlock(), fn->getEntryBlock().begin());
+  llvm::AllocaInst *slot = entry.CreateAlloca(slot_type, 0, "stack_" + t->name);
+
+  builder->CreateStore(llvm::Constant::getNullValue(slot_type), slot);
+  Value *header = builder->CreateStructGEP(slot_type, slot, 0);
+  builder->CreateStore(type_info(t),
+                       builder->CreateStructGEP(alloc_header_type, header, 0));
+  builder->CreateStore(
+      llvm::ConstantInt::get(llvm::Type::getInt64Ty(ctx), num_elems),
+      builder->CreateStructGEP(alloc_header_type, header, 1));
+  Value *obj = builder->CreateStructGEP(slot_type, slot, 1);
+  builder->CreateStore(
+      builder->getInt8(GC_ON_STACK),
+      builder->CreateStructGEP(layout, obj, NL_OBJ_GC_BYTE_IDX));
+  return obj;
+}
+
+llvm::AllocaInst *CodeGen::gc_root_slot(const std::string &name,
+                                        llvm::Type *type) {
+  llvm::Function *fn = builder->GetInsertBlock()->getParent();
+  llvm::IRBuilder<> entry(&fn->getEntryBlock(), fn->getEntryBlock().begin());
+  llvm::AllocaInst *slot = entry.CreateAlloca(type, 0, name);
+  gc_frame.slots.push_back(slot);
+  return slot;
+}
+
+Value *CodeGen::gc_root_temp(Value *ref) {
+  if (gc_frame.temps_used == gc_frame.temps.size()) {
+    gc_frame.temps.push_back(
+        gc_root_slot("gc_tmp", llvm::Type::getInt8PtrTy(ctx)));
+  }
+  llvm::AllocaInst *slot = gc_frame.temps[gc_frame.temps_used++];
+  builder->CreateStore(
+      builder->CreateBitCast(ref, llvm::Type::getInt8PtrTy(ctx)), slot);
+  return ref;
+}
+
+/* Replaces the function's root slots with a shadow stack frame
+ { i8* prev, i64 num_roots, [N x i8*] roots }, pushed on entry and popped
+ before every return (or tail call). Functions without roots get no frame
+ at all. */
+void CodeGen::emit_gc_frame(llvm::Function *fn) {
+  const std::vector<llvm::AllocaInst *> &slots = gc_frame.slots;
+  if (slots.empty()) {
+    return;
+  }
+
+  llvm::Type *i8_ptr = llvm::Type::getInt8PtrTy(ctx);
+  llvm::Type *i64 = llvm::Type::getInt64Ty(ctx);
+  llvm::StructType *frame_type = llvm::StructType::get(
+      ctx, {i8_ptr, i64, llvm::ArrayType::get(i8_ptr, slots.size())});
+
+  llvm::BasicBlock &entry_bb = fn->getEntryBlock();
+  llvm::IRBuilder<> entry(&entry_bb, entry_bb.begin());
+  llvm::AllocaInst *frame = entry.CreateAlloca(frame_type, 0, "gc_frame");
+
+  // Set the frame up after the allocas, before anything else runs.
+  auto first_non_alloca = entry_bb.begin();
+  while (llvm::isa<llvm::AllocaInst>(*first_non_alloca)) {
+    ++first_non_alloca;
+  }
+  entry.SetInsertPoint(&entry_bb, first_non_alloca);
+
+  for (size_t i = 0; i < slots.size(); i++) {
+    Value *root = entry.CreateInBoundsGEP(
+        frame_type, frame, {get_int32(0), get_int32(2), get_int32(i)});
+    entry.CreateStore(llvm::Constant::getNullValue(i8_ptr), root);
+    slots[i]->replaceAllUsesWith(
+        entry.CreateBitCast(root, slots[i]->getType()));
+    slots[i]->eraseFromParent();
+  }
+
+  entry.CreateStore(llvm::ConstantInt::get(i64, slots.size()),
+                    entry.CreateStructGEP(frame_type, frame, 1));
+  entry.CreateStore(entry.CreateLoad(i8_ptr, gc_top_frame, "gc_prev_frame"),
+                    entry.CreateStructGEP(frame_type, frame, 0));
+  entry.CreateStore(entry.CreateBitCast(frame, i8_ptr), gc_top_frame);
+
+  for (llvm::BasicBlock &bb : *fn) {
+    llvm::Instruction *term = bb.getTerminator();
+    if (term && llvm::isa<llvm::ReturnInst>(term)) {
+      // A tail call's arguments are all the callee needs, so the frame is
+      // popped before it, leaving nothing on the stack that is still used.
+      llvm::CallInst *call = tail_call(term);
+      llvm::IRBuilder<> ret(call ? call : term);
+      ret.CreateStore(
+          ret.CreateLoad(i8_ptr, ret.CreateStructGEP(frame_type, frame, 0)),
+          gc_top_frame);
+    }
+  }
+}
@@ -0,0 +1,121 @@
+#include <cstdint>
+
+#include "backends/llvm/codegen.h"
+#include "nlrt.h"
+#include "pass-timer.h"
+
+#include "llvm/ExecutionEngine/JITSymbol.h"
+#include "llvm/ExecutionEngine/Orc/Core.h"
+#include "llvm/ExecutionEngine/Orc/ExecutionUtils.h"
+#include "llvm/ExecutionEngine/Orc/JITTargetMachineBuilder.h"
+#include "llvm/ExecutionEngine/Orc/LLJIT.h"
+#include "llvm/ExecutionEngine/Orc/ThreadSafeModule.h"
+#include "llvm/IR/Verifier.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/raw_ostream.h"
+
+/*
+ * In-process execution with ORC. The module (and the context that owns
+ * its types) is handed to an LLLazyJIT, which compiles each function the
+ * first time it is called, so a large program starts running without
+ * waiting for all of its code to be compiled. Calls between functions go
+ * through stubs that are patched once their target has been compiled.
+ *
+ * The runtime is linked into the compiler itself, and its entry points,
+ * printing included, are defined in the JIT up front. Anything else, like
+ * the memset or memcpy the optimizer may turn a loop into, is looked up in
+ * the compiler's process, which includes the C library.
+ */
+
+static bool report(llvm::Error err) {
+  if (!err) {
+    return true;
+  }
+  llvm::logAllUnhandledErrors(std::move(err), llvm::errs(), "JIT: ");
+  return false;
+}
+
+template <typename T> static llvm::JITEvaluatedSymbol runtime_symbol(T *addr) {
+  return llvm::JITEvaluatedSymbol(llvm::pointerToJITTargetAddress(addr),
+                                  llvm::JITSymbolFlags::Exported);
+}
+
+bool CodeGen::run_jit(bool lazy, int &status) {
+  if (llvm::verifyModule(*module, &llvm::errs())) {
+    llvm::errs() << "Invalid IR was generated; not running it.\n";
+    return false;
+  }
+
+  std::unique_ptr<llvm::orc::LLLazyJIT> jit;
+  {
+    PassTimer timer("JIT setup");
+    llvm::InitializeNativeTarget();
+    llvm::InitializeNativeTargetAsmPrinter();
+
+    auto machine = llvm::orc::JITTargetMachineBuilder::detectHost();
+    if (!machine) {
+      return report(machine.takeError());
+    }
+    const llvm::CodeGenOpt::Level levels[] = {
+        llvm::CodeGenOpt::None, llvm::CodeGenOpt::Less,
+        llvm::CodeGenOpt::Default, llvm::CodeGenOpt::Aggressive};
+    machine->setCodeGenOptLevel(levels[opt_level]);
+
+    auto created = llvm::orc::LLLazyJITBuilder()
+                       .setJITTargetMachineBuilder(std::move(*machine))
+                       .create();
+    if (!created) {
+      return report(created.takeError());
+    }
+    jit = std::move(*created);
+
+    const llvm::DataLayout &layout = jit->getDataLayout();
+    llvm::orc::JITDylib &dylib = jit->getMainJITDylib();
+    llvm::orc::MangleAndInterner mangle(jit->getExecutionSession(), layout);
+    llvm::orc::SymbolMap runtime;
+    runtime[mangle("nl_alloc")] = runtime_symbol(&nl_alloc);
+    runtime[mangle("nl_gc_collect")] = runtime_symbol(&nl_gc_collect);
+    runtime[mangle("nl_index_error")] = runtime_symbol(&nl_index_error);
+    runtime[mangle("nl_gc_top_frame")] = runtime_symbol(&nl_gc_top_frame);
+    runtime[mangle("nl_nursery")] = runtime_symbol(&nl_nursery);
+    runtime[mangle("nl_profile_call")] = runtime_symbol(&nl_profile_call);
+    runtime[mangle("nl_print_int")] = runtime_symbol(&nl_print_int);
+    runtime[mangle("nl_print_float")] = runtime_symbol(&nl_print_float);
+    runtime[mangle("nl_print_str")] = runtime_symbol(&nl_print_str);
+    if (!report(dylib.define(llvm::orc::absoluteSymbols(runtime)))) {
+      return false;
+    }
+
+    auto process =
+        llvm::orc::DynamicLibrarySearchGenerator::GetForCurrentProcess(
+            layout.getGlobalPrefix());
+    if (!process) {
+      return report(process.takeError());
+    }
+    dylib.setGenerator(std::move(*process));
+
+    module->setDataLayout(layout);
+    llvm::orc::ThreadSafeModule tsm(std::move(module), std::move(owned_ctx));
+    if (!report(lazy ? jit->addLazyIRModule(std::move(tsm))
+                     : jit->addIRModule(std::move(tsm)))) {
+      return false;
+    }
+  }
+
+  llvm::Expected<llvm::JITEvaluatedSymbol> main_fn = [&] {
+    PassTimer timer("JIT compilation of main");
+    return jit->lookup("main");
+  }();
+  if (!main_fn) {
+    return report(main_fn.takeError());
+  }
+
+  PassTimer timer("Program execution");
+  auto *entry = reinterpret_cast<int32_t (*)()>(
+      static_cast<uintptr_t>(main_fn->getAddress()));
+  status = entry();
+  // The compiler carries on, so the program's output can't wait for exit.
+  nl_print_flush();
+  return true;
+}
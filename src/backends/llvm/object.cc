@@ -7,6 +7,8 @@ int NL_OBJ_VT_IDX = 1;
 
 int NL_ARR_SIZE_IDX = 2;
 int NL_ARR_ELEMS_IDX = 3;
+int NL_ARR_EXTENTS_IDX = 4;
+int NL_ARR_STRIDES_IDX = 5;
 
 std::vector<llvm::Type *> object_header(llvm::LLVMContext &ctx) {
   return {llvm::Type::getInt8Ty(
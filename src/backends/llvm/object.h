@@ -23,6 +23,10 @@ extern int NL_OBJ_VT_IDX;
 
 extern int NL_ARR_SIZE_IDX;
 extern int NL_ARR_ELEMS_IDX;
+// Only arrays of more than one dimension have these: an i32 per dimension,
+// in elements. The last dimension's stride is always 1.
+extern int NL_ARR_EXTENTS_IDX;
+extern int NL_ARR_STRIDES_IDX;
 
 /* Returns the (ordered) object layout LLVM types. The header is:
  ___________________________________
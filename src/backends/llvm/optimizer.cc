@@ -0,0 +1,75 @@
+#include "backends/llvm/codegen.h"
+#include "pass-timer.h"
+
+#include "llvm/Analysis/TargetTransformInfo.h"
+#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/IR/Verifier.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/IPO.h"
+#include "llvm/Transforms/IPO/AlwaysInliner.h"
+#include "llvm/Transforms/IPO/PassManagerBuilder.h"
+
+/*
+ * Runs LLVM's standard pass pipeline over the module, as `opt -O<level>`
+ * would, so that out.bc is already optimized when it reaches lli or llc.
+ *
+ * Code generation is deliberately naive: every local lives in an entry
+ * block alloca, and nothing is simplified while emitting. At level 1 and
+ * up, mem2reg (SROA) promotes those locals to registers, and instcombine,
+ * GVN, LICM and the loop passes clean up after it. Levels 2 and 3 also
+ * inline calls between NL functions; level 1 only inlines functions
+ * marked always-inline, like clang does.
+ *
+ * Rooted references still go through the shadow stack frame, which is
+ * reachable from a global, so the optimizer keeps every store to a root
+ * that a collection could observe.
+ */
+void CodeGen::optimize(unsigned level) {
+  opt_level = level;
+  if (level == 0) {
+    return;
+  }
+
+  PassTimer timer("Optimization");
+
+  // The passes assume well-formed IR; don't let a code generation bug
+  // crash them.
+  if (llvm::verifyModule(*module, &llvm::errs())) {
+    llvm::errs() << "Invalid IR was generated; not optimizing.\n";
+    return;
+  }
+
+  llvm::PassManagerBuilder pmb;
+  pmb.OptLevel = level;
+  pmb.SizeLevel = 0;
+  pmb.Inliner = level > 1 ? llvm::createFunctionInliningPass(level, 0, false)
+                          : llvm::createAlwaysInlinerLegacyPass();
+  pmb.LoopVectorize = level > 1;
+  pmb.SLPVectorize = level > 1;
+
+  // Let the passes see the host's costs and data layout.
+  llvm::TargetMachine *machine = target_machine();
+  if (machine) {
+    machine->adjustPassManager(pmb);
+  }
+
+  llvm::legacy::FunctionPassManager fpm(module.get());
+  if (machine) {
+    fpm.add(llvm::createTargetTransformInfoWrapperPass(
+        machine->getTargetIRAnalysis()));
+  }
+  pmb.populateFunctionPassManager(fpm);
+  fpm.doInitialization();
+  for (llvm::Function &fn : *module) {
+    fpm.run(fn);
+  }
+  fpm.doFinalization();
+
+  llvm::legacy::PassManager mpm;
+  if (machine) {
+    mpm.add(llvm::createTargetTransformInfoWrapperPass(
+        machine->getTargetIRAnalysis()));
+  }
+  pmb.populateModulePassManager(mpm);
+  mpm.run(*module);
+}
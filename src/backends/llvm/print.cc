@@ -0,0 +1,62 @@
+/*
+ * Print statements and string literals. Printing calls into the runtime's
+ * buffered output (runtime/print.cc), one function per printable type, so
+ * no format strings are needed. String literals are interned: each
+ * distinct string is emitted once per module however often it is used.
+ */
+
+#include "backends/llvm/codegen.h"
+#include "primitives.h"
+
+#include "llvm/IR/DerivedTypes.h"
+#include "llvm/IR/GlobalVariable.h"
+
+static llvm::FunctionCallee print_int_callee;
+static llvm::FunctionCallee print_float_callee;
+static llvm::FunctionCallee print_str_callee;
+
+void CodeGen::init_print() {
+  llvm::Type *void_type = llvm::Type::getVoidTy(ctx);
+  print_int_callee = module->getOrInsertFunction(
+      "nl_print_int", llvm::FunctionType::get(
+                          void_type, {llvm::Type::getInt64Ty(ctx)}, false));
+  print_float_callee = module->getOrInsertFunction(
+      "nl_print_float", llvm::FunctionType::get(
+                            void_type, {llvm::Type::getDoubleTy(ctx)}, false));
+  print_str_callee = module->getOrInsertFunction(
+      "nl_print_str", llvm::FunctionType::get(
+                          void_type, {llvm::Type::getInt8PtrTy(ctx)}, false));
+}
+
+void CodeGen::emit_print(Value *value, NLType t) {
+  llvm::Type *i64 = llvm::Type::getInt64Ty(ctx);
+  if (t == Primitives::Int()) {
+    builder->CreateCall(print_int_callee, {builder->CreateSExt(value, i64)});
+  } else if (t == Primitives::Bool()) {
+    builder->CreateCall(print_int_callee, {builder->CreateZExt(value, i64)});
+  } else if (t == Primitives::Float()) {
+    builder->CreateCall(print_float_callee, {value});
+  } else if (t == Primitives::String()) {
+    builder->CreateCall(print_str_callee, {value});
+  } else {
+    assert(false && "Unprintable type; type checker should have caught this");
+  }
+}
+
+llvm::Constant *CodeGen::intern_string(const std::string &s) {
+  auto it = string_pool.find(s);
+  if (it != string_pool.end()) {
+    return it->second;
+  }
+
+  llvm::Constant *chars = llvm::ConstantDataArray::getString(ctx, s);
+  auto gv = new llvm::GlobalVariable(*module, chars->getType(), true,
+                                     llvm::GlobalValue::PrivateLinkage, chars,
+                                     "__str");
+  gv->setUnnamedAddr(llvm::GlobalValue::UnnamedAddr::Global);
+  llvm::Constant *zero = llvm::ConstantInt::get(llvm::Type::getInt32Ty(ctx), 0);
+  llvm::Constant *str = llvm::ConstantExpr::getInBoundsGetElementPtr(
+      chars->getType(), gv, std::vector<llvm::Constant *>{zero, zero});
+  string_pool[s] = str;
+  return str;
+}
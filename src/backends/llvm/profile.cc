@@ -0,0 +1,258 @@
+/*
+ * Profile-guided devirtualization. Class hierarchy analysis only calls a
+ * method directly when no other implementation can be reached; many
+ * calls that could be polymorphic are, in practice, nearly always made
+ * on one class.
+ *
+ * With --profile-generate, every virtual call site reports the vtable it
+ * found in its receiver to the runtime (runtime/profile.cc), which writes
+ * per-site receiver class counts when the program exits. With
+ * --profile-use, a site whose counts are dominated by one class compares
+ * the receiver's vtable with that class's and, if they match, calls its
+ * implementation directly, where it can be inlined. Other receivers take
+ * the usual vtable call.
+ */
+
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+#include "backends/llvm/codegen.h"
+#include "interner.h"
+
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/DerivedTypes.h"
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/MDBuilder.h"
+#include "llvm/Support/raw_ostream.h"
+
+// A site is promoted when this share of its calls (in percent) went to
+// a single class.
+static const uint64_t PROMOTE_PERCENT = 80;
+
+static llvm::StructType *profile_type;
+static llvm::FunctionCallee profile_callee;
+
+void CodeGen::instrument_calls(const std::string &path) {
+  llvm::Type *i8_ptr = llvm::Type::getInt8PtrTy(ctx);
+  llvm::Type *i8_ptr_ptr = llvm::PointerType::getUnqual(i8_ptr);
+  llvm::Type *i32 = llvm::Type::getInt32Ty(ctx);
+
+  // Mirrors struct nl_profile in runtime/nlrt.h.
+  profile_type = llvm::StructType::create(ctx, "__nl_profile");
+  llvm::Type *profile_ptr = llvm::PointerType::getUnqual(profile_type);
+  profile_type->setBody(
+      {i8_ptr, i8_ptr_ptr, i8_ptr_ptr, i8_ptr_ptr, i8_ptr, i32, i32});
+
+  // Its initializer is set once every call site has been numbered.
+  profile_path = path;
+  profile = new llvm::GlobalVariable(*module, profile_type, false,
+                                     llvm::GlobalValue::InternalLinkage,
+                                     nullptr, "__nl_profile");
+  profile_callee = module->getOrInsertFunction(
+      "nl_profile_call",
+      llvm::FunctionType::get(llvm::Type::getVoidTy(ctx),
+                              {profile_ptr, i32, i8_ptr}, false));
+}
+
+/* Reads a profile written by runtime/profile.cc. */
+bool CodeGen::use_profile(const std::string &path) {
+  std::ifstream in(path);
+  if (!in) {
+    llvm::errs() << "Could not read profile '" << path << "'\n";
+    return false;
+  }
+
+  std::string line;
+  for (int line_no = 1; std::getline(in, line); line_no++) {
+    if (line.empty() || line[0] == '#') {
+      continue;
+    }
+
+    std::istringstream entry(line);
+    uint32_t site;
+    std::string method, receiver;
+    uint64_t count;
+    if (!(entry >> site >> method >> receiver >> count)) {
+      llvm::errs() << path << ":" << line_no << ": malformed profile entry\n";
+      return false;
+    }
+
+    if (site >= site_profiles.size()) {
+      site_profiles.resize(site + 1);
+    }
+    SiteProfile &sp = site_profiles[site];
+    if (!sp.method.empty() && sp.method != method) {
+      llvm::errs() << path << ":" << line_no << ": call site " << site
+                   << " is both " << sp.method << " and " << method << "\n";
+      return false;
+    }
+    sp.method = method;
+    sp.receivers[receiver] += count;
+  }
+  return true;
+}
+
+/* Numbers the virtual call site of a method Get, whose receiver's vtable
+ has been loaded. Counts the call if instrumenting, and decides whether
+ to guard it with the profile's dominant receiver class. */
+void CodeGen::profile_call_site(const Get *expr, NLType static_type,
+                                Value *vtable) {
+  const uint32_t site = num_call_sites++;
+  const std::string method_name = expr->name.lexeme();
+  const std::string method = static_type->name + "." + method_name;
+
+  if (profile) {
+    site_methods.push_back(method);
+    builder->CreateCall(profile_callee,
+                        {profile, builder->getInt32(site),
+                         builder->CreateBitCast(
+                             vtable, llvm::Type::getInt8PtrTy(ctx))});
+  }
+
+  if (profile_stale || site >= site_profiles.size() ||
+      site_profiles[site].receivers.empty()) {
+    return;
+  }
+
+  const SiteProfile &sp = site_profiles[site];
+  if (sp.method != method) {
+    // Site numbers only line up with the program that was profiled.
+    llvm::errs() << "Profile does not match this program (call site " << site
+                 << " is " << method << ", not " << sp.method
+                 << "); ignoring it from there on.\n";
+    profile_stale = true;
+    return;
+  }
+
+  const std::string *likely = nullptr;
+  uint64_t hits = 0, total = 0;
+  for (const auto &entry : sp.receivers) {
+    total += entry.second;
+    if (entry.second > hits) {
+      likely = &entry.first;
+      hits = entry.second;
+    }
+  }
+  if (!likely || hits * 100 < total * PROMOTE_PERCENT) {
+    return;
+  }
+
+  NLType receiver = sm.types.get(Interner::intern(*likely));
+  if (!receiver || !static_type->superclass_of(receiver.get()) ||
+      !module->getGlobalVariable("__vtable_" + receiver->name)) {
+    return;
+  }
+
+  GuardedCall &guard = guarded_calls[expr];
+  guard.vtable = vtable;
+  guard.receiver = receiver.get();
+  guard.target = get_virtual_method(
+      receiver->method_owner(static_type->method_idx(expr->name.id)),
+      method_name);
+  guard.hits = hits;
+  guard.misses = total - hits;
+}
+
+/* Emits
+
+   if (receiver's vtable == likely receiver class's vtable)
+     result = LikelyClass_method(args)
+   else
+     result = callee(args)
+
+ with branch weights from the profile. */
+Value *CodeGen::emit_guarded_call(const GuardedCall &guard, Value *callee,
+                                  const std::vector<Value *> &args) {
+  llvm::Function *fn = builder->GetInsertBlock()->getParent();
+  llvm::BasicBlock *direct = llvm::BasicBlock::Create(ctx, "call_direct", fn);
+  llvm::BasicBlock *indirect =
+      llvm::BasicBlock::Create(ctx, "call_virtual", fn);
+  llvm::BasicBlock *done = llvm::BasicBlock::Create(ctx, "call_done", fn);
+
+  // Branch weights are 32-bit.
+  uint64_t hits = guard.hits, misses = guard.misses;
+  while (hits > UINT32_MAX || misses > UINT32_MAX) {
+    hits /= 2;
+    misses /= 2;
+  }
+
+  Value *expected = builder->CreateBitCast(
+      module->getGlobalVariable("__vtable_" + guard.receiver->name),
+      guard.vtable->getType());
+  Value *matches =
+      builder->CreateICmpEQ(guard.vtable, expected, "vtable_matches");
+  builder->CreateCondBr(matches, direct, indirect,
+                        llvm::MDBuilder(ctx).createBranchWeights(hits, misses));
+
+  builder->SetInsertPoint(indirect);
+  Value *virtual_result = builder->CreateCall(callee, args);
+  builder->CreateBr(done);
+
+  // The implementation's 'this' is the receiver class, and its return
+  // type may be narrower than the slot's.
+  builder->SetInsertPoint(direct);
+  std::vector<Value *> direct_args;
+  auto params = guard.target->getFunctionType()->params();
+  for (size_t i = 0; i < args.size(); i++) {
+    direct_args.push_back(builder->CreateBitCast(args[i], params[i]));
+  }
+  Value *direct_result = builder->CreateCall(guard.target, direct_args);
+  if (!direct_result->getType()->isVoidTy()) {
+    direct_result =
+        builder->CreateBitCast(direct_result, virtual_result->getType());
+  }
+  builder->CreateBr(done);
+
+  builder->SetInsertPoint(done);
+  if (virtual_result->getType()->isVoidTy()) {
+    return virtual_result;
+  }
+  llvm::PHINode *result = builder->CreatePHI(virtual_result->getType(), 2);
+  result->addIncoming(direct_result, direct);
+  result->addIncoming(virtual_result, indirect);
+  return result;
+}
+
+static llvm::Constant *pointer_array(llvm::Module &module,
+                                     const std::vector<llvm::Constant *> &elems,
+                                     const std::string &name) {
+  llvm::Type *i8_ptr = llvm::Type::getInt8PtrTy(module.getContext());
+  llvm::ArrayType *type = llvm::ArrayType::get(i8_ptr, elems.size());
+  auto gv = new llvm::GlobalVariable(module, type, true,
+                                     llvm::GlobalValue::PrivateLinkage,
+                                     llvm::ConstantArray::get(type, elems),
+                                     name);
+  return llvm::ConstantExpr::getBitCast(gv,
+                                        llvm::PointerType::getUnqual(i8_ptr));
+}
+
+/* Fills in the nl_profile describing the numbered call sites and every
+ class with a vtable. */
+void CodeGen::emit_profile() {
+  llvm::Type *i8_ptr = llvm::Type::getInt8PtrTy(ctx);
+  llvm::Type *i32 = llvm::Type::getInt32Ty(ctx);
+
+  std::vector<llvm::Constant *> sites;
+  for (const std::string &method : site_methods) {
+    sites.push_back(intern_string(method));
+  }
+
+  std::vector<llvm::Constant *> class_names, vtables;
+  for (const auto &entry : methods) {
+    const std::string &name = entry.first->name;
+    class_names.push_back(intern_string(name));
+    vtables.push_back(llvm::ConstantExpr::getBitCast(
+        module->getGlobalVariable("__vtable_" + name), i8_ptr));
+  }
+
+  profile->setInitializer(llvm::ConstantStruct::get(
+      profile_type,
+      {intern_string(profile_path),
+       pointer_array(*module, sites, "__nl_profile_sites"),
+       pointer_array(*module, class_names, "__nl_profile_classes"),
+       pointer_array(*module, vtables, "__nl_profile_vtables"),
+       llvm::ConstantPointerNull::get(llvm::cast<llvm::PointerType>(i8_ptr)),
+       llvm::ConstantInt::get(i32, sites.size()),
+       llvm::ConstantInt::get(i32, vtables.size())}));
+}
@@ -0,0 +1,131 @@
+/*
+ * Structure-of-arrays layout. An array declared `soa Particle[n]` stores
+ * each of Particle's fields in a column of its own, rather than each
+ * element whole, so a loop that touches one or two fields of every
+ * element streams through just those columns, and LLVM can vectorize it.
+ *
+ * The columns follow the array header in the same block an array of
+ * whole elements would take, and the header's 'elements' field holds a
+ * pointer to each one (see TypeBuilder::array_type). Accessing a field of
+ * an element indexes its column; copying an element whole gathers or
+ * scatters it field by field. Only arrays of structs can be laid out this
+ * way: an object element is a reference, which a column per field can't
+ * provide.
+ */
+
+#include <algorithm>
+#include <numeric>
+#include <vector>
+
+#include "arrays.h"
+#include "backends/llvm/codegen.h"
+#include "backends/llvm/object.h"
+#include "primitives.h"
+
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/DerivedTypes.h"
+
+/* The alignment a column of t needs. Scalars are aligned to their size on
+ the targets we generate code for, and a struct to its widest field. */
+static uint32_t column_align(NLType t) {
+  if (t == Primitives::Float()) {
+    return 8;
+  }
+  if (t == Primitives::Int()) {
+    return 4;
+  }
+  uint32_t align = 1;
+  for (const Field &field : t->fields) {
+    align = std::max(align, column_align(field.type));
+  }
+  return align;
+}
+
+/* The element of a soa array that expr accesses, if it is one. */
+const GetIndex *CodeGen::soa_element(const Expr *expr) {
+  if (const auto *group = dynamic_cast<const Grouping *>(expr)) {
+    return soa_element(&group->expression);
+  }
+  const auto *index = dynamic_cast<const GetIndex *>(expr);
+  return index && expr_types.get(&index->callee)->soa ? index : nullptr;
+}
+
+/* Points the header's columns into the num_elems elements' worth of space
+ at elems. Columns are placed widest first, so each starts aligned without
+ padding, and together they take no more space than whole elements. */
+void CodeGen::emit_soa_columns(NLType t, Value *array, Value *elems,
+                               Value *num_elems) {
+  const std::vector<Field> &fields = Arrays::elem_type(t)->fields;
+  std::vector<size_t> order(fields.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+    return column_align(fields[a].type) > column_align(fields[b].type);
+  });
+
+  llvm::Type *i8 = llvm::Type::getInt8Ty(ctx);
+  llvm::Type *i64 = llvm::Type::getInt64Ty(ctx);
+  Value *base = builder->CreateBitCast(elems, llvm::Type::getInt8PtrTy(ctx));
+  Value *count = builder->CreateZExt(num_elems, i64);
+  Value *offset = llvm::ConstantInt::get(i64, 0);
+  for (size_t i : order) {
+    llvm::Type *column_type = tb.to_llvm(fields[i].type);
+    Value *column = builder->CreateBitCast(
+        builder->CreateInBoundsGEP(i8, base, offset),
+        llvm::PointerType::getUnqual(column_type),
+        "column_" + fields[i].name);
+    builder->CreateStore(
+        column, builder->CreateGEP(array, {get_int32(0),
+                                           get_int32(NL_ARR_ELEMS_IDX),
+                                           get_int32(i)}));
+    offset = builder->CreateAdd(
+        offset,
+        builder->CreateMul(count, llvm::ConstantExpr::getSizeOf(column_type)));
+  }
+}
+
+/* The address of one field of a soa array's element. */
+Value *CodeGen::emit_soa_column_ptr(const GetIndex *element, int field_idx) {
+  Value *array;
+  Value *offset = emit_element_offset(element, element->callee,
+                                      element->index, element->bracket, array);
+  Value *column = builder->CreateLoad(
+      builder->CreateGEP(array, {get_int32(0), get_int32(NL_ARR_ELEMS_IDX),
+                                 get_int32(field_idx)}),
+      "column");
+  return builder->CreateGEP(column, offset);
+}
+
+/* Gathers a whole element of a soa array from its columns. */
+Value *CodeGen::emit_soa_load(const GetIndex *element) {
+  Value *array;
+  Value *offset = emit_element_offset(element, element->callee,
+                                      element->index, element->bracket, array);
+
+  NLType elem_type = expr_types.get(element);
+  Value *result = llvm::UndefValue::get(tb.to_llvm(elem_type));
+  for (size_t i = 0; i < elem_type->fields.size(); i++) {
+    Value *column = builder->CreateLoad(builder->CreateGEP(
+        array, {get_int32(0), get_int32(NL_ARR_ELEMS_IDX), get_int32(i)}));
+    Value *field = builder->CreateLoad(builder->CreateGEP(column, offset),
+                                       "load_" + elem_type->fields[i].name);
+    result = builder->CreateInsertValue(result, field, i);
+  }
+  return result;
+}
+
+/* Scatters a struct into the columns of a soa array's element. */
+Value *CodeGen::emit_soa_store(const SetIndex *element) {
+  Value *array;
+  Value *offset = emit_element_offset(element, element->callee,
+                                      element->index, element->bracket, array);
+  Value *value = emit(&element->value);
+
+  NLType elem_type = expr_types.get(&element->value);
+  for (size_t i = 0; i < elem_type->fields.size(); i++) {
+    Value *column = builder->CreateLoad(builder->CreateGEP(
+        array, {get_int32(0), get_int32(NL_ARR_ELEMS_IDX), get_int32(i)}));
+    builder->CreateStore(builder->CreateExtractValue(value, i),
+                         builder->CreateGEP(column, offset));
+  }
+  return value;
+}
@@ -0,0 +1,49 @@
+/*
+ * Tail calls. A function that returns the result of a call has nothing
+ * left to do once it's made, so the call is marked as a tail call and
+ * reuses the caller's stack frame: deep recursion runs in constant stack,
+ * and LLVM turns self-recursion into a loop. Calls whose prototype matches
+ * the caller's are marked musttail, which guarantees it even without
+ * optimization.
+ *
+ * NL code never takes the address of a local, so only the shadow stack
+ * frame could be reached from the callee; emit_gc_frame pops it before
+ * tail calls.
+ */
+
+#include "backends/llvm/codegen.h"
+
+/* The call whose result is returned by ret with nothing in between but a
+ bitcast, if any. */
+llvm::CallInst *CodeGen::tail_call(llvm::Instruction *ret) {
+  auto *ret_inst = llvm::dyn_cast_or_null<llvm::ReturnInst>(ret);
+  if (!ret_inst || !ret_inst->getReturnValue()) {
+    return nullptr;
+  }
+  Value *result = ret_inst->getReturnValue();
+  llvm::Instruction *prev = ret->getPrevNode();
+  if (auto *cast = llvm::dyn_cast<llvm::BitCastInst>(result)) {
+    if (cast != prev) {
+      return nullptr;
+    }
+    result = cast->getOperand(0);
+    prev = cast->getPrevNode();
+  }
+  auto *call = llvm::dyn_cast<llvm::CallInst>(result);
+  return call && call == prev ? call : nullptr;
+}
+
+void CodeGen::mark_tail_calls(llvm::Function *fn) {
+  for (llvm::BasicBlock &bb : *fn) {
+    llvm::CallInst *call = tail_call(bb.getTerminator());
+    if (!call) {
+      continue;
+    }
+    if (call->getFunctionType() == fn->getFunctionType() &&
+        call->getType() == fn->getReturnType()) {
+      call->setTailCallKind(llvm::CallInst::TCK_MustTail);
+    } else {
+      call->setTailCall();
+    }
+  }
+}
@@ -0,0 +1,179 @@
+#include <cstdlib>
+#include <string>
+#include <system_error>
+
+#include "backends/llvm/codegen.h"
+#include "pass-timer.h"
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/IR/Verifier.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Host.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/Program.h"
+#include "llvm/Support/TargetRegistry.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Target/TargetOptions.h"
+
+/*
+ * Native code emission. The module is compiled for the host by an LLVM
+ * TargetMachine, the same way llc would, and an executable is linked from
+ * the resulting object file and the runtime library (lib/libnlrt.a). The
+ * executable has no run-time dependency on LLVM.
+ *
+ * Linking is left to the system's C compiler driver (cc, or $CC), which
+ * knows where the C library and startup files live on the host.
+ */
+
+static const char *default_output(Options::Emit emit) {
+  switch (emit) {
+  case Options::BITCODE:
+    return "out.bc";
+  case Options::IR:
+    return "out.ll";
+  case Options::ASSEMBLY:
+    return "out.s";
+  case Options::OBJECT:
+    return "out.o";
+  case Options::EXECUTABLE:
+    return "a.out";
+  }
+  return "out.bc";
+}
+
+bool CodeGen::write_output(Options::Emit emit, std::string path) {
+  if (path.empty()) {
+    path = default_output(emit);
+  }
+
+  switch (emit) {
+  case Options::BITCODE:
+    return write_bitcode(path);
+  case Options::IR:
+    return write_ir(path);
+  case Options::ASSEMBLY:
+    return write_native(path, true);
+  case Options::OBJECT:
+    return write_native(path, false);
+  case Options::EXECUTABLE:
+    return link_executable(path);
+  }
+  return false;
+}
+
+/* The host's TargetMachine, created on first use. Also makes the module
+   target the host, so the optimizer sees the real data layout. */
+llvm::TargetMachine *CodeGen::target_machine() {
+  if (host_machine) {
+    return host_machine.get();
+  }
+
+  llvm::InitializeNativeTarget();
+  llvm::InitializeNativeTargetAsmPrinter();
+
+  const std::string triple = llvm::sys::getDefaultTargetTriple();
+  std::string error;
+  const llvm::Target *target =
+      llvm::TargetRegistry::lookupTarget(triple, error);
+  if (!target) {
+    llvm::errs() << "No target for '" << triple << "': " << error << "\n";
+    return nullptr;
+  }
+
+  const llvm::CodeGenOpt::Level levels[] = {
+      llvm::CodeGenOpt::None, llvm::CodeGenOpt::Less,
+      llvm::CodeGenOpt::Default, llvm::CodeGenOpt::Aggressive};
+  host_machine.reset(target->createTargetMachine(
+      triple, llvm::sys::getHostCPUName(), "", llvm::TargetOptions(),
+      llvm::Reloc::PIC_, llvm::None, levels[opt_level]));
+
+  module->setTargetTriple(triple);
+  module->setDataLayout(host_machine->createDataLayout());
+  return host_machine.get();
+}
+
+bool CodeGen::write_native(const std::string &path, bool assembly) {
+  llvm::TargetMachine *machine = target_machine();
+  if (!machine) {
+    return false;
+  }
+  if (llvm::verifyModule(*module, &llvm::errs())) {
+    llvm::errs() << "Invalid IR was generated; not emitting '" << path
+                 << "'.\n";
+    return false;
+  }
+
+  PassTimer timer("Native code emission");
+  std::error_code EC;
+  llvm::raw_fd_ostream os(path, EC, llvm::sys::fs::F_None);
+  if (EC) {
+    llvm::errs() << "Could not write '" << path << "': " << EC.message()
+                 << "\n";
+    return false;
+  }
+
+  llvm::legacy::PassManager pm;
+  if (machine->addPassesToEmitFile(
+          pm, os, nullptr,
+          assembly ? llvm::TargetMachine::CGFT_AssemblyFile
+                   : llvm::TargetMachine::CGFT_ObjectFile)) {
+    llvm::errs() << "The host target can't emit this kind of file.\n";
+    return false;
+  }
+  pm.run(*module);
+  os.flush();
+  return true;
+}
+
+/* lib/libnlrt.a, next to the bin/ directory the compiler runs from. */
+static std::string runtime_library() {
+  static int anchor;
+  const std::string exe = llvm::sys::fs::getMainExecutable(nullptr, &anchor);
+  llvm::SmallString<128> lib(
+      llvm::sys::path::parent_path(llvm::sys::path::parent_path(exe)));
+  llvm::sys::path::append(lib, "lib", "libnlrt.a");
+  return std::string(lib.str());
+}
+
+bool CodeGen::link_executable(const std::string &path) {
+  const std::string runtime = runtime_library();
+  if (!llvm::sys::fs::exists(runtime)) {
+    llvm::errs() << "Could not find the NL runtime at '" << runtime << "'\n";
+    return false;
+  }
+
+  const char *cc_name = getenv("CC") ? getenv("CC") : "cc";
+  llvm::ErrorOr<std::string> cc = llvm::sys::findProgramByName(cc_name);
+  if (!cc) {
+    llvm::errs() << "Could not find '" << cc_name << "' to link with\n";
+    return false;
+  }
+
+  llvm::SmallString<128> object;
+  if (std::error_code EC =
+          llvm::sys::fs::createTemporaryFile("neeilang", "o", object)) {
+    llvm::errs() << "Could not create an object file: " << EC.message()
+                 << "\n";
+    return false;
+  }
+  const std::string object_path(object.str());
+  if (!write_native(object_path, false)) {
+    llvm::sys::fs::remove(object_path);
+    return false;
+  }
+
+  PassTimer timer("Linking");
+  std::string error;
+  const llvm::StringRef args[] = {*cc, object_path, runtime, "-o", path};
+  const int status = llvm::sys::ExecuteAndWait(*cc, args, llvm::None, {}, 0,
+                                               0, &error);
+  llvm::sys::fs::remove(object_path);
+  if (status != 0) {
+    llvm::errs() << "Linking '" << path << "' failed"
+                 << (error.empty() ? "" : ": " + error) << "\n";
+    return false;
+  }
+  return true;
+}
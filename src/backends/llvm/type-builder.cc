@@ -24,6 +24,15 @@ llvm::Type *TypeBuilder::to_llvm(NLType t) {
 
   std::vector<llvm::Type *> field_types;
 
+  // Structs are used by value, and have no header.
+  if (t->is_struct) {
+    for (auto field : t->fields) {
+      field_types.push_back(to_llvm(field.type));
+    }
+    ll_types.insert({t, llvm::StructType::create(ctx, field_types, t->name)});
+    return ll_types[t];
+  }
+
   // Create the identified struct type
   auto opaque_struct = llvm::StructType::create(ctx, t->name);
   ll_types.insert({t, llvm::PointerType::getUnqual(opaque_struct)});
@@ -56,7 +65,7 @@ llvm::Type *TypeBuilder::to_llvm(NLType t) {
 llvm::Type *TypeBuilder::array_type(NLType t) {
   std::vector<llvm::Type *> field_types;
 
-  NLType elem_type = Arrays::next_enclosed_type(t);
+  NLType elem_type = Arrays::elem_type(t);
 
   // Header
   for (auto hdr_field_ty : object_header(ctx)) {
@@ -66,8 +75,24 @@ llvm::Type *TypeBuilder::array_type(NLType t) {
   // 'size'
   field_types.push_back(llvm::IntegerType::getInt32Ty(ctx));
 
-  // 'elements'
-  field_types.push_back(llvm::PointerType::get(to_llvm(elem_type), 0));
+  // 'elements', or for soa arrays, a pointer to each field's column
+  if (t->soa) {
+    std::vector<llvm::Type *> columns;
+    for (const Field &field : elem_type->fields) {
+      columns.push_back(llvm::PointerType::get(to_llvm(field.type), 0));
+    }
+    field_types.push_back(llvm::StructType::get(ctx, columns));
+  } else {
+    field_types.push_back(llvm::PointerType::get(to_llvm(elem_type), 0));
+  }
+
+  // 'extents' and 'strides', for row-major indexing
+  if (t->dims > 1) {
+    llvm::Type *per_dim =
+        llvm::ArrayType::get(llvm::IntegerType::getInt32Ty(ctx), t->dims);
+    field_types.push_back(per_dim);
+    field_types.push_back(per_dim);
+  }
 
   llvm::Type *struct_type = llvm::StructType::create(ctx, field_types, t->name);
   ll_types.insert({t, llvm::PointerType::getUnqual(struct_type)});
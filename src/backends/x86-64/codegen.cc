@@ -1,119 +1,380 @@
 #include "backends/x86-64/codegen.h"
 
+#include <algorithm>
+#include <cstring>
 #include <iostream>
 #include <functional>
 
 #include "arrays.h"
+#include "pass-timer.h"
 #include "primitives.h"
 
 namespace x86_64 {
 
-// TODO: Copied from LLVM backend - put in common utils
-static bool is_initializer(const std::string &fn) {
-  const std::string init("_init");
-  if (fn.length() >= init.length()) {
-    return (0 == fn.compare(fn.length() - init.length(), init.length(), init));
+// Number of elements up to which arrays are bump-allocated inline; larger
+// ones are left to nl_alloc (and may be allocated outside the nursery).
+static const int INLINE_ALLOC_MAX_ELEMS = 4096;
+
+// Bytes of the runtime's nl_alloc_header that precedes every object.
+static const int ALLOC_HEADER_SIZE = 16;
+
+// Stack arrays of large structs could overflow the frame, so arrays of
+// more bytes than this stay on the heap.
+static const uint32_t MAX_STACK_ARRAY_BYTES = 4096;
+
+static uint32_t sizeOfObject(NLType t) {
+  // Total sizes of members + 8 bytes for a vtable pointer
+  std::function<uint32_t(NLType)> sizeOfMembers = [&](NLType t) -> uint32_t {
+    if (!t) { return 0; }
+    uint32_t size = 0;
+    for (auto const &field : t->fields) {
+      size += sizeOfValue(field.type);
+    }
+    return size + sizeOfMembers(t->supertype);
+  };
+  return sizeOfMembers(t) + 8;
+}
+
+// Fields of objects follow the 8-byte vtable pointer; structs have none.
+static uint32_t fieldOffset(NLType t, int idx) {
+  uint32_t offset = t->is_struct ? 0 : 8;
+  auto const &fields = t->get_fields();
+  for (int i = 0; i < idx; ++i) {
+    offset += sizeOfValue(fields[i].type);
+  }
+  return offset;
+}
+
+// Leaves a pointer to a zeroed object of the type described by typeInfo in
+// %rax. The allocation is bumped off the runtime's nursery inline
+// (see runtime/nlrt.h), falling back to nl_alloc once the nursery is full.
+// For arrays, countRef holds the number of elements; objects pass "$0".
+// Only %rax and %r15 are clobbered.
+void CodeGen::emitAlloc(const std::string &typeInfo,
+                        ValueRefTracker::ValueRef countRef, bool isArray,
+                        uint32_t size, uint32_t elemSize) {
+  static uint16_t id = 1;
+  auto const slowLabel = std::string("__alloc_slow_") + std::to_string(id);
+  auto const doneLabel = std::string("__alloc_done_") + std::to_string(id++);
+
+  if (isArray) {
+    // Negative counts are huge unsigned ones, so nl_alloc reports them.
+    text_.instr({"movq", countRef, "%r15"});
+    text_.instr({"cmpq", "$" + std::to_string(INLINE_ALLOC_MAX_ELEMS), "%r15"});
+    text_.instr({"ja", slowLabel});
+    if (elemSize == 8) {
+      text_.instr({"leaq",
+                   std::to_string(ALLOC_HEADER_SIZE + size) + "(,%r15,8)",
+                   "%r15"});
+    } else {
+      text_.instr({"imulq", "$" + std::to_string(elemSize), "%r15"});
+      text_.instr({"leaq",
+                   std::to_string(ALLOC_HEADER_SIZE + size) + "(%r15)",
+                   "%r15"});
+    }
+    text_.instr({"movq", "nl_nursery(%rip)", "%rax"});
+    text_.instr({"addq", "%rax", "%r15"});
   } else {
-    return false;
-  }
-}
-// TODO: Copied from LLVM backend - put in common utils
-/* Fetches the correct implementation of method that should be used
- for dynamic dispatch with type. Note that NL doesn't allow name reuse
- within a class, so the method name alone suffices here. However, it can
- be mangled to allow such behavior in the future. */
-std::string get_virtual_method(NLType type, const std::string &method, const std::unordered_set<std::string> funcLabels) {
-  NLType curr = type; // Curr is self or parent
-  for (NLType curr = type; curr != nullptr; curr = curr->supertype) {
-    auto methodName = curr->name + "_" + method;
-    if (funcLabels.find(methodName) == funcLabels.end()) {
-      return methodName;
-    }
-  }
-  assert(false && "No such virtual fn");
-}
-
-ValueRefTracker::ValueRef CodeGen::emitArrayInit(NLType nlType,
-                                const std::vector<const Expr *>& dims) {
-
-  auto innerType = Arrays::next_enclosed_type(nlType);
-  assert(innerType == Primitives::Int() && "Only Int arrays supported");
-  assert(dims.size() == 1);
-  // TODO: check that each dim is > 0.
-  emit(dims[0]);
-  text_.instr({"push", "%rdi"});
-  text_.instr({"push", "%rsi"});
-  // rdi holds # of elems
-  text_.instr({"mov", valueRefs_.get(dims[0]), "%rdi"});
-  // rdi now holds # of elems * size per elem
-  text_.instr({"imul", "$8", "%rdi"});
-  // rdi now holds another 8 bytes of header
-  text_.instr({"add", "$8", "%rdi"});
+    text_.instr({"movq", "nl_nursery(%rip)", "%rax"});
+    text_.instr({"leaq", std::to_string(ALLOC_HEADER_SIZE + size) + "(%rax)",
+                 "%r15"});
+  }
+  // %r15 is the new cursor; it must not pass the nursery's limit.
+  text_.instr({"cmpq", "nl_nursery+8(%rip)", "%r15"});
+  text_.instr({"ja", slowLabel});
+  text_.instr({"movq", "%r15", "nl_nursery(%rip)"});
+  text_.instr({"leaq", typeInfo + "(%rip)", "%r15"});
+  text_.instr({"movq", "%r15", "(%rax)"});
+  if (isArray) {
+    text_.instr({"movq", countRef, "%r15"});
+    text_.instr({"movq", "%r15", "8(%rax)"});
+  }
+  text_.instr({"addq", "$" + std::to_string(ALLOC_HEADER_SIZE), "%rax"});
+  text_.instr({"jmp", doneLabel});
+
+  text_.label({slowLabel});
+  text_.instr({"movq", countRef, "%rsi"});
+  text_.instr({"leaq", typeInfo + "(%rip)", "%rdi"});
   // Align the stack if necessary
   // TODO: Can we wrap this in an AlignedCall RAII?
   auto const stackLocals = stackFrames_.bases[enclosingFunc_];
-  // == 0 because we push rsi - can we track this with RAII or similar?
-  if (stackLocals.totalSize % 16 == 0) {
-    text_.instr({"push", "%rbx"});
-  }
-  // %rdi holds array size
-  text_.instr({"call", "malloc"});
-  if (stackLocals.totalSize % 16 == 0) {
-    text_.instr({"pop", "%rbx"});
-  }
-
-  text_.instr({"pop", "%rsi"});
-  // Restore %rdi
-  text_.instr({"pop", "%rdi"});
-  // %rax is a pointer to the malloc'd memory
-  // Array header { u32: size of each element, u32: number of elements }
-  text_.instr({"movl", "$8", "(%rax)"});
-  auto dimRef = valueRefs_.get(dims[0]);
-  text_.instr({"movl", dimRef[0] == '%' ? (dimRef+"d") : dimRef , "4(%rax)"});
+  if (stackLocals.totalSize % 16) {
+    text_.instr({"subq", "$8", "%rsp"});
+  }
+  text_.instr({"call", "nl_alloc"});
+  if (stackLocals.totalSize % 16) {
+    text_.instr({"addq", "$8", "%rsp"});
+  }
+  text_.label({doneLabel});
+}
+
+// Leaves a pointer to the stack slot that holds site's object in %rax,
+// zeroed. The slot is reused each time the allocation runs, so it's cleared
+// here rather than once. Code from this backend is never collected, so
+// stack objects get no nl_alloc_header. Only %rax and %r15 are clobbered.
+void CodeGen::emitStackAlloc(const void *site, uint32_t size) {
+  text_.instr({"leaq", frameObjectRef(site), "%rax"});
+  emitClear(size);
+}
+
+// The frame slot added for site with FrameBase::addObject.
+ValueRefTracker::ValueRef CodeGen::frameObjectRef(const void *site) {
+  auto const bpOffset =
+      stackFrames_.bases[enclosingFunc_].bpOffsetOfObject(site);
+  assert(bpOffset.has_value());
+  return "-" + std::to_string(*bpOffset) + "(%rbp)";
+}
+
+// Zeroes size bytes (a multiple of 8) at %rax. Clobbers %r15.
+void CodeGen::emitClear(uint32_t size) {
+  if (size <= 64) {
+    for (uint32_t i = 0; i < size; i += 8) {
+      text_.instr({"movq", "$0", std::to_string(i) + "(%rax)"});
+    }
+    return;
+  }
+  static uint16_t id = 1;
+  auto const loopLabel = std::string("__stack_clear_") + std::to_string(id++);
+  text_.instr({"movq", "$" + std::to_string(size / 8), "%r15"});
+  text_.label({loopLabel});
+  text_.instr({"movq", "$0", "-8(%rax,%r15,8)"});
+  text_.instr({"decq", "%r15"});
+  text_.instr({"jnz", loopLabel});
+}
+
+// Copies a struct of size bytes from the address in src to the one in
+// %rax. Structs are small, so the copy is unrolled. Clobbers %r15.
+void CodeGen::emitStructCopy(ValueRefTracker::ValueRef src, uint32_t size) {
+  for (uint32_t i = 0; i < size; i += 8) {
+    text_.instr({"movq", std::to_string(i) + "(" + src + ")", "%r15"});
+    text_.instr({"movq", "%r15", std::to_string(i) + "(%rax)"});
+  }
+}
+
+// Arrays start with { u32: size of each element, u32: number of elements }.
+// Arrays of more than one dimension follow that with a u32 extent and then
+// a u32 stride (in elements) per dimension. The elements come next, in
+// row-major order.
+static uint32_t arrayHeaderSize(size_t dims) {
+  return dims > 1 ? 8 + 8 * dims : 8;
+}
+
+static uint32_t arrayExtentOffset(size_t dim) { return 8 + 4 * dim; }
+
+static uint32_t arrayStrideOffset(size_t dims, size_t dim) {
+  return 8 + 4 * dims + 4 * dim;
+}
+
+// Aborts through the runtime unless 0 <= index < the u32 bound at
+// boundOffset in the array, which is read into %r15. Comparing unsigned
+// catches negative indices too.
+void CodeGen::emitBoundsCheck(ValueRefTracker::ValueRef arr,
+                              uint32_t boundOffset,
+                              ValueRefTracker::ValueRef index, int line) {
+  static uint16_t id = 1;
+  auto const okLabel = std::string("__index_ok_") + std::to_string(id++);
+
+  text_.instr({"movslq", std::to_string(boundOffset) + "(" + arr + ")", "%r15"});
+  text_.instr({"cmpq", index, "%r15"});
+  text_.instr({"ja", okLabel});
+  // nl_index_error doesn't return, so nothing needs saving.
+  text_.instr({"movq", index, "%rdi"});
+  text_.instr({"movq", "%r15", "%rsi"});
+  text_.instr({"movq", "$" + std::to_string(line), "%rdx"});
+  text_.instr({"andq", "$-16", "%rsp"});
+  text_.instr({"call", "nl_index_error"});
+  text_.label({okLabel});
+}
+
+// Addresses an element of a multi-dimensional array through the array and
+// the element's offset (the sum of each index times its dimension's
+// stride). Their registers are already freed, so the operand must be used
+// right away. Accesses that ArrayBounds proved safe aren't checked.
+ValueRefTracker::ValueRef CodeGen::emitElementRef(
+    const Expr *access, const Expr *array,
+    const std::vector<const Expr *> &indices, uint32_t elemSize, int line) {
+  auto const dims = indices.size();
+  auto const checked = !bounds_.in_bounds(access);
+
+  auto const arr = valueRefs_.makeAssignable(array);
+  text_.instr({"mov", valueRefs_.get(array), arr});
+  auto const offset = valueRefs_.makeAssignable(indices[0]);
+  text_.instr({"mov", valueRefs_.get(indices[0]), offset});
+  if (checked) {
+    emitBoundsCheck(arr, arrayExtentOffset(0), offset, line);
+  }
+  text_.instr({"movslq", std::to_string(arrayStrideOffset(dims, 0)) + "(" + arr + ")", "%r15"});
+  text_.instr({"imulq", "%r15", offset});
+
+  for (size_t i = 1; i < dims; ++i) {
+    auto const index = valueRefs_.makeAssignable(indices[i]);
+    text_.instr({"mov", valueRefs_.get(indices[i]), index});
+    if (checked) {
+      emitBoundsCheck(arr, arrayExtentOffset(i), index, line);
+    }
+    // The last dimension's stride is 1.
+    if (i + 1 < dims) {
+      text_.instr({"movslq", std::to_string(arrayStrideOffset(dims, i)) + "(" + arr + ")", "%r15"});
+      text_.instr({"imulq", "%r15", index});
+    }
+    text_.instr({"addq", index, offset});
+    valueRefs_.regFree(index);
+  }
+
+  if (elemSize != 8) {
+    text_.instr({"imulq", "$" + std::to_string(elemSize), offset});
+  }
+  valueRefs_.regFree(arr);
+  valueRefs_.regFree(offset);
+  return std::to_string(arrayHeaderSize(dims)) + "(" + arr + ", " + offset +
+         (elemSize == 8 ? ", 8)" : ", 1)");
+}
+
+// The number of elements of an array that goes in the stack frame, or 0.
+uint32_t CodeGen::stackArrayElems(const VarStmt *decl) {
+  auto const elems = escapes_.stack_array_size(decl);
+  auto const elemSize = sizeOfValue(sm_.types.get(decl->tp.name.id));
+  return elems * elemSize <= MAX_STACK_ARRAY_BYTES ? elems : 0;
+}
+
+// Addresses an element of a one-dimensional array. Words are indexed
+// directly; the index is scaled to the element size otherwise.
+ValueRefTracker::ValueRef CodeGen::elementRef(ValueRefTracker::Register arr,
+                                              ValueRefTracker::Register index,
+                                              uint32_t elemSize) {
+  if (elemSize == 8) {
+    return std::string("8(") + arr + ", " + index + ", 8)";
+  }
+  text_.instr({"imulq", "$" + std::to_string(elemSize), index});
+  return std::string("8(") + arr + ", " + index + ", 1)";
+}
+
+// Arrays that EscapeAnalysis found don't escape go in the stack frame.
+// Struct elements are stored inline.
+ValueRefTracker::ValueRef CodeGen::emitArrayInit(const VarStmt *decl,
+                                                 NLType nlType) {
+  auto const &dims = decl->tp.dims;
+  auto const stackElems = stackArrayElems(decl);
+
+  auto innerType = Arrays::elem_type(nlType);
+  assert((innerType == Primitives::Int() || innerType->is_struct) &&
+         "Only Int and struct arrays supported");
+  auto const elemSize = sizeOfValue(innerType);
+  auto const elemSizeImm = "$" + std::to_string(elemSize);
+  auto typeInfo = "typeinfo_array_" + innerType->name;
+
+  // Each extent gets a register of its own, since one that's a call's
+  // result is in %rax, which the next call and the allocation overwrite.
+  std::vector<ValueRefTracker::Register> extents;
+  for (auto const *dim : dims) {
+    emit(dim);
+    extents.push_back(valueRefs_.makeAssignable(dim));
+    text_.instr({"mov", valueRefs_.get(dim), extents.back()});
+  }
+
+  if (dims.size() == 1) {
+    // Array header { u32: size of each element, u32: number of elements },
+    // followed by the elements.
+    if (stackElems) {
+      emitStackAlloc(decl, arrayHeaderSize(1) + elemSize * stackElems);
+    } else {
+      arrayTypeInfos_[typeInfo] = {arrayHeaderSize(1), elemSize};
+      emitAlloc(typeInfo, extents[0], true, 8, elemSize);
+    }
+    // %rax is a pointer to the array
+    text_.instr({"movl", elemSizeImm, "(%rax)"});
+    text_.instr({"movl", extents[0] + "d", "4(%rax)"});
+    valueRefs_.regFree(extents[0]);
+    return "%rax";
+  }
+
+  auto const count = valueRefs_.makeVirtual();
+  text_.instr({"mov", extents[0], count});
+  for (size_t i = 1; i < dims.size(); ++i) {
+    text_.instr({"imulq", extents[i], count});
+  }
+  if (stackElems) {
+    emitStackAlloc(decl, arrayHeaderSize(dims.size()) + elemSize * stackElems);
+  } else {
+    typeInfo += "_" + std::to_string(dims.size()) + "d";
+    arrayTypeInfos_[typeInfo] = {arrayHeaderSize(dims.size()), elemSize};
+    emitAlloc(typeInfo, count, true, arrayHeaderSize(dims.size()), elemSize);
+  }
+  // %rax is a pointer to the array
+  text_.instr({"movl", elemSizeImm, "(%rax)"});
+  text_.instr({"movl", count + "d", "4(%rax)"});
+
+  // Row-major strides, from the last dimension's 1 outwards.
+  text_.instr({"movq", "$1", "%r15"});
+  for (size_t i = dims.size(); i-- > 0;) {
+    text_.instr({"movl", "%r15d", std::to_string(arrayStrideOffset(dims.size(), i)) + "(%rax)"});
+    text_.instr({"imulq", extents[i], "%r15"});
+  }
+  for (size_t i = 0; i < dims.size(); ++i) {
+    text_.instr({"movq", extents[i], "%r15"});
+    text_.instr({"movl", "%r15d", std::to_string(arrayExtentOffset(i)) + "(%rax)"});
+    valueRefs_.regFree(extents[i]);
+  }
   return "%rax";
 }
 
-ValueRefTracker::ValueRef CodeGen::emitClassInit(NLType nlType) {
-  // Total sizes of members
-  // + vtable ptr
-  std::function<uint32_t(NLType)> sizeOfMembers = [&](NLType t) -> uint32_t {
-    if (!t) { return 0; }
-    return t->fields.size() * 8 + sizeOfMembers(t->supertype);  
-  };
-  // Total size is sizeOfMembers + 8 bytes for a vtable pointer
-  text_.instr({"push", "%rdi"});
-  text_.instr({"push", "%rsi"});
-  text_.instr({"mov", std::string("$")+std::to_string(sizeOfMembers(nlType)+8), "%rdi" });
-  text_.instr({"call", "malloc"});
-  text_.instr({"pop", "%rsi"});
-  text_.instr({"pop", "%rdi"});
+ValueRefTracker::ValueRef CodeGen::emitClassInit(const Call *init,
+                                                 NLType nlType) {
+  if (escapes_.on_stack(init)) {
+    emitStackAlloc(init, sizeOfObject(nlType));
+  } else {
+    emitAlloc("typeinfo_" + nlType->name, "$0", false, sizeOfObject(nlType));
+  }
 
   // First 8 bytes are the vtable pointer
   text_.instr({"lea", "vtable_" + nlType->name + "(%rip)", "%r15"});
   text_.instr({"mov", "%r15", "(%rax)"});
 
-  // %rax is a pointer to the malloc'd memory
+  // %rax is a pointer to the object
   return "%rax";
 }
 
 void CodeGen::generate(const std::vector<Stmt *> &program) {
   sm_.reset();
-  stackFrames_.init(program);
+  {
+    PassTimer timer("Stack frame layout");
+    stackFrames_.init(program);
+  }
   sm_.reset();
-  // Setup format strings for printf
-  rodata_.directive({"format_printf_int: .asciz \"%ld\\n\""});
-  rodata_.directive({"format_printf_float: .asciz \"%f\\n\""});
   text_.directive({".global main"});
-  emit(program);
+  {
+    PassTimer timer("Instruction selection");
+    emit(program);
+  }
 
+  PassTimer timer("Vtable emission");
   for (auto *c : classes_) {
-    auto className = c->name.lexeme;
-    auto const classType = sm_.globals().typetab->get(className);
+    auto className = c->name.lexeme();
+    auto const classType = sm_.types.get_global(c->name.id);
     rodata_.directive({ std::string("vtable_") + className + ":"});
-    for (auto m : classType->get_methods()) {
-      rodata_.directive({ std::string(".quad ") + get_virtual_method(classType, m->name, funcLabels_)});
+    // Each slot points at the implementation from the class that last
+    // defined the method.
+    auto const &methods = classType->get_methods();
+    for (size_t i = 0; i < methods.size(); ++i) {
+      auto const *impl = classType->method_owner(i);
+      rodata_.directive({ std::string(".quad ") + impl->name + "_" + methods[i]->name});
     }
   }
+
+  // Type descriptors for the runtime (see nl_type_info in runtime/nlrt.h).
+  // Objects don't start with a GC byte in this backend, and no shadow stack
+  // is kept, so nothing here is ever traced: they only carry sizes.
+  rodata_.directive({".balign 8"});
+  arrayTypeInfos_["typeinfo_array_Int"] = {arrayHeaderSize(1), 8};
+  for (auto const &[label, sizes] : arrayTypeInfos_) {
+    rodata_.directive({label + ": .quad " + std::to_string(sizes.first) +
+                       ", " + std::to_string(sizes.second) + ", 0, 0"});
+  }
+  for (auto *c : classes_) {
+    auto const classType = sm_.types.get_global(c->name.id);
+    rodata_.directive({"typeinfo_" + c->name.lexeme() + ": .quad " +
+                       std::to_string(sizeOfObject(classType)) + ", 0, 0, 0"});
+  }
 }
 
 void CodeGen::emit(const std::vector<Stmt *> &stmts) {
@@ -122,12 +383,32 @@ void CodeGen::emit(const std::vector<Stmt *> &stmts) {
 }
 
 void CodeGen::emit(const Stmt *stmt) { stmt->accept(this); }
-void CodeGen::emit(const Expr *expr) { expr->accept(this); }
+void CodeGen::emit(const Expr *expr) {
+  // Expressions whose value is known (literals included) become immediates.
+  if (auto const known = consts_.value(expr)) {
+    if (known.kind == KnownValue::FLOAT) {
+      uint64_t bits;
+      std::memcpy(&bits, &known.float_value, sizeof(bits));
+      valueRefs_.assign(expr, floatLiteral(".quad " + std::to_string(bits)));
+    } else {
+      valueRefs_.assign(expr, "$" + std::to_string(known.int_value));
+    }
+    return;
+  }
+  expr->accept(this);
+}
+
+// x86-64 has no floating-point immediates, so Floats are read from .rodata.
+ValueRefTracker::ValueRef CodeGen::floatLiteral(const std::string &directive) {
+  static uint16_t id = 1;
+  auto const label = std::string("_float_literal_") + std::to_string(id++);
+  rodata_.directive({label + ": " + directive});
+  return label;
+}
 
 void CodeGen::visit(const ExprStmt *stmt) {
   emit(stmt->expression);
-  // Clear all registers, unless we're using a preallocation scheme,
-  // which we're current not.
+  // No temporary outlives its statement.
   valueRefs_.resetRegisters();
 }
 void CodeGen::visit(const BlockStmt *stmt) {
@@ -146,56 +427,46 @@ void CodeGen::visit(const PrintStmt *stmt) {
   emit(e);
   auto const exprRef = valueRefs_.get(e);
 
+  // Printing is buffered by the runtime (see nl_print_int etc. in
+  // runtime/nlrt.h), which takes the value as its only argument. Nothing
+  // is kept in the registers it may overwrite (see regalloc.h).
   // Align the stack if necessary
   auto const stackLocals = stackFrames_.bases[enclosingFunc_];
   if (stackLocals.totalSize % 16) {
-    text_.instr({"push", "%rbx"});
+    text_.instr({"subq", "$8", "%rsp"});
   }
 
-  auto const exprType = exprTypes_.find(e);
-  if (exprType->second == Primitives::String()) {
-    text_.instr({"push", "%rdi"});
-    if (stackLocals.totalSize % 16) { text_.instr({"push", "%rbx"}); }
+  auto const exprType = exprTypes_.get(e);
+  if (exprType == Primitives::String()) {
     text_.instr({"mov", exprRef, "%rdi"});
-    text_.instr({"call", "puts"});
-    // This sucks - the library should hide this stack-aligning stuff
-    if (stackLocals.totalSize % 16) { text_.instr({"pop", "%rbx"}); }
-    text_.instr({"pop", "%rdi"});
-  } else if (exprType->second == Primitives::Float()) {
-    text_.instr({"lea", "format_printf_float(%rip)", "%rdi"});
+    text_.instr({"call", "nl_print_str"});
+  } else if (exprType == Primitives::Float()) {
     // TODO: Assumes the float is a literal, which isn't always true
     text_.instr({"movsd", exprRef + "(%rip)", "%xmm0"});
-    text_.instr({"call", "printf"});
+    text_.instr({"call", "nl_print_float"});
   } else {
-    // %rdi and %rsi hold first two integer/pointer function params
-    // per x86-64 System V calling convention
-    // Preserve/restore %rdi and %rsi *carefully*
-
-    // This is hacky - we want to use r14/r15 as GP, not just
-    // compiler scratch.
-    text_.instr({"push", "%rdi"});
-    text_.instr({"push", "%rsi"});
-    text_.instr({"lea", "format_printf_int(%rip)", "%rdi"});
-    text_.instr({"mov", exprRef, "%rsi"});
-    text_.instr({"call", "printf"});
-    text_.instr({"pop", "%rsi"});
-    text_.instr({"pop", "%rdi"});
+    text_.instr({"mov", exprRef, "%rdi"});
+    text_.instr({"call", "nl_print_int"});
   }
   if (stackLocals.totalSize % 16) {
-    text_.instr({"pop", "%rbx"});
+    text_.instr({"addq", "$8", "%rsp"});
   }
   valueRefs_.regFree(exprRef);
   text_.instr({"# END print", ap.print(stmt->expression)});
 }
 
 void CodeGen::visit(const VarStmt *stmt) {
-  auto const &varName = stmt->name.lexeme;
-  auto const nlType = sm_.current().typetab->get(varName);
+  auto const &varName = stmt->name.lexeme();
+  auto const nlType = sm_.types.get(stmt->name.id);
+  if (nlType->is_struct) {
+    emitStructInit(stmt, nlType);
+    return;
+  }
   if (stmt->expression) {
     emit(stmt->expression);
   } else {
     if (nlType->is_array_type()) {
-    valueRefs_.assign(stmt->expression, emitArrayInit(nlType, stmt->tp.dims));
+    valueRefs_.assign(stmt->expression, emitArrayInit(stmt, nlType));
     } else {
       // TODO: Pick reasonable defaults, based on type.
       valueRefs_.assign(stmt->expression, "$0");
@@ -203,33 +474,59 @@ void CodeGen::visit(const VarStmt *stmt) {
   }
 
 
+  auto val = valueRefs_.get(stmt->expression);
+  valueRefs_.regFree(valueRefs_.get(stmt->expression));
+
+  // Locals of functions get a virtual register of their own.
+  if (enclosingFunc_) {
+    auto const reg = valueRefs_.makeVirtual();
+    text_.instr({"movq", val, reg});
+    namedVals->insert(varName, reg);
+    return;
+  }
+
   // For globals, space should be reserved in .data and addressed relative to %rip
   auto const bpOffset = stackFrames_.bases[enclosingFunc_].bpOffsetOf(stmt);
   assert(bpOffset.has_value());
 
-  auto val = valueRefs_.get(stmt->expression);
-  valueRefs_.regFree(valueRefs_.get(stmt->expression));
-
   // dest is the memory location of this variable on the stack
   // to start off with, assume only one int64 variable, first thing on the stack
   auto const dest = (*bpOffset ? (std::string("-") + std::to_string(*bpOffset)) : std::string{}) + "(%rbp)";
   // 8 bytes so use q suffix
-  bool mustRestoreVal = false;
   if (val[0] != '%' && dest[0] != '%' && val[0] != '$') {
-    auto [valReg, mustRestore] = valueRefs_.acquireRegister(stmt->expression);
+    auto const valReg = valueRefs_.makeAssignable(stmt->expression);
     text_.instr({"mov", val, valReg});
-    val = valReg; mustRestoreVal = mustRestore;
+    val = valReg;
   }
   text_.instr({ "movq", val, dest});
-  if (mustRestoreVal) {
-    text_.instr({"pop", val});
-  }
   namedVals->insert(varName, dest);
 }
 
+// Struct locals are stored in the frame, and start out zeroed or as a copy
+// of their initializer.
+void CodeGen::emitStructInit(const VarStmt *stmt, NLType nlType) {
+  auto const bpOffset = stackFrames_.bases[enclosingFunc_].bpOffsetOf(stmt);
+  assert(bpOffset.has_value());
+  auto const dest = "-" + std::to_string(*bpOffset) + "(%rbp)";
+  if (stmt->expression) {
+    emit(stmt->expression);
+    auto const src = valueRefs_.get(stmt->expression);
+    text_.instr({"leaq", dest, "%rax"});
+    emitStructCopy(src, sizeOfValue(nlType));
+    valueRefs_.regFree(src);
+  } else {
+    text_.instr({"leaq", dest, "%rax"});
+    emitClear(sizeOfValue(nlType));
+  }
+  namedVals->insert(stmt->name.lexeme(), dest);
+}
+
 void CodeGen::visit(const ClassStmt *stmt) {
-  classes_.push_back(stmt);
-  enclosingClass_ = sm_.current().typetab->get(stmt->name.lexeme);;
+  // Structs have no vtable or type descriptor.
+  if (!stmt->is_struct) {
+    classes_.push_back(stmt);
+  }
+  enclosingClass_ = sm_.types.get(stmt->name.id);
   enterScope();
   for (const Stmt *method : stmt->methods) {
     emit(method);
@@ -239,26 +536,26 @@ void CodeGen::visit(const ClassStmt *stmt) {
 }
 
 void CodeGen::visit(const IfStmt *stmt) {
-  static uint16_t id = 1;
-  emit(stmt->condition);
-  const auto ref = valueRefs_.get(stmt->condition);
-  // TODO: Is is fine if cond is memory and not register?
-  auto const cond = valueRefs_.makeAssignable(stmt->condition);
-  if (ref != cond) {
-    text_.instr({"mov", ref, cond });
-    valueRefs_.regFree(ref); // TODO: Can we do this by reference-counting?
+  // Only the branch a known condition takes is emitted; the other one's
+  // scopes are skipped.
+  if (auto const known = consts_.value(stmt->condition)) {
+    if (known.int_value) {
+      emit(stmt->then_branch);
+      sm_.skip(consts_.scopes_in(stmt->else_branch));
+    } else {
+      sm_.skip(consts_.scopes_in(stmt->then_branch));
+      if (stmt->else_branch) {
+        emit(stmt->else_branch);
+      }
+    }
+    return;
   }
 
+  static uint16_t id = 1;
   auto elseLabel = std::string("__else_") + std::to_string(id++);
   auto postIfStmtLabel = std::string("__post_ifstmt_") + std::to_string(id);
-  // cond AND cond
-  // cond & cond - set flags
-  // if cond is true - ZF = 0 ; jne jumps
-  // else            = ZF = 1 ;  je jumps
-  text_.instr({"test", cond, cond });
-  // je = jump if ZF=1 (i.e cond is 0)
-  text_.instr({"je", stmt->else_branch ? elseLabel : postIfStmtLabel});
-  valueRefs_.regFree(cond);
+  emitJumpUnless(stmt->condition,
+                 stmt->else_branch ? elseLabel : postIfStmtLabel);
   emit(stmt->then_branch);
   if (stmt->else_branch) {
     text_.instr({"jmp", postIfStmtLabel});
@@ -269,33 +566,106 @@ void CodeGen::visit(const IfStmt *stmt) {
 }
 
 void CodeGen::visit(const WhileStmt *stmt) {
+  auto const known = consts_.value(stmt->condition);
+  if (known && !known.int_value) {
+    sm_.skip(consts_.scopes_in(stmt->body));
+    return;
+  }
+
   static uint16_t id = 1;
   auto const checkCondLabel =
       std::string("__loop_check_") + std::to_string(id);
   auto const postLoopLabel = std::string("__post_loop_") + std::to_string(id++);
 
   text_.label({checkCondLabel});
-  emit(stmt->condition);
-  auto cond = valueRefs_.get(stmt->condition);
-  bool mustRestoreCond = false;
-  if (cond[0] != '%') {
-    auto const [condReg, mustRestore] =
-        valueRefs_.acquireRegister(stmt->condition);
-    text_.instr({"mov", cond, condReg});
-    cond = condReg;
-    mustRestoreCond = mustRestore;
-  }
-  text_.instr({"test", cond, cond});
-  text_.instr({"je", postLoopLabel});
-  valueRefs_.regFree(cond);
+  emitJumpUnless(stmt->condition, postLoopLabel);
   if (stmt->body) {
     emit(stmt->body);
   }
   text_.instr({"jmp", checkCondLabel});
   text_.label({postLoopLabel});
-  if (mustRestoreCond) {
-    text_.instr({"pop", cond});
+}
+
+// Conditions of ifs and loops are never materialized as Bools when they
+// needn't be: and/or/! become jumps, and Int comparisons jump on the flags
+// cmp sets.
+void CodeGen::emitJump(const Expr *cond, bool when, const std::string &label) {
+  static uint16_t id = 1;
+  if (auto const known = consts_.value(cond)) {
+    if ((known.int_value != 0) == when) {
+      text_.instr({"jmp", label});
+    }
+    return;
+  }
+  if (auto const *group = dynamic_cast<const Grouping *>(cond)) {
+    emitJump(&group->expression, when, label);
+    return;
+  }
+  if (auto const *unary = dynamic_cast<const Unary *>(cond)) {
+    if (unary->op.type == TokenType::BANG) {
+      emitJump(&unary->right, !when, label);
+      return;
+    }
+  }
+  if (auto const *logical = dynamic_cast<const Logical *>(cond)) {
+    // (a and b) is false if a is, (a or b) true if a is. Otherwise b
+    // decides, so a jumps past it in the other case.
+    auto const decidesAlone = logical->op.type == TokenType::OR;
+    if (decidesAlone == when) {
+      emitJump(&logical->left, when, label);
+      emitJump(&logical->right, when, label);
+    } else {
+      auto const skipLabel = std::string("__cond_skip_") + std::to_string(id++);
+      emitJump(&logical->left, !when, skipLabel);
+      emitJump(&logical->right, when, label);
+      text_.label({skipLabel});
+    }
+    return;
+  }
+
+  if (auto const *binary = dynamic_cast<const Binary *>(cond)) {
+    static const std::unordered_map<int, std::pair<std::string, std::string>>
+        jumps = {
+            {TokenType::LESS, {"jl", "jge"}},
+            {TokenType::LESS_EQUAL, {"jle", "jg"}},
+            {TokenType::GREATER, {"jg", "jle"}},
+            {TokenType::GREATER_EQUAL, {"jge", "jl"}},
+            {TokenType::EQUAL_EQUAL, {"je", "jne"}},
+            {TokenType::BANG_EQUAL, {"jne", "je"}},
+        };
+    auto const jump = jumps.find(binary->op.type);
+    if (jump != jumps.end() &&
+        exprTypes_.get(&binary->left) == Primitives::Int()) {
+      emit(&binary->left);
+      auto const left = valueRefs_.get(&binary->left);
+      auto const dest = valueRefs_.makeAssignable(&binary->left);
+      if (left != dest) {
+        valueRefs_.regOverwrite(&binary->left, dest);
+        text_.instr({"mov", left, dest});
+      }
+      emit(&binary->right);
+      auto const right = valueRefs_.get(&binary->right);
+      text_.instr({"cmp", right, dest});
+      valueRefs_.regFree(dest);
+      valueRefs_.regFree(right);
+      text_.instr({when ? jump->second.first : jump->second.second, label});
+      return;
+    }
   }
+
+  emit(cond);
+  auto const ref = valueRefs_.get(cond);
+  auto const reg = valueRefs_.makeAssignable(cond);
+  if (ref != reg) {
+    text_.instr({"mov", ref, reg});
+  }
+  text_.instr({"test", reg, reg});
+  text_.instr({when ? "jne" : "je", label});
+  valueRefs_.regFree(reg);
+}
+
+void CodeGen::emitJumpUnless(const Expr *cond, const std::string &label) {
+  emitJump(cond, false, label);
 }
 
 void CodeGen::visit(const FuncStmt *stmt) {
@@ -308,9 +678,19 @@ void CodeGen::visit(const FuncStmt *stmt) {
       name += enclosingClass_->name;
       name += "_";
     }
-    return name + stmt->name.lexeme;
+    return name + stmt->name.lexeme();
   }();
   funcLabels_.insert(label);
+  // Structs are passed by address, and copied into the callee's frame. One
+  // is returned by copying it into a buffer whose address the caller
+  // passes in %rax (see visit(const Call *)), and returning that address.
+  auto const isStruct = [&](const TypeParse &tp) {
+    return !tp.is_array() && sm_.types.get(tp.name.id)->is_struct;
+  };
+  auto const returnsStruct = isStruct(stmt->return_type);
+  auto const oldEnclosingFuncLabel = enclosingFuncLabel_;
+  enclosingFuncLabel_ = label;
+  auto const funcBegin = text_.contents.size();
   text_.label({label});
   text_.instr({"pushq", "%rbp"});
 
@@ -318,28 +698,105 @@ void CodeGen::visit(const FuncStmt *stmt) {
   // slot on the stack, not to a valid value. It always points to the memory
   // location that will be used for the next push operation.
   // Also, values 'grow' towards lower addresses.
-  auto const stackLocalsBase = stackFrames_.bases[stmt];
+  auto &frame = stackFrames_.bases[stmt];
+  // Objects EscapeAnalysis keeps on the stack go below the locals.
+  for (const Call *init : escapes_.frame_objects(stmt)) {
+    auto const &cls = static_cast<const Get &>(init->callee).callee;
+    frame.addObject(init, sizeOfObject(sm_.types.get(
+                              static_cast<const Variable &>(cls).name.id)));
+  }
+  for (const VarStmt *array : escapes_.frame_arrays(stmt)) {
+    if (auto const elems = stackArrayElems(array)) {
+      auto const elemSize = sizeOfValue(sm_.types.get(array->tp.name.id));
+      frame.addObject(array, arrayHeaderSize(array->tp.dims.size()) +
+                                 elemSize * elems);
+    }
+  }
+  for (size_t i = 0; i < stmt->parameters.size(); ++i) {
+    if (isStruct(stmt->parameter_types[i])) {
+      frame.addObject(&stmt->parameters[i],
+                      sizeOfValue(sm_.types.get(stmt->parameter_types[i].name.id)));
+    }
+  }
+  if (returnsStruct) {
+    frame.addObject(stmt, 8);
+  }
+  auto const stackLocalsBase = frame;
   text_.instr({"movq", "%rsp", "%rbp"});
+  auto const frameSizeIdx = text_.contents.size();
   text_.instr({"subq", "$" + std::to_string(stackLocalsBase.totalSize),
                "%rsp"});  // locals sit between bp and sp
+  if (returnsStruct) {
+    text_.instr({"movq", "%rax", frameObjectRef(stmt)});
+  }
+  // Self tail calls start over from here, in the same frame.
+  text_.label({"__body_" + label});
+
+  // Parameters, and `this`, get virtual registers of their own like
+  // locals, so the argument registers are free once the body starts.
+  static std::vector<std::string> argRegs = { "%rdi", "%rsi", "%rdx", "%rcx", "%r8", "%r9" };
+  auto const hasImplicitThisArg = enclosingClass_ != nullptr;
+  if (hasImplicitThisArg) {
+    thisRef_ = valueRefs_.makeVirtual();
+    text_.instr({"movq", "%rdi", thisRef_});
+  }
+  for (size_t i = 0; i < stmt->parameters.size(); ++i) {
+    auto const &tp = stmt->parameter_types[i];
+    auto const &argReg = argRegs[i + hasImplicitThisArg];
+    if (isStruct(tp)) {
+      auto const copy = frameObjectRef(&stmt->parameters[i]);
+      text_.instr({"leaq", copy, "%rax"});
+      emitStructCopy(argReg, sizeOfValue(sm_.types.get(tp.name.id)));
+      namedVals->insert(stmt->parameters[i].lexeme(), copy);
+    } else {
+      auto const reg = valueRefs_.makeVirtual();
+      text_.instr({"movq", argReg, reg});
+      namedVals->insert(stmt->parameters[i].lexeme(), reg);
+    }
+  }
 
   emit(stmt->body);
   
   // Void functions may not have return stmt
   // TODO: Insert this in reachability stage!
-  if (text_.contents.back().values[0] != "ret") {
+  auto const &last = text_.contents.back().values[0];
+  if (last != "ret" && last != "jmp") {
     ReturnStmt tmp({}, nullptr);
     emit(&tmp);
   }
+  RegisterAllocator(text_.contents, frame).run(funcBegin);
+  // Spill slots, and buffers for struct results, are only known now.
+  text_.contents[frameSizeIdx].values[1] = "$" + std::to_string(frame.totalSize);
 
+  enclosingFuncLabel_ = oldEnclosingFuncLabel;
   enclosingFunc_ = oldenclosingFunc_;
   exitScope();
 }
 
 void CodeGen::visit(const ReturnStmt *stmt) {
   if (stmt->value) {
+    // Returned calls are tail calls, which return to our caller themselves.
+    auto const *call = dynamic_cast<const Call *>(stmt->value);
+    tailCall_ = call;
     emit(stmt->value);
-    text_.instr({"mov", valueRefs_.get(stmt->value), "%rax"});
+    // Cleared if the call was made as a tail call.
+    auto const isTailCall = call && tailCall_ == nullptr;
+    tailCall_ = nullptr;
+    if (isTailCall) {
+      return;
+    }
+    if (auto const nlType = exprTypes_.get(stmt->value); nlType->is_struct) {
+      // %rax is loaded with the caller's buffer, so the struct's address
+      // must be elsewhere.
+      auto const src = valueRefs_.makeAssignable(stmt->value);
+      if (valueRefs_.get(stmt->value) != src) {
+        text_.instr({"mov", valueRefs_.get(stmt->value), src});
+      }
+      text_.instr({"movq", frameObjectRef(enclosingFunc_), "%rax"});
+      emitStructCopy(src, sizeOfValue(nlType));
+    } else {
+      text_.instr({"mov", valueRefs_.get(stmt->value), "%rax"});
+    }
   }
 
   text_.instr({"mov", "%rbp", "%rsp"});
@@ -348,8 +805,8 @@ void CodeGen::visit(const ReturnStmt *stmt) {
 }
 
 void CodeGen::visit(const Unary *expr) {
-  auto const exprType = exprTypes_.find(&expr->right);
-  if (exprType->second == Primitives::Float()) {
+  auto const exprType = exprTypes_.get(&expr->right);
+  if (exprType == Primitives::Float()) {
     // Unimplemented
     return;
   }
@@ -363,7 +820,7 @@ void CodeGen::visit(const Unary *expr) {
   if (expr->op.type == TokenType::MINUS) {
     text_.instr({"neg", dest});
   } else { // BANG
-    text_.instr({"not", dest});
+    text_.instr({"xor", "$1", dest});
   }
   valueRefs_.assign(expr, dest);
 }
@@ -397,6 +854,8 @@ void CodeGen::visit(const Binary *expr) {
     auto destByte = dest[0] == '%' ? (dest+"b") : dest;
     text_.instr({"cmp", right, dest });
     text_.instr({setByteOp, destByte});
+    // Bools are whole words of 0 or 1.
+    text_.instr({"movzbq", destByte, dest});
     valueRefs_.regOverwrite(expr, dest);
     valueRefs_.regFree(right);
   };
@@ -417,11 +876,12 @@ void CodeGen::visit(const Binary *expr) {
     break;
   }
   case SLASH: {
-    auto destl = (dest[0] == '%' ? dest+"d" : dest);
-    text_.instr({"xor", "%rax", "%rax" });
-    text_.instr({"movl", destl, "%eax" });
-    text_.instr({"movl", right, "%ecx" });
-    text_.instr({"cltd" }); // sign-extends eax into edx:eax
+    // idiv divides %rdx:%rax. Argument registers only hold arguments
+    // while a call is made, so %rdx and %rcx are free here. The divisor is
+    // read first, as it may be in %rax.
+    text_.instr({"movq", right, "%rcx" });
+    text_.instr({"movq", dest, "%rax" });
+    text_.instr({"cqto" }); // sign-extends rax into rdx:rax
     text_.instr({"idivq", "%rcx" });
     text_.instr({"movq", "%rax", dest });
     valueRefs_.regOverwrite(expr, dest);
@@ -433,7 +893,7 @@ void CodeGen::visit(const Binary *expr) {
     break;
   }
   case LESS: {
-    cmpOpEmit("setc");
+    cmpOpEmit("setl");
     break;
   }
   case GREATER_EQUAL: {
@@ -459,26 +919,22 @@ void CodeGen::visit(const Binary *expr) {
 void CodeGen::visit(const Grouping *expr) {
   auto const *e = &expr->expression;
   emit(e);
-  valueRefs_.overwrite(expr, valueRefs_.get(e));
+  valueRefs_.overwrite(expr, e);
 }
 
 void CodeGen::visit(const StrLiteral *expr) {
   static uint16_t strLiteralId = 1;
-  // Reuse literals if possible
+  // Each distinct literal is emitted once
   static std::unordered_map<std::string, std::string> literalToLabel;
-  auto it = literalToLabel.find(expr->value);
-  if (it != literalToLabel.end()) {
-    valueRefs_.assign(expr, it->second);
-    return;
+  auto &label = literalToLabel[expr->value];
+  if (label.empty()) {
+    label = std::string("__strlit_") + std::to_string(strLiteralId++);
+    rodata_.directive({label + ": .asciz \"" + expr->value + "\""});
   }
-  auto const label =
-      std::string("__strlit_") + std::to_string(strLiteralId++);
-  rodata_.directive({label + ": .asciz \"" + expr->value + "\""});
-  literalToLabel[expr->value] = label;
   // Need memory references to be rip-relative to produce position independent
   // executables i.e we want the assembler to emit a RIP-relative relocation
   // rather than an absolute R_X86_64_32, since gcc invokes the linker in PIE
-  // mode by default. Same for printf format strings below.
+  // mode by default.
   // e.g. `lea __strlit_1(%rip), %rsi`
   auto const dest = valueRefs_.makeAssignable(expr);
   text_.instr({"lea", label+"(%rip)", dest});
@@ -486,15 +942,12 @@ void CodeGen::visit(const StrLiteral *expr) {
 }
 
 void CodeGen::visit(const NumLiteral *expr) {
-  auto const exprType = exprTypes_.find(expr);
-  if(exprType == exprTypes_.end()) { std::cerr << "[Unknown ExprType]" << std::endl; return; }
+  auto const exprType = exprTypes_.get(expr);
+  if(!exprType) { std::cerr << "[Unknown ExprType]" << std::endl; return; }
   // TODO: How do negative literals work here?
-  if (exprType->second == Primitives::Float()) {
-    static uint16_t id = 1;
-    auto const label = std::string("_float_literal_") + std::to_string(id++);
-    rodata_.directive({label + ": .double " + expr->value});
-    valueRefs_.assign(expr, label);
-  } else if (exprType->second == Primitives::Int()) {
+  if (exprType == Primitives::Float()) {
+    valueRefs_.assign(expr, floatLiteral(".double " + expr->value));
+  } else if (exprType == Primitives::Int()) {
     // e.g. 5 becomes $5
     valueRefs_.assign(expr, "$" + expr->value);
   }
@@ -507,73 +960,72 @@ void CodeGen::visit(const BoolLiteral *expr) {
 }
 
 void CodeGen::visit(const Variable *expr) {
-  auto const &varName = expr->name.lexeme;
-  auto key = TypeTableUtil::fn_key(varName);
-  auto const nlType = sm_.current().typetab->get(key);
+  auto const &varName = expr->name.lexeme();
+  auto key = TypeTableUtil::fn_key(expr->name.id);
+  auto const nlType = sm_.types.get(key);
   // Referring to a function?
   if (nlType && nlType->is_function_type()) {
     valueRefs_.assign(expr, varName);
     return;
   }
 
-  // Referring to a function parameter?
-  auto const& params = enclosingFunc_->parameters;
-  auto hasImplicitThisArg = enclosingClass_ != nullptr;
-  static std::vector<std::string> argRegs = { "%rdi", "%rsi", "%rdx", "%rcx", "%r8", "%r9" };
-  for (size_t i = 0; i < params.size(); ++i) {
-    if (varName == params[i].lexeme) {
-      valueRefs_.assign(expr, argRegs[i + hasImplicitThisArg]);
-      return;
-    }
+  // Structs are referred to by their address. Struct parameters are
+  // copied into the frame, and found there like locals.
+  if (auto const nlType = exprTypes_.get(expr); nlType && nlType->is_struct) {
+    auto const res = valueRefs_.makeAssignable(expr);
+    text_.instr({"leaq", namedVals->get(varName), res});
+    valueRefs_.assign(expr, res);
+    return;
   }
 
   valueRefs_.assign(expr, namedVals->get(varName));
-
 }
 void CodeGen::visit(const Assignment *expr) {
   emit(&expr->value);
+  if (auto const nlType = exprTypes_.get(expr); nlType->is_struct) {
+    auto const src = valueRefs_.get(&expr->value);
+    text_.instr({"leaq", namedVals->get(expr->name.lexeme()), "%rax"});
+    emitStructCopy(src, sizeOfValue(nlType));
+    valueRefs_.assign(expr, src);
+    return;
+  }
+  auto src = valueRefs_.get(&expr->value);
+  auto const dest = namedVals->get(expr->name.lexeme());
   // Move into reg because x86 doesn't support memory-to-memory `mov`s
-  auto const [srcReg, mustRestore] = valueRefs_.acquireRegister(&expr->value);
-  text_.instr({"mov", valueRefs_.get(&expr->value), srcReg});
-  auto const dest = namedVals->get(expr->name.lexeme);
-  text_.instr({"mov", srcReg, dest});
-  if (mustRestore) {
-    text_.instr({"pop", srcReg});
-  } else {
-    valueRefs_.regFree(srcReg);
+  if (src[0] != '%' && src[0] != '$' && dest[0] != '%') {
+    auto const srcReg = valueRefs_.makeAssignable(&expr->value);
+    text_.instr({"mov", src, srcReg});
+    src = srcReg;
   }
+  text_.instr({"movq", src, dest});
+  valueRefs_.regFree(src);
   valueRefs_.assign(expr, dest);
 }
 
 void CodeGen::visit(const Logical *expr) {
-  // TODO(neeilan): For short-circuiting, wait to emit right
-  emit(&expr->left);
-  emit(&expr->right);
+  static uint16_t id = 1;
+  auto const doneLabel = std::string("__logical_done_") + std::to_string(id++);
 
+  emit(&expr->left);
   auto const left = valueRefs_.get(&expr->left);
-  auto const right = valueRefs_.get(&expr->right);
   auto const dest = valueRefs_.makeAssignable(&expr->left);
+  if (left != dest) {
+    text_.instr({"mov", left, dest});
+  }
+  valueRefs_.regOverwrite(expr, dest);
 
-  auto logicalOpEmit = [&](auto const &opcode) {
-    text_.instr({opcode, right, dest});
-    valueRefs_.regOverwrite(expr, dest);
-    // Can resuse `right` as dest is the accumulator
-    valueRefs_.regFree(right);
-  };
-
-  switch (expr->op.type) {
-    case AND: {
-    logicalOpEmit("and");
-    return;
-    }
-    case OR: {
-    logicalOpEmit("or");
-    return;
-    }
-    default: {
-    return;
-    }
+  // The left operand is the result if it decides it; otherwise the right
+  // one is evaluated and is the result.
+  text_.instr({"test", dest, dest});
+  text_.instr({expr->op.type == TokenType::AND ? "je" : "jne", doneLabel});
+  emit(&expr->right);
+  auto const right = valueRefs_.get(&expr->right);
+  if (right != dest) {
+    text_.instr({"mov", right, dest});
   }
+  valueRefs_.regFree(right);
+  valueRefs_.regOverwrite(expr, dest);
+  text_.label({doneLabel});
 }
 
 void CodeGen::visit(const Call *expr) {
@@ -586,21 +1038,23 @@ void CodeGen::visit(const Call *expr) {
 
   // Constructors
   // ------------
-  auto const isInitializer = is_initializer(callee);
-  auto const isMethodCall = isInitializer || callee[0] == '%';
-  // If it's a constructor, we must first allocate the object.
+  // Initializers are called on the class, methods on an object.
+  auto const isMethodCall = expr->callee.is_object_field();
+  auto const isInitializer =
+      isMethodCall &&
+      exprTypes_.get(&static_cast<const Get &>(expr->callee).callee) ==
+          Primitives::Class();
+  // If it's a constructor, we must first allocate the object. It's passed
+  // as `this`, like the object a method is called on.
+  ValueRefTracker::ValueRef self;
   if (isInitializer) {
     auto const className = callee.substr(0, callee.find('_'));
-    auto const classType = sm_.current().typetab->get(className);
-    emitClassInit(classType);
-    // Preserve the allocated address (rax) and rdi
-    text_.instr({"push", "%rdi"});
-    // Pass `this` as first arg
-    text_.instr({"mov", "%rax", "%rdi"});
+    auto const classType =
+        sm_.types.get(Interner::intern(className));
+    emitClassInit(expr, classType);
+    self = stableRef("%rax");
   } else if (isMethodCall) {
-    // Pass `this` as first arg
-    text_.instr({"push", "%rdi"});
-    text_.instr({"mov", lastDereferencedObj_, "%rdi"});
+    self = stableRef(lastDereferencedObj_);
   }
 
   // Per System V ABI
@@ -608,76 +1062,114 @@ void CodeGen::visit(const Call *expr) {
   auto const numArgs = expr->args.size() + isMethodCall; // +1 for `this`
   assert(numArgs <= argRegs.size() && "Not enough registers to pass args");
 
-  // Align the stack if necessary
-  auto const stackLocals = stackFrames_.bases[enclosingFunc_];
-  // We push/pop %rdi for method-like calls
-  if (stackLocals.totalSize % (16 - 8*isMethodCall)) {
-    text_.instr({"push", "%rbx"});
+  // Every arg is evaluated before any is passed, so evaluating one (which
+  // may make calls of its own) can't overwrite another.
+  std::vector<ValueRefTracker::ValueRef> args;
+  if (isMethodCall) {
+    args.push_back(self);
+  }
+  for (const Expr *arg : expr->args) {
+    emit(arg);
+    args.push_back(stableRef(valueRefs_.get(arg)));
   }
+  auto const passArgs = [&]() {
+    for (size_t i = 0; i < numArgs; ++i) {
+      text_.instr({"mov", args[i], argRegs[i]});
+      valueRefs_.regFree(args[i]);
+    }
+  };
 
-  // Save scratch registers
-  uint16_t numPushed = 0;
-  for (size_t i = isMethodCall; i < numArgs; ++i) {
-    text_.instr({"push", argRegs[i]});
-    numPushed++;
+  // Nothing in this frame is needed after a tail call, and the callee
+  // returns straight to our caller. Initializers aren't tail-called: the
+  // object is returned after them. Nor are calls that pass or return
+  // structs, whose copies live in this frame.
+  auto const returnsStruct = exprTypes_.get(expr)->is_struct;
+  auto const passesStructs =
+      returnsStruct ||
+      std::any_of(expr->args.begin(), expr->args.end(), [&](const Expr *arg) {
+        return exprTypes_.get(arg)->is_struct;
+      });
+  if (expr == tailCall_ && !isInitializer && !passesStructs) {
+    passArgs();
+    emitTailCall(callee);
+    valueRefs_.regFree(callee);
+    tailCall_ = nullptr; // Tells the ReturnStmt it's done.
+    return;
   }
-  if (numPushed % 2 == 1) {
-    text_.instr({"push", "%rbx"});
+  // Align the stack if necessary
+  auto const stackLocals = stackFrames_.bases[enclosingFunc_];
+  if (stackLocals.totalSize % 16) {
+    text_.instr({"subq", "$8", "%rsp"});
   }
-
-  for (size_t i = 0; i < expr->args.size(); i++) {
-    const Expr *arg = expr->args[i];
-    emit(arg);
-    auto const rArg = valueRefs_.get(arg);
-    // If method call, first register is used for `this`
-    auto const targetReg = i + isMethodCall;
-    text_.instr({"mov", rArg, argRegs[targetReg]});
-    if (rArg != argRegs[targetReg]) {
-      valueRefs_.regFree(rArg);
+  passArgs();
+
+  // Values live across the call are in callee-saved registers, or in
+  // memory (see regalloc.h), so no others need preserving.
+  // A struct result is copied into a buffer in this frame, which it's
+  // then referred to by. Buffers are whole multiples of 16 bytes, so
+  // whether the frame is aligned doesn't change.
+  if (returnsStruct) {
+    auto &frame = stackFrames_.bases[enclosingFunc_];
+    if (!frame.bpOffsetOfObject(expr)) {
+      frame.addObject(expr, (sizeOfValue(exprTypes_.get(expr)) + 15) / 16 * 16);
     }
+    text_.instr({"leaq", frameObjectRef(expr), "%rax"});
   }
-
-  // Preserve GP regs
-  // TODO: No need if we could somehow tell that a function's transitive graph won't
-  // use a specific register.
-  std::vector<std::string> gpRegs{ "%r10", "%r11" , "%r12", "%r13"};
-  for (auto & r : gpRegs) {
-    text_.instr({"push", r});
-  }
-
   text_.instr({"call", (callee[0] == '%' ? "*" : "") + callee});
   valueRefs_.regFree(callee);
-  valueRefs_.assign(expr, "%rax");
-
-  for (auto it = gpRegs.rbegin(); it != gpRegs.rend(); ++it) {
-    text_.instr({"pop", *it});
-  }
-
-  // Restore scratch registers
-  if (numPushed % 2 == 1) {
-    text_.instr({"pop", "%rbx"});
+  if (stackLocals.totalSize % 16) {
+    text_.instr({"addq", "$8", "%rsp"});
   }
-  for (size_t i = isMethodCall; i < numArgs; ++i) {
-    text_.instr({"pop", argRegs[i]});
+  if (returnsStruct) {
+    auto const res = valueRefs_.makeAssignable(expr);
+    text_.instr({"leaq", frameObjectRef(expr), res});
+    valueRefs_.assign(expr, res);
+  } else {
+    valueRefs_.assign(expr, "%rax");
   }
+}
 
-  if (stackLocals.totalSize % (16 - 8*isMethodCall)) {
-    text_.instr({"pop", "%rbx"});
+// A value that's needed after more code is emitted. One in a machine
+// register, like a call's result in %rax, is moved to a virtual register
+// that code can't overwrite.
+ValueRefTracker::ValueRef CodeGen::stableRef(ValueRefTracker::ValueRef ref) {
+  if (ref[0] != '%' || ref[1] == 'v') {
+    return ref;
   }
+  auto const reg = valueRefs_.makeVirtual();
+  text_.instr({"movq", ref, reg});
+  return reg;
+}
 
-  if (isMethodCall) {
-    text_.instr({"pop", "%rdi"});
+// Calling ourselves just starts the body over, with the new arguments.
+// Anything else gets our caller's return address on top of the stack,
+// as if our caller had called it, and reuses our stack space.
+void CodeGen::emitTailCall(const std::string &callee) {
+  if (callee == enclosingFuncLabel_) {
+    text_.instr({"jmp", "__body_" + callee});
+    return;
   }
+  // A callee in a register is moved out of the ones restored with the
+  // frame; %rax carries no argument.
+  auto target = callee;
+  if (callee[0] == '%') {
+    text_.instr({"mov", callee, "%rax"});
+    target = "*%rax";
+  }
+  text_.instr({"mov", "%rbp", "%rsp"});
+  text_.instr({"popq", "%rbp"});
+  text_.instr({"jmp", target});
 }
+
 void CodeGen::visit(const Get *expr) {
-  auto fieldName = expr->name.lexeme;
-  auto calleeType = exprTypes_.find(&expr->callee);
-  assert(calleeType != exprTypes_.end() && "NL Type of callee unknown");
+  auto fieldName = expr->name.lexeme();
+  auto calleeType = exprTypes_.get(&expr->callee);
+  assert(calleeType && "NL Type of callee unknown");
 
   // Initializers / static fields
-  if (calleeType->second == Primitives::Class()) {
+  if (calleeType == Primitives::Class()) {
     const Variable *callee = static_cast<const Variable *>(&expr->callee);
-    const auto& className = callee->name.lexeme;
+    const auto& className = callee->name.lexeme();
     if (fieldName == "init") {
       valueRefs_.assign(expr, className + "_init");
     }
@@ -688,10 +1180,27 @@ void CodeGen::visit(const Get *expr) {
   emit(&expr->callee);
   lastDereferencedObj_ = valueRefs_.get(&expr->callee);
 
+  // Arrays only have a size, in the upper half of their first 8 bytes.
+  if (calleeType->is_array_type()) {
+    text_.instr({"movq", lastDereferencedObj_, "%rax"});
+    valueRefs_.regFree(lastDereferencedObj_);
+    auto res = valueRefs_.makeAssignable(expr);
+    text_.instr({"movslq", "4(%rax)", res});
+    valueRefs_.assign(expr, res);
+    return;
+  }
+
   // Methods
-  if (calleeType->second->has_method(fieldName)) {
+  if (calleeType->has_method(expr->name.id)) {
+    // Monomorphic calls (see class-hierarchy.h) skip the vtable.
+    if (auto const *impl = cha_.direct_target(expr)) {
+      valueRefs_.assign(expr, impl->name + "_" + fieldName);
+      valueRefs_.regFree(lastDereferencedObj_);
+      return;
+    }
+
     text_.instr({"# BEGIN method lookup: " + fieldName});  
-    auto [reg, mustRestore] = valueRefs_.acquireRegister(expr);
+    auto const reg = valueRefs_.makeAssignable(expr);
     text_.instr({"mov", lastDereferencedObj_, reg});
 
     // reg holds address of the callee
@@ -699,43 +1208,37 @@ void CodeGen::visit(const Get *expr) {
     text_.instr({"mov", "(" + reg + ")", reg});
     // now reg holds address of the vtable
     // therefore reg[i] holds address of method i for this class
-    auto idx = calleeType->second->method_idx(fieldName);
+    auto idx = calleeType->method_idx(expr->name.id);
     if (auto offset = idx * 8) {
       text_.instr({"add", std::string("$") + std::to_string(offset), reg});
     }
     // Set reg to the address of the method
     text_.instr({"mov", "(" + reg + ")", reg});
     valueRefs_.assign(expr, reg);
-    if (mustRestore) {
-      text_.instr({"pop", reg});
-    }
     text_.instr({"# END method lookup: " + fieldName});
     valueRefs_.regFree(lastDereferencedObj_);
     return;
   }
 
-  // Plain fields
-  auto idx = calleeType->second->field_idx(fieldName);
-  // Value is idx * 8 byte offset into the address of the last deref object
+  // Plain fields (of objects or structs)
+  auto idx = calleeType->field_idx(expr->name.id);
   valueRefs_.assign(&expr->callee, lastDereferencedObj_);
   text_.instr({"movq", lastDereferencedObj_, "%rax"});
 
-  // constexpr uint64_t fieldSize = 8;
-  for (int i = 0; i <= idx; i++) {
-    text_.instr({"add", "$8", "%rax"});
-  }
-
-  auto const fieldAccess = "(%rax)";
+  auto const fieldAccess =
+      std::to_string(fieldOffset(calleeType, idx)) + "(%rax)";
   valueRefs_.regFree(lastDereferencedObj_);
   auto res = valueRefs_.makeAssignable(expr);
-  text_.instr({"movq",  fieldAccess, res});
+  // A struct field is referred to by its address.
+  text_.instr({exprTypes_.get(expr)->is_struct ? "leaq" : "movq", fieldAccess,
+               res});
   valueRefs_.assign(expr, res);
 }
 
 void CodeGen::visit(const Set *expr) {
-  auto fieldName = expr->name.lexeme;
-  auto calleeType = exprTypes_.find(&expr->callee);
-  assert(calleeType != exprTypes_.end() && "NL Type of callee unknown");
+  auto fieldName = expr->name.lexeme();
+  auto calleeType = exprTypes_.get(&expr->callee);
+  assert(calleeType && "NL Type of callee unknown");
 
   // Emit the callee
   emit(&expr->callee);
@@ -745,29 +1248,52 @@ void CodeGen::visit(const Set *expr) {
   emit(&expr->value);
   auto valueRef = valueRefs_.get(&expr->value);
 
-  auto idx = calleeType->second->field_idx(fieldName);
-  // Value is idx * 8 byte offset into the address of the last deref object
+  auto idx = calleeType->field_idx(expr->name.id);
   text_.instr({"movq", calleeRef, "%rax"});
-  for (int i = 0; i <= idx; i++) {
-    text_.instr({"add", "$8", "%rax"});
+  auto const fieldAccess =
+      std::to_string(fieldOffset(calleeType, idx)) + "(%rax)";
+
+  if (auto const valueType = exprTypes_.get(&expr->value);
+      valueType->is_struct) {
+    text_.instr({"leaq", fieldAccess, "%rax"});
+    emitStructCopy(valueRef, sizeOfValue(valueType));
+    valueRefs_.regFree(calleeRef);
+    valueRefs_.regFree(valueRef);
+    return;
   }
-  auto const fieldAccess = "(%rax)";
 
-  bool mustRestoreVal = false;
   if (valueRef[0] != '%' && valueRef[0] != '$') {
-    auto [valReg, mustRestore] = valueRefs_.acquireRegister(&expr->value);
+    auto const valReg = valueRefs_.makeAssignable(&expr->value);
     text_.instr({"mov", valueRef, valReg});
-    valueRef = valReg; mustRestoreVal = mustRestore;
+    valueRef = valReg;
   }
 
   text_.instr({"movq", valueRef, fieldAccess});
-  if (mustRestoreVal) { text_.instr({"pop", valueRef}); }
 
   valueRefs_.regFree(calleeRef);
   valueRefs_.regFree(valueRef);
 }
 
 void CodeGen::visit(const GetIndex * expr) {
+  std::vector<const Expr *> indices;
+  auto const *array = Arrays::element_access(expr->callee, expr->index, indices);
+  // Struct elements are stored inline, and referred to by their address.
+  auto const elemType = exprTypes_.get(expr);
+  auto const elemSize = sizeOfValue(elemType);
+  auto const load = elemType->is_struct ? "leaq" : "movq";
+  if (indices.size() > 1) {
+    emit(array);
+    for (auto const *index : indices) {
+      emit(index);
+    }
+    auto const elem =
+        emitElementRef(expr, array, indices, elemSize, expr->bracket.line);
+    auto res = valueRefs_.makeAssignable(expr);
+    text_.instr({load, elem, res});
+    valueRefs_.assign(expr, res);
+    return;
+  }
+
   emit(&expr->callee);
   emit(&expr->index);
 
@@ -776,19 +1302,51 @@ void CodeGen::visit(const GetIndex * expr) {
   text_.instr({"mov", valueRefs_.get(&expr->callee), arr});
   auto const index = valueRefs_.makeAssignable(&expr->index);
   text_.instr({"mov", valueRefs_.get(&expr->index), index});
+  if (!bounds_.in_bounds(expr)) {
+    emitBoundsCheck(arr, 4, index, expr->bracket.line);
+  }
 
-  auto const elem = std::string("8(") + arr + ", " + index + ", 8)";
+  auto const elem = elementRef(arr, index, elemSize);
   valueRefs_.regFree(arr);
 
   valueRefs_.regFree(index);
   auto res = valueRefs_.makeAssignable(expr);
   valueRefs_.regFree(arr);
 
-  text_.instr({"movq",  elem, res});
+  text_.instr({load,  elem, res});
   valueRefs_.assign(expr, res);
 }
 
 void CodeGen::visit(const SetIndex *expr) {
+  std::vector<const Expr *> indices;
+  auto const *array = Arrays::element_access(expr->callee, expr->index, indices);
+  auto const elemType = exprTypes_.get(expr);
+  auto const elemSize = sizeOfValue(elemType);
+  if (indices.size() > 1) {
+    emit(array);
+    for (auto const *index : indices) {
+      emit(index);
+    }
+    emit(&expr->value);
+    auto const elem =
+        emitElementRef(expr, array, indices, elemSize, expr->bracket.line);
+    auto value = valueRefs_.get(&expr->value);
+    if (elemType->is_struct) {
+      text_.instr({"leaq", elem, "%rax"});
+      emitStructCopy(value, elemSize);
+      valueRefs_.assign(expr, value);
+      return;
+    }
+    if (value[0] != '%' && value[0] != '$') {
+      // No memory-to-memory moves.
+      text_.instr({"movq", value, "%r15"});
+      value = "%r15";
+    }
+    text_.instr({"movq", value, elem});
+    valueRefs_.assign(expr, elem);
+    return;
+  }
+
   emit(&expr->callee);
   emit(&expr->index);
   emit(&expr->value);
@@ -798,20 +1356,30 @@ void CodeGen::visit(const SetIndex *expr) {
   text_.instr({"mov", valueRefs_.get(&expr->callee), arr});
   auto const index = valueRefs_.makeAssignable(&expr->index);
   text_.instr({"mov", valueRefs_.get(&expr->index), index});
+  if (!bounds_.in_bounds(expr)) {
+    emitBoundsCheck(arr, 4, index, expr->bracket.line);
+  }
 
-  auto const elem = std::string("8(") + arr + ", " + index + ", 8)";
+  auto const elem = elementRef(arr, index, elemSize);
+  if (elemType->is_struct) {
+    text_.instr({"leaq", elem, "%rax"});
+    emitStructCopy(valueRefs_.get(&expr->value), elemSize);
+    valueRefs_.assign(expr, valueRefs_.get(&expr->value));
+    return;
+  }
   text_.instr({"movq", valueRefs_.get(&expr->value) , elem});
   valueRefs_.assign(expr, elem);
 }
 
 void CodeGen::visit(const This *expr) {
-  // For a method call, `this` is the first argument passed in %rdi
-  valueRefs_.assign(expr, "%rdi");
+  // Passed in %rdi, and moved to thisRef_ on entry (see visit(FuncStmt)).
+  valueRefs_.assign(expr, thisRef_);
 }
 
 void CodeGen::visit(const SentinelExpr *) {}
 
 void CodeGen::dump() const {
+  PassTimer timer("Assembly output");
   std::stringstream ss;
   auto dumpLine = [&](auto const &asmLine) {
     auto const &line = asmLine.values;
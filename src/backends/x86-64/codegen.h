@@ -2,16 +2,23 @@
 #define _NL_BACKENDS_X86_64_CODEGEN_H_
 
 #include <iostream>
+#include <map>
 #include <ostream>
 #include <sstream>
 #include <string>
 #include <unordered_map>
 #include <unordered_set>
 
+#include "array-bounds.h"
 #include "ast-printer.h"
+#include "cactus-table.h"
+#include "class-hierarchy.h"
+#include "constant-folding.h"
+#include "escape-analysis.h"
 #include "expr-types.h"
 #include "scope-manager.h"
 #include "backends/abstract-codegen.h"
+#include "regalloc.h"
 #include "stackframe.h"
 #include "visitor.h"
 
@@ -26,8 +33,10 @@ namespace x86_64 {
 // Question: Should we get rid of immediate here, and make
 // it an optimization pass?
 
-// A naive implementation of register allocation which falls
-// back to storing values on the stack.
+// Hands out virtual registers (%v0, %v1, ...), as many as are needed, for
+// the values instruction selection computes and for locals. Once a
+// function's code is complete, RegisterAllocator maps them to machine
+// registers or stack slots (see regalloc.h).
 class ValueRefTracker {
 public:
   using ValueRef = std::string;
@@ -38,30 +47,27 @@ public:
   ValueRef makeAssignable(const Expr* expr) {
     // Is it already assignable?
     auto it = exprToRegister_.find(expr);
-    if (it != exprToRegister_.end() && it->second != "%rax") {
+    if (it != exprToRegister_.end()) {
       return it->second;
     }
-    if (!unusedGpRegs_.empty()) {
-      auto const it = unusedGpRegs_.begin();
-      auto const reg = *it;
-      exprToRegister_[expr] = reg;
-      registerToExpr_[reg] = expr;
-      unusedGpRegs_.erase(it);
-      return reg;
-    }
-
-    AstPrinter ap;
-    std::cerr << "[makeAssignable] No GP register to assign for expr [" << ap.print(expr) << "]\n"
-      << "  Current assignments:\n";
-    for (auto it = registerToExpr_.begin(); it != registerToExpr_.end(); ++it) {
-      std::cerr << "   > " << it->first << " : [" << ap.print(it->second) << "]\n";
-    }
-    exit(1);
+    auto const reg = makeVirtual();
+    exprToRegister_[expr] = reg;
+    registerToExpr_[reg] = expr;
+    return reg;
   }
 
-  void overwrite(const Expr* expr, const ValueRef& v) {
-    if (v[0] == '%') { regOverwrite(expr, v); return; }
-    exprToRef_[expr] = v;
+  // A register of its own, e.g. for a local. No expression holds it, so
+  // it's never overwritten by one.
+  Register makeVirtual() { return "%v" + std::to_string(nextVirtual_++); }
+
+  // Gives expr the value of from, and its register if from holds one.
+  void overwrite(const Expr *expr, const Expr *from) {
+    auto it = exprToRegister_.find(from);
+    if (it != exprToRegister_.end()) {
+      regOverwrite(expr, it->second);
+    } else {
+      exprToRef_[expr] = get(from);
+    }
   }
 
   void regOverwrite(const Expr *expr, const Register &reg) {
@@ -84,35 +90,8 @@ public:
     return it->second;
   }
 
-  std::pair<std::string, bool> acquireRegister(const Expr* expr) {
-    // TODO: returns register. and whether it need to be restored from stack. Needed because we can't to stuff like memory-to-memory `mov`s
-    // Is it already assignable?
-    auto it = exprToRegister_.find(expr);
-    if (it != exprToRegister_.end()) {
-      return {it->second, false};
-    }
-    if (!unusedGpRegs_.empty()) {
-      auto const it = unusedGpRegs_.begin();
-      auto const reg = *it;
-      exprToRegister_[expr] = reg;
-      registerToExpr_[reg] = expr;
-      unusedGpRegs_.erase(it);
-      return {reg, false};
-    }
-
-    AstPrinter ap;
-    std::cerr << "[acquireRegister] No GP register to assign for expr [" << ap.print(expr) << "]\n"
-      << "  Current assignments:\n";
-    for (auto it = registerToExpr_.begin(); it != registerToExpr_.end(); ++it) {
-      std::cerr << "   > " << it->first << " : [" << ap.print(it->second) << "]\n";
-    }
-    exit(1);
-  }
-
-  // Ensure no expressions use the register,
-  // spilling them to memory if necessary.
-  // void regObtain(const Register&);
-
+  // Virtual registers are never handed out twice, so freeing one only
+  // forgets the expression that held it.
   void regFree(const Register& reg) {
     auto it = registerToExpr_.find(reg);
     if (it == registerToExpr_.end()) { return; }
@@ -120,20 +99,16 @@ public:
     registerToExpr_.erase(it);
     exprToRef_.erase(expr);
     exprToRegister_.erase(expr);
-    unusedGpRegs_.insert(reg);
   }
 
   void resetRegisters() {
-    for (auto const & [reg, _] : registerToExpr_) {
-      unusedGpRegs_.insert(reg);
-    }
-    for (auto const & reg : unusedGpRegs_) {
-      regFree(reg);
-    }
+    exprToRef_.clear();
+    exprToRegister_.clear();
+    registerToExpr_.clear();
   }
 
 private:
-  std::unordered_set<Register> unusedGpRegs_ { "%r10", "%r11" , "%r12", "%r13"};
+  uint32_t nextVirtual_ = 0;
   std::unordered_map<const Expr*, std::string> exprToRef_;
   std::unordered_map<const Expr*, Register> exprToRegister_;
   std::unordered_map<Register, const Expr*> registerToExpr_;
@@ -167,7 +142,11 @@ class CodeGen : public AbstractCodegen,
                 public ExprVisitor<>,
                 public StmtVisitor<> {
 public:
-  CodeGen(const ExprTypes &exprTypes, ScopeManager &sm) : exprTypes_(exprTypes), sm_(sm)
+  CodeGen(const ExprTypes &exprTypes, ScopeManager &sm,
+          const ConstantFolding &consts, const ClassHierarchy &cha,
+          const ArrayBounds &bounds, const EscapeAnalysis &escapes)
+  : exprTypes_(exprTypes), sm_(sm), consts_(consts), cha_(cha), bounds_(bounds)
+  , escapes_(escapes)
   , stackFrames_(StackFrameSizer(sm))
   {}
   virtual void generate(const std::vector<Stmt *> &program) override;
@@ -186,20 +165,51 @@ private:
 
 
 
-  ValueRefTracker::ValueRef emitArrayInit(NLType nlType, const std::vector<const Expr *>& dims);
-  ValueRefTracker::ValueRef emitClassInit(NLType nlType);
+  void emitTailCall(const std::string &callee);
+  ValueRefTracker::ValueRef stableRef(ValueRefTracker::ValueRef ref);
+  ValueRefTracker::ValueRef floatLiteral(const std::string &directive);
+  void emitJump(const Expr *cond, bool when, const std::string &label);
+  void emitJumpUnless(const Expr *cond, const std::string &label);
+  ValueRefTracker::ValueRef emitArrayInit(const VarStmt *decl, NLType nlType);
+  ValueRefTracker::ValueRef emitClassInit(const Call *init, NLType nlType);
+  void emitStructInit(const VarStmt *decl, NLType nlType);
+  uint32_t stackArrayElems(const VarStmt *decl);
+  void emitStackAlloc(const void *site, uint32_t size);
+  ValueRefTracker::ValueRef frameObjectRef(const void *site);
+  void emitClear(uint32_t size);
+  void emitStructCopy(ValueRefTracker::ValueRef src, uint32_t size);
+  void emitAlloc(const std::string &typeInfo, ValueRefTracker::ValueRef countRef,
+                 bool isArray, uint32_t size, uint32_t elemSize = 8);
+  void emitBoundsCheck(ValueRefTracker::ValueRef arr, uint32_t boundOffset,
+                       ValueRefTracker::ValueRef index, int line);
+  ValueRefTracker::ValueRef emitElementRef(const Expr *access,
+                                           const Expr *array,
+                                           const std::vector<const Expr *> &indices,
+                                           uint32_t elemSize, int line);
+  ValueRefTracker::ValueRef elementRef(ValueRefTracker::Register arr,
+                                       ValueRefTracker::Register index,
+                                       uint32_t elemSize);
 
   ValueRefTracker valueRefs_;
 
   const ExprTypes &exprTypes_;
   ScopeManager &sm_;
+  const ConstantFolding &consts_;
+  const ClassHierarchy &cha_;
+  const ArrayBounds &bounds_;
+  const EscapeAnalysis &escapes_;
   std::unordered_set<std::string> funcLabels_;
   std::vector<ClassStmt const*> classes_;
+  // Type descriptors of the arrays allocated: header and element sizes.
+  std::map<std::string, std::pair<uint32_t, uint32_t>> arrayTypeInfos_;
 
   StackFrameSizer stackFrames_;
   const FuncStmt * enclosingFunc_ = nullptr;
+  std::string enclosingFuncLabel_;
+  const Call *tailCall_ = nullptr; // Returned by the return being emitted.
   NLType enclosingClass_ = nullptr;
   ValueRefTracker::ValueRef lastDereferencedObj_;
+  ValueRefTracker::Register thisRef_; // Where methods keep `this`.
 
 
   Section rodata_;
@@ -0,0 +1,456 @@
+#include "backends/x86-64/regalloc.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cctype>
+#include <climits>
+#include <cstdlib>
+#include <unordered_set>
+
+#include "backends/x86-64/codegen.h"
+
+namespace x86_64 {
+
+namespace {
+
+struct MachineReg {
+  const char *q, *d, *b;  // 64, low 32 and low 8 bits.
+  bool calleeSaved;
+};
+
+// The registers instruction selection never names itself: the rest carry
+// arguments, results and scratch values. The caller-saved ones come first,
+// so values that aren't live across a call don't cost a save.
+const MachineReg REGS[] = {
+    {"%r10", "%r10d", "%r10b", false}, {"%r11", "%r11d", "%r11b", false},
+    {"%rbx", "%ebx", "%bl", true},     {"%r12", "%r12d", "%r12b", true},
+    {"%r13", "%r13d", "%r13b", true},  {"%r14", "%r14d", "%r14b", true},
+};
+const int NUM_REGS = sizeof(REGS) / sizeof(REGS[0]);
+
+// Instruction selection uses %r15 as scratch, so it's saved like the
+// registers handed out when a function mentions it.
+const char *SCRATCH_REG = "%r15";
+
+const char *nameOf(int reg, char width) {
+  return width == 'd' ? REGS[reg].d : width == 'b' ? REGS[reg].b : REGS[reg].q;
+}
+
+// A virtual register in an operand: %v<n>, or %v<n>d or %v<n>b for its low
+// 32 or 8 bits.
+struct Mention {
+  size_t pos, len;
+  uint32_t vreg;
+  char width;
+};
+
+std::vector<Mention> mentions(const std::string &operand) {
+  std::vector<Mention> found;
+  for (auto i = operand.find("%v"); i != std::string::npos;
+       i = operand.find("%v", i + 1)) {
+    auto j = i + 2;
+    uint32_t vreg = 0;
+    while (j < operand.size() && std::isdigit(operand[j])) {
+      vreg = vreg * 10 + (operand[j++] - '0');
+    }
+    if (j == i + 2) {
+      continue;
+    }
+    auto width = 'q';
+    if (j < operand.size() && (operand[j] == 'd' || operand[j] == 'b')) {
+      width = operand[j++];
+    }
+    found.push_back({i, j - i, vreg, width});
+  }
+  return found;
+}
+
+bool isInstruction(const AsmLine &line) {
+  return line.kind == AsmLine::Kind::Instruction && line.values[0][0] != '#';
+}
+
+bool usesRegister(const AsmLine &line, int reg) {
+  for (size_t i = 1; i < line.values.size(); ++i) {
+    for (auto const *name : {REGS[reg].q, REGS[reg].d, REGS[reg].b}) {
+      if (line.values[i].find(name) != std::string::npos) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+bool isImm32(const std::string &operand) {
+  if (operand[0] != '$') {
+    return false;
+  }
+  char *end;
+  auto const value = std::strtoll(operand.c_str() + 1, &end, 10);
+  return *end == '\0' && value >= INT_MIN && value <= INT_MAX;
+}
+
+AsmLine instr(std::vector<std::string> &&values) {
+  return {AsmLine::Kind::Instruction, std::move(values)};
+}
+
+}  // namespace
+
+void RegisterAllocator::run(size_t begin) {
+  buildIntervals(begin);
+  extendOverLoops();
+  linearScan();
+
+  for (int reg = 0; reg < NUM_REGS; ++reg) {
+    auto const used = std::any_of(
+        intervals_.begin(), intervals_.end(),
+        [&](const Interval &interval) { return interval.reg == reg; });
+    if (used && REGS[reg].calleeSaved) {
+      saved_.push_back(REGS[reg].q);
+    }
+  }
+  for (auto i = begin; i < code_.size(); ++i) {
+    auto const &values = code_[i].values;
+    if (isInstruction(code_[i]) &&
+        std::any_of(values.begin() + 1, values.end(), [](auto const &v) {
+          return v.find(SCRATCH_REG) != std::string::npos;
+        })) {
+      saved_.push_back(SCRATCH_REG);
+      break;
+    }
+  }
+  if (intervals_.empty() && saved_.empty()) {
+    return;
+  }
+
+  auto const numSlots = spillSlots_.size() + saved_.size();
+  if (numSlots) {
+    firstSlot_ = frame_.addSlots(numSlots);
+  }
+
+  // Callee-saved registers are saved once the frame is set up, and
+  // restored before every return or tail call tears it down.
+  std::vector<AsmLine> out;
+  auto prologueSeen = false;
+  for (auto i = begin; i < code_.size(); ++i) {
+    auto const &values = code_[i].values;
+    auto const isEpilogue = isInstruction(code_[i]) && values.size() == 3 &&
+                            values[0] == "mov" && values[1] == "%rbp" &&
+                            values[2] == "%rsp";
+    if (isEpilogue) {
+      for (size_t s = 0; s < saved_.size(); ++s) {
+        out.push_back(instr({"movq", slot(spillSlots_.size() + s), saved_[s]}));
+      }
+    }
+    rewrite(code_[i], out);
+
+    auto const isPrologue = !prologueSeen && isInstruction(code_[i]) &&
+                            values.size() == 3 && values[0] == "subq" &&
+                            values[2] == "%rsp";
+    if (isPrologue) {
+      prologueSeen = true;
+      for (size_t s = 0; s < saved_.size(); ++s) {
+        out.push_back(instr({"movq", saved_[s], slot(spillSlots_.size() + s)}));
+      }
+    }
+  }
+  code_.erase(code_.begin() + begin, code_.end());
+  code_.insert(code_.end(), out.begin(), out.end());
+}
+
+void RegisterAllocator::buildIntervals(size_t begin) {
+  for (auto i = begin; i < code_.size(); ++i) {
+    auto const &line = code_[i];
+    if (line.isLabel()) {
+      labels_[line.values[0]] = i;
+      continue;
+    }
+    if (!isInstruction(line)) {
+      continue;
+    }
+    auto const &op = line.values[0];
+    if (op == "call") {
+      calls_.push_back(i);
+    } else if (op[0] == 'j' && line.values.size() == 2) {
+      jumps_.push_back({i, line.values[1]});
+    }
+    for (size_t k = 1; k < line.values.size(); ++k) {
+      for (auto const &m : mentions(line.values[k])) {
+        auto const [it, isNew] = intervalOf_.try_emplace(m.vreg, intervals_.size());
+        if (isNew) {
+          intervals_.push_back({m.vreg, i, i});
+        }
+        intervals_[it->second].end = i;
+      }
+    }
+  }
+}
+
+// A value live into a loop is needed on every iteration, so it stays live
+// until the jump back to the loop's start. Extending one loop's values can
+// make them live into an enclosing loop, so this repeats until nothing
+// changes.
+void RegisterAllocator::extendOverLoops() {
+  for (auto changed = true; changed;) {
+    changed = false;
+    for (auto const &[at, target] : jumps_) {
+      auto const label = labels_.find(target);
+      if (label == labels_.end() || label->second > at) {
+        continue;
+      }
+      auto const loopStart = label->second;
+      for (auto &interval : intervals_) {
+        if (interval.start < loopStart && interval.end >= loopStart &&
+            interval.end < at) {
+          interval.end = at;
+          changed = true;
+        }
+      }
+    }
+  }
+
+  for (auto &interval : intervals_) {
+    auto const call =
+        std::lower_bound(calls_.begin(), calls_.end(), interval.start);
+    interval.crossesCall = call != calls_.end() && *call < interval.end;
+  }
+}
+
+void RegisterAllocator::linearScan() {
+  std::sort(intervals_.begin(), intervals_.end(),
+            [](const Interval &a, const Interval &b) {
+              return a.start < b.start;
+            });
+  for (size_t i = 0; i < intervals_.size(); ++i) {
+    intervalOf_[intervals_[i].vreg] = i;
+  }
+
+  auto const spill = [&](Interval &interval) {
+    interval.reg = -1;
+    spillSlots_.emplace(interval.vreg, spillSlots_.size());
+  };
+
+  bool isFree[NUM_REGS];
+  std::fill(isFree, isFree + NUM_REGS, true);
+  std::vector<size_t> active;
+  for (size_t i = 0; i < intervals_.size(); ++i) {
+    auto &current = intervals_[i];
+    // Intervals that ended before this one starts give back their registers.
+    active.erase(std::remove_if(active.begin(), active.end(),
+                                [&](size_t a) {
+                                  if (intervals_[a].end >= current.start) {
+                                    return false;
+                                  }
+                                  isFree[intervals_[a].reg] = true;
+                                  return true;
+                                }),
+                 active.end());
+
+    auto const fits = [&](int reg) {
+      return !current.crossesCall || REGS[reg].calleeSaved;
+    };
+    for (int reg = 0; reg < NUM_REGS; ++reg) {
+      if (isFree[reg] && fits(reg)) {
+        current.reg = reg;
+        isFree[reg] = false;
+        break;
+      }
+    }
+    if (current.reg >= 0) {
+      active.push_back(i);
+      continue;
+    }
+
+    // Out of registers: whichever of this and the active intervals ends
+    // last goes to memory.
+    auto victim = active.end();
+    for (auto a = active.begin(); a != active.end(); ++a) {
+      if (fits(intervals_[*a].reg) &&
+          (victim == active.end() ||
+           intervals_[*a].end > intervals_[*victim].end)) {
+        victim = a;
+      }
+    }
+    if (victim != active.end() && intervals_[*victim].end > current.end) {
+      current.reg = intervals_[*victim].reg;
+      spill(intervals_[*victim]);
+      *victim = i;
+    } else {
+      spill(current);
+    }
+  }
+}
+
+std::string RegisterAllocator::slot(size_t idx) const {
+  return "-" + std::to_string(firstSlot_ + 8 * idx) + "(%rbp)";
+}
+
+// Replaces the virtual registers in operand that have a register, or one
+// borrowed for this instruction. Spilled ones are left as they are.
+std::string RegisterAllocator::rename(
+    const std::string &operand,
+    const std::unordered_map<uint32_t, int> &borrowed) const {
+  auto renamed = operand;
+  auto const found = mentions(operand);
+  for (auto m = found.rbegin(); m != found.rend(); ++m) {
+    auto reg = intervals_[intervalOf_.at(m->vreg)].reg;
+    if (auto const b = borrowed.find(m->vreg); b != borrowed.end()) {
+      reg = b->second;
+    }
+    if (reg >= 0) {
+      renamed.replace(m->pos, m->len, nameOf(reg, m->width));
+    }
+  }
+  return renamed;
+}
+
+// A spilled value is used straight from its slot when that's the
+// instruction's only memory operand, and the operand size is implied by a
+// register operand or by a suffix we can add.
+bool RegisterAllocator::useSlot(AsmLine &line) const {
+  static const std::unordered_set<std::string> eitherOperand = {
+      "mov", "movq", "add", "addq", "sub",  "subq", "cmp",
+      "cmpq", "test", "testq", "xor", "xorq", "and", "andq"};
+  static const std::unordered_set<std::string> sourceOnly = {"imul", "imulq"};
+
+  auto &values = line.values;
+  size_t k = 0;
+  uint32_t vreg = 0;
+  for (size_t i = 1; i < values.size(); ++i) {
+    for (auto const &m : mentions(values[i])) {
+      if (k) {
+        return false;  // More than one spilled value.
+      }
+      k = i;
+      vreg = m.vreg;
+    }
+  }
+  auto const plain = "%v" + std::to_string(vreg);
+  auto const mem = slot(spillSlots_.at(vreg));
+  auto op = values[0];
+
+  if (values.size() == 2) {
+    if (values[1] == "*" + plain && (op == "call" || op == "jmp")) {
+      values[1] = "*" + mem;
+      return true;
+    }
+    if (values[1] == plain &&
+        (op == "push" || op == "pop" || op == "neg" || op == "pushq" ||
+         op == "popq")) {
+      values[0] = op.back() == 'q' ? op : op + "q";
+      values[1] = mem;
+      return true;
+    }
+    return false;
+  }
+  if (values.size() != 3 || values[k] != plain) {
+    return false;
+  }
+  auto const &other = values[3 - k];
+  auto const otherIsReg = other[0] == '%' && other.find('(') == std::string::npos;
+  if (otherIsReg &&
+      (eitherOperand.count(op) || (sourceOnly.count(op) && k == 1))) {
+    values[k] = mem;
+    return true;
+  }
+  if (k == 2 && isImm32(other) && eitherOperand.count(op)) {
+    values[0] = op.back() == 'q' ? op : op + "q";
+    values[k] = mem;
+    return true;
+  }
+  return false;
+}
+
+// Rewrites an instruction in terms of machine registers. Spilled values
+// the instruction can't use from memory are loaded into registers it
+// doesn't use, which are saved around it, and stored back after.
+void RegisterAllocator::rewrite(const AsmLine &line,
+                                std::vector<AsmLine> &out) const {
+  if (!isInstruction(line)) {
+    out.push_back(line);
+    return;
+  }
+  auto renamed = line;
+  for (size_t i = 1; i < line.values.size(); ++i) {
+    renamed.values[i] = rename(line.values[i], {});
+  }
+
+  std::vector<uint32_t> spilled;
+  for (size_t i = 1; i < renamed.values.size(); ++i) {
+    for (auto const &m : mentions(renamed.values[i])) {
+      if (std::find(spilled.begin(), spilled.end(), m.vreg) == spilled.end()) {
+        spilled.push_back(m.vreg);
+      }
+    }
+  }
+  if (spilled.empty() || useSlot(renamed)) {
+    out.push_back(std::move(renamed));
+    return;
+  }
+
+  std::unordered_map<uint32_t, int> borrowed;
+  auto const borrow = [&](uint32_t vreg) {
+    for (int reg = 0; reg < NUM_REGS; ++reg) {
+      auto const taken =
+          usesRegister(renamed, reg) ||
+          std::any_of(borrowed.begin(), borrowed.end(),
+                      [&](auto const &b) { return b.second == reg; });
+      if (!taken) {
+        borrowed[vreg] = reg;
+        return;
+      }
+    }
+    assert(false && "No register to load a spilled value into");
+  };
+  auto const load = [&]() {
+    auto loaded = line;
+    for (size_t i = 1; i < line.values.size(); ++i) {
+      loaded.values[i] = rename(line.values[i], borrowed);
+    }
+    return loaded;
+  };
+
+  // One of several spilled values may still be usable from its slot.
+  for (size_t i = 0; i + 1 < spilled.size(); ++i) {
+    borrow(spilled[i]);
+  }
+  auto loaded = load();
+  if (spilled.size() == 1 || !useSlot(loaded)) {
+    borrow(spilled.back());
+    loaded = load();
+  }
+
+  // Only values the instruction writes are stored back: those in its last
+  // operand, unless it only compares or pushes them.
+  static const std::unordered_set<std::string> readOnly = {
+      "cmp", "cmpq", "test", "testq", "push", "pushq", "call", "jmp"};
+  auto const &last = line.values.back();
+  auto const writes = [&](uint32_t vreg) {
+    if (readOnly.count(line.values[0]) || line.values.size() < 2 ||
+        last.find('(') != std::string::npos) {
+      return false;
+    }
+    auto const found = mentions(last);
+    return std::any_of(found.begin(), found.end(),
+                       [&](const Mention &m) { return m.vreg == vreg; });
+  };
+
+  std::vector<uint32_t> order;
+  for (auto const vreg : spilled) {
+    if (borrowed.count(vreg)) {
+      order.push_back(vreg);
+      out.push_back(instr({"push", REGS[borrowed[vreg]].q}));
+      out.push_back(
+          instr({"movq", slot(spillSlots_.at(vreg)), REGS[borrowed[vreg]].q}));
+    }
+  }
+  out.push_back(std::move(loaded));
+  for (auto v = order.rbegin(); v != order.rend(); ++v) {
+    if (writes(*v)) {
+      out.push_back(
+          instr({"movq", REGS[borrowed[*v]].q, slot(spillSlots_.at(*v))}));
+    }
+    out.push_back(instr({"pop", REGS[borrowed[*v]].q}));
+  }
+}
+
+}  // namespace x86_64
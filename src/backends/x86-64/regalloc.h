@@ -0,0 +1,67 @@
+#ifndef _NL_BACKENDS_X86_64_REGALLOC_H_
+#define _NL_BACKENDS_X86_64_REGALLOC_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "stackframe.h"
+
+namespace x86_64 {
+
+struct AsmLine;
+
+// Linear-scan register allocation (Poletto and Sarkar). Instruction
+// selection gives each value it computes, and each local, a virtual
+// register of its own (%v0, %v1, ...); once a function's code is complete,
+// they're mapped to the registers instruction selection never names.
+//
+// A virtual register is live from its first mention in the function's
+// instructions to its last, and through to the end of any loop it's live
+// into. Those live across a call get callee-saved registers, which the
+// function saves in its frame. When registers run out, the value whose
+// interval ends last goes to a stack slot below the frame's objects.
+class RegisterAllocator {
+ public:
+  RegisterAllocator(std::vector<AsmLine> &code, FrameBase &frame)
+      : code_(code), frame_(frame) {}
+
+  // Allocates registers for the function whose code starts at begin and
+  // runs to the end of code, and adds the saves and restores it needs.
+  void run(size_t begin);
+
+ private:
+  struct Interval {
+    uint32_t vreg;
+    size_t start, end;
+    bool crossesCall = false;
+    int reg = -1;  // Index into the allocatable registers, or -1 if spilled.
+  };
+
+  void buildIntervals(size_t begin);
+  void extendOverLoops();
+  void linearScan();
+  std::string slot(size_t idx) const;
+  std::string rename(const std::string &operand,
+                     const std::unordered_map<uint32_t, int> &borrowed) const;
+  bool useSlot(AsmLine &line) const;
+  void rewrite(const AsmLine &line, std::vector<AsmLine> &out) const;
+
+  std::vector<AsmLine> &code_;
+  FrameBase &frame_;
+
+  std::vector<Interval> intervals_;
+  std::unordered_map<uint32_t, size_t> intervalOf_;
+  std::unordered_map<std::string, size_t> labels_;
+  std::vector<size_t> calls_;
+  std::vector<std::pair<size_t, std::string>> jumps_;
+  std::unordered_map<uint32_t, size_t> spillSlots_;
+  std::vector<std::string> saved_;  // Callee-saved registers to restore.
+  uint16_t firstSlot_ = 0;          // Offset from %rbp of the first slot.
+};
+
+}  // namespace x86_64
+
+#endif  // _NL_BACKENDS_X86_64_REGALLOC_H_
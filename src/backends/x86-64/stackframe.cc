@@ -2,6 +2,17 @@
 
 namespace x86_64 {
 
+uint32_t sizeOfValue(NLType t) {
+  if (!t->is_struct) {
+    return 8;
+  }
+  uint32_t size = 0;
+  for (auto const &field : t->fields) {
+    size += sizeOfValue(field.type);
+  }
+  return size;
+}
+
 void StackFrameSizer::init(const std::vector<Stmt *> &program) {
   for (const Stmt *stmt : program) {
     init(stmt);
@@ -22,15 +33,13 @@ void StackFrameSizer::visit(const FuncStmt *stmt) {
 }
 
 void StackFrameSizer::visit(const VarStmt *stmt) {
-  NLType nlType = sm_.current().typetab->get(stmt->name.lexeme);
+  NLType nlType = sm_.types.get(stmt->name.id);
+  // Other locals of functions are kept in virtual registers.
+  if (enclosingFunc && !nlType->is_struct) {
+    return;
+  }
 
-  auto nlTypeTox86TypeSize = [](auto nlType) {
-    if (nlType == Primitives::Int()) {
-      return 8;
-    }
-    return 8;
-  };
-  bases[enclosingFunc].addLocal(stmt, nlTypeTox86TypeSize(nlType));
+  bases[enclosingFunc].addLocal(stmt, sizeOfValue(nlType));
 }
 
 void StackFrameSizer::visit(const BlockStmt *stmt) {
@@ -39,10 +48,13 @@ void StackFrameSizer::visit(const BlockStmt *stmt) {
   sm_.exit();
 }
 
+// Scopes are entered as the type checker did, so locals' types are found.
 void StackFrameSizer::visit(const ClassStmt *stmt) {
+  sm_.enter();
   for (const Stmt *method : stmt->methods) {
     init(method);
   }
+  sm_.exit();
 }
 
 void StackFrameSizer::visit(const IfStmt *stmt) {
@@ -21,21 +21,55 @@ struct FrameBase {
     sizes.push_back({varStmt, size});
     totalSize += size;
   }
+  // Locals larger than a word (structs) extend upwards from their offset.
   std::optional<uint16_t> bpOffsetOf(const VarStmt *varStmt) {
     uint16_t bpOffset = 0;
     for (auto &[v, size] : sizes) {
       if (v == varStmt) {
-        return bpOffset;
+        return bpOffset + size - 8;
       }
       bpOffset += size;
     }
     return std::nullopt;
   }
+  // Objects that EscapeAnalysis put on the stack sit below the locals.
+  // The site is the Call or VarStmt that allocates one.
+  void addObject(const void *site, uint16_t size) {
+    objects.push_back({site, size});
+    totalSize += size;
+  }
+  std::optional<uint16_t> bpOffsetOfObject(const void *site) {
+    uint16_t bpOffset = 0;
+    for (auto &[v, size] : sizes) {
+      bpOffset += size;
+    }
+    for (auto &[o, size] : objects) {
+      bpOffset += size;
+      if (o == site) {
+        return bpOffset;
+      }
+    }
+    return std::nullopt;
+  }
+  // Values RegisterAllocator spills, and the callee-saved registers it
+  // saves, get a word each below the objects. Words are added in pairs, so
+  // whether the frame is 16-byte aligned doesn't change. Returns the offset
+  // of the first.
+  uint16_t addSlots(uint16_t count) {
+    auto const first = totalSize + 8;
+    totalSize += 8 * (count + count % 2);
+    return first;
+  }
   // Return address is pushed 'after' the caller aligns the stack
   std::vector<std::pair<const VarStmt *, uint16_t>> sizes = {{nullptr, 8}};
+  std::vector<std::pair<const void *, uint16_t>> objects;
   uint16_t totalSize = 8;
 };
 
+// Bytes a value of the type takes in a local, field or array element: a
+// word, or a struct's fields laid out one after the other.
+uint32_t sizeOfValue(NLType t);
+
 class StackFrameSizer : public StmtVisitor<> {
  public:
   StackFrameSizer(ScopeManager &sm) : sm_(sm) {}
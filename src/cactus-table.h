@@ -7,7 +7,8 @@
 /*
  * CactusTable implements a multi-map with scoping semantics.
  * It is a cactus tree (wikipedia.org/wiki/Parent_pointer_tree)
- * that is specializable on K+V to build symbol/type/vtables.
+ * that is specializable on K+V. Symbol and type tables, which are keyed
+ * by interned names, use the flat ScopedTable instead.
  */
 template <typename K, typename V> class CactusTable {
 private:
@@ -23,17 +24,23 @@ public:
   void insert(K const& k, V const& v) { mappings[k] = v; }
 
   bool contains(K const& k) const {
-    if (!parent) {
-      return mappings.count(k) > 0;
+    for (const CactusTable *t = this; t; t = t->parent.get()) {
+      if (t->mappings.find(k) != t->mappings.end()) {
+        return true;
+      }
     }
-    return mappings.count(k) > 0 || parent->contains(k);
+    return false;
   }
 
   V get(K const& k) {
-    if (mappings.count(k) > 0 || !parent) {
-      return mappings[k];
+    CactusTable *t = this;
+    for (; t->parent; t = t->parent.get()) {
+      auto it = t->mappings.find(k);
+      if (it != t->mappings.end()) {
+        return it->second;
+      }
     }
-    return parent->get(k);
+    return t->mappings[k];
   }
 };
 
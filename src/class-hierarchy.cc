@@ -0,0 +1,156 @@
+#include "class-hierarchy.h"
+
+#include "expr.h"
+#include "primitives.h"
+
+void ClassHierarchy::analyze_program(const std::vector<Stmt *> &program) {
+  // Classes can only be declared at the top level.
+  for (const Stmt *stmt : program) {
+    if (const auto *cls = dynamic_cast<const ClassStmt *>(stmt)) {
+      classes.push_back(sm.types.get_global(cls->name.id));
+    }
+  }
+  find_overrides();
+  analyze(program);
+}
+
+/* A slot of an ancestor is overridden if some descendant's vtable holds a
+   different implementation in it. Subclass vtables start with their
+   superclass's slots, so slot numbers agree along the hierarchy. */
+void ClassHierarchy::find_overrides() {
+  for (const NLType &cls : classes) {
+    overridden[cls.get()].resize(cls->num_methods(), false);
+  }
+
+  for (const NLType &cls : classes) {
+    for (Type *ancestor = cls->supertype.get(); ancestor;
+         ancestor = ancestor->supertype.get()) {
+      std::vector<bool> &slots = overridden[ancestor];
+      slots.resize(ancestor->num_methods(), false);
+      for (size_t slot = 0; slot < slots.size(); slot++) {
+        if (cls->method_owner(slot) != ancestor->method_owner(slot)) {
+          slots[slot] = true;
+        }
+      }
+    }
+  }
+}
+
+void ClassHierarchy::analyze(const std::vector<Stmt *> &stmts) {
+  for (const Stmt *stmt : stmts) {
+    analyze(stmt);
+  }
+}
+
+void ClassHierarchy::analyze(const Stmt *stmt) { stmt->accept(this); }
+
+void ClassHierarchy::analyze(const Expr *expr) { expr->accept(this); }
+
+void ClassHierarchy::visit(const BlockStmt *stmt) {
+  analyze(stmt->block_contents);
+}
+
+void ClassHierarchy::visit(const ExprStmt *stmt) { analyze(stmt->expression); }
+
+void ClassHierarchy::visit(const PrintStmt *stmt) {
+  analyze(stmt->expression);
+}
+
+void ClassHierarchy::visit(const VarStmt *stmt) {
+  for (const Expr *dim : stmt->tp.dims) {
+    analyze(dim);
+  }
+  if (stmt->expression) {
+    analyze(stmt->expression);
+  }
+}
+
+void ClassHierarchy::visit(const ClassStmt *stmt) { analyze(stmt->methods); }
+
+void ClassHierarchy::visit(const IfStmt *stmt) {
+  analyze(stmt->condition);
+  analyze(stmt->then_branch);
+  if (stmt->else_branch) {
+    analyze(stmt->else_branch);
+  }
+}
+
+void ClassHierarchy::visit(const WhileStmt *stmt) {
+  analyze(stmt->condition);
+  analyze(stmt->body);
+}
+
+void ClassHierarchy::visit(const FuncStmt *stmt) { analyze(stmt->body); }
+
+void ClassHierarchy::visit(const ReturnStmt *stmt) {
+  if (stmt->value) {
+    analyze(stmt->value);
+  }
+}
+
+void ClassHierarchy::visit(const Unary *expr) { analyze(&expr->right); }
+
+void ClassHierarchy::visit(const Binary *expr) {
+  analyze(&expr->left);
+  analyze(&expr->right);
+}
+
+void ClassHierarchy::visit(const Grouping *expr) {
+  analyze(&expr->expression);
+}
+
+void ClassHierarchy::visit(const StrLiteral *) {}
+void ClassHierarchy::visit(const NumLiteral *) {}
+void ClassHierarchy::visit(const BoolLiteral *) {}
+void ClassHierarchy::visit(const Variable *) {}
+void ClassHierarchy::visit(const SentinelExpr *) {}
+void ClassHierarchy::visit(const This *) {}
+
+void ClassHierarchy::visit(const Assignment *expr) { analyze(&expr->value); }
+
+void ClassHierarchy::visit(const Logical *expr) {
+  analyze(&expr->left);
+  analyze(&expr->right);
+}
+
+void ClassHierarchy::visit(const Call *expr) {
+  analyze(&expr->callee);
+  for (const Expr *arg : expr->args) {
+    analyze(arg);
+  }
+}
+
+void ClassHierarchy::visit(const Get *expr) {
+  analyze(&expr->callee);
+
+  NLType receiver = expr_types.get(&expr->callee);
+  if (!receiver || receiver == Primitives::Class() ||
+      !receiver->has_method(expr->name.id)) {
+    return; // An initializer or a field, not a method call.
+  }
+
+  const int slot = receiver->method_idx(expr->name.id);
+  auto slots = overridden.find(receiver.get());
+  if (slots == overridden.end() || slots->second[slot]) {
+    virtual_calls++;
+    return;
+  }
+  direct_targets[expr] = receiver->method_owner(slot);
+  direct_calls++;
+}
+
+void ClassHierarchy::visit(const Set *expr) {
+  analyze(&expr->callee);
+  analyze(&expr->value);
+}
+
+void ClassHierarchy::visit(const GetIndex *expr) {
+  analyze(&expr->callee);
+  analyze(&expr->index);
+}
+
+void ClassHierarchy::visit(const SetIndex *expr) {
+  analyze(&expr->callee);
+  analyze(&expr->index);
+  analyze(&expr->value);
+}
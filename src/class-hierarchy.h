@@ -0,0 +1,63 @@
+#ifndef _NL_CLASS_HIERARCHY_H_
+#define _NL_CLASS_HIERARCHY_H_
+
+#include <cstddef>
+#include <unordered_map>
+#include <vector>
+
+#include "expr-map.h"
+#include "expr-types.h"
+#include "scope-manager.h"
+#include "stmt.h"
+#include "visitor.h"
+
+/*
+ * Class hierarchy analysis. NL programs are compiled whole, so every
+ * subclass of a class is known at compile time. A method call whose
+ * receiver's static type is C can only reach the implementations found
+ * in C's vtable slot and in that slot of C's subclasses. When all of
+ * those are the same function, the call is monomorphic, and the backends
+ * call that function directly instead of loading it from the vtable.
+ *
+ * Runs after type checking. The result is a side table from the method
+ * Get expression of each monomorphic call site to the class whose
+ * implementation it calls.
+ */
+class ClassHierarchy : public ExprVisitor<void>, public StmtVisitor<void> {
+public:
+  ClassHierarchy(ScopeManager &sm, const ExprTypes &expr_types)
+      : sm(sm), expr_types(expr_types) {}
+
+  void analyze_program(const std::vector<Stmt *> &program);
+
+  /* The class implementing the method a Get names, if the call can only
+     reach that one implementation; otherwise nullptr. */
+  const Type *direct_target(const Expr *method) const {
+    return direct_targets.get(method);
+  }
+
+  size_t num_direct_calls() const { return direct_calls; }
+  size_t num_virtual_calls() const { return virtual_calls; }
+
+  OVERRIDE_EXPR_VISITOR_FNS(void)
+  OVERRIDE_STMT_VISITOR_FNS(void)
+
+private:
+  ScopeManager &sm;
+  const ExprTypes &expr_types;
+  std::vector<NLType> classes;
+
+  // Per class, whether each vtable slot is overridden by a subclass.
+  std::unordered_map<const Type *, std::vector<bool>> overridden;
+
+  ExprMap<const Type *> direct_targets;
+  size_t direct_calls = 0;
+  size_t virtual_calls = 0;
+
+  void find_overrides();
+  void analyze(const std::vector<Stmt *> &stmts);
+  void analyze(const Stmt *stmt);
+  void analyze(const Expr *expr);
+};
+
+#endif // _NL_CLASS_HIERARCHY_H_
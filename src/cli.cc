@@ -1,19 +1,95 @@
+#include <cstring>
 #include <iostream>
 
 #include "neeilang.h"
+#include "options.h"
 #include "token.h"
 
+static void usage() {
+  std::cout << "Usage: neeilang [--stats] [--stop-after=lex|parse]\n"
+            << "                [--time-passes] [--trace=<file.json>]\n"
+#ifndef TARGET_X86
+            << "                [-O0|-O1|-O2|-O3]\n"
+            << "                [--emit=bc|ll|asm|obj|exe] [-o <file>]\n"
+            << "                [--run[=eager]]\n"
+            << "                [--profile-generate[=<file>]]\n"
+            << "                [--profile-use=<file>]\n"
+#endif
+            << "                [source file | -]" << std::endl;
+  exit(0);
+}
+
+#ifdef TARGET_X86
+// The x86-64 backend always prints assembly to stdout, so options that
+// control the LLVM backend's output would be silently ignored.
+static bool llvm_only(const char *arg) {
+  return strncmp(arg, "-O", 2) == 0 || strncmp(arg, "--emit=", 7) == 0 ||
+         strcmp(arg, "-o") == 0 || strcmp(arg, "--run") == 0 ||
+         strncmp(arg, "--run=", 6) == 0 || strncmp(arg, "--profile-", 10) == 0;
+}
+#endif
+
 int main(int argc, char **argv) {
-  if (argc > 2) {
-    std::cout << "Usage: neeilang [source file]" << std::endl;
-    exit(0);
+  Options options;
+  const char *path = nullptr;
+
+  for (int i = 1; i < argc; i++) {
+#ifdef TARGET_X86
+    if (llvm_only(argv[i])) {
+      std::cerr << "neeilang: " << argv[i]
+                << " is only supported by the LLVM backend" << std::endl;
+      return 1;
+    }
+#endif
+    if (strcmp(argv[i], "--stats") == 0) {
+      options.stats = true;
+    } else if (strcmp(argv[i], "--stop-after=lex") == 0) {
+      options.stop_after = Options::LEX;
+    } else if (strcmp(argv[i], "--stop-after=parse") == 0) {
+      options.stop_after = Options::PARSE;
+    } else if (strcmp(argv[i], "--time-passes") == 0) {
+      options.time_passes = true;
+    } else if (strncmp(argv[i], "--trace=", 8) == 0 && argv[i][8] != '\0') {
+      options.trace_file = argv[i] + 8;
+    } else if (strncmp(argv[i], "-O", 2) == 0 && argv[i][2] >= '0' &&
+               argv[i][2] <= '3' && argv[i][3] == '\0') {
+      options.opt_level = argv[i][2] - '0';
+    } else if (strcmp(argv[i], "--emit=bc") == 0) {
+      options.emit = Options::BITCODE;
+    } else if (strcmp(argv[i], "--emit=ll") == 0) {
+      options.emit = Options::IR;
+    } else if (strcmp(argv[i], "--emit=asm") == 0) {
+      options.emit = Options::ASSEMBLY;
+    } else if (strcmp(argv[i], "--emit=obj") == 0) {
+      options.emit = Options::OBJECT;
+    } else if (strcmp(argv[i], "--emit=exe") == 0) {
+      options.emit = Options::EXECUTABLE;
+    } else if (strcmp(argv[i], "--run") == 0) {
+      options.run = Options::RUN_LAZY;
+    } else if (strcmp(argv[i], "--run=eager") == 0) {
+      options.run = Options::RUN_EAGER;
+    } else if (strcmp(argv[i], "--profile-generate") == 0) {
+      options.profile_generate = "default.nlprof";
+    } else if (strncmp(argv[i], "--profile-generate=", 19) == 0 &&
+               argv[i][19] != '\0') {
+      options.profile_generate = argv[i] + 19;
+    } else if (strncmp(argv[i], "--profile-use=", 14) == 0 &&
+               argv[i][14] != '\0') {
+      options.profile_use = argv[i] + 14;
+    } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+      options.output_file = argv[++i];
+    } else if ((argv[i][0] == '-' && argv[i][1] != '\0') || path) {
+      usage();
+    } else {
+      path = argv[i];
+    }
   }
 
   Neeilang nl;
 
-  if (argc == 2) {
-    nl.run_file(argv[1]);
+  if (path) {
+    nl.run_file(path, options);
   }
 
   return 0;
-}
\ No newline at end of file
+}
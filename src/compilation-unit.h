@@ -0,0 +1,28 @@
+#ifndef _NL_COMPILATION_UNIT_H_
+#define _NL_COMPILATION_UNIT_H_
+
+#include <cstdint>
+#include <vector>
+
+#include "arena.h"
+#include "stmt.h"
+#include "token.h"
+
+/*
+ * Owns everything produced by the front-end for one source file. AST
+ * nodes live in the arena and refer to each other (and to tokens) by
+ * pointer, so the unit must outlive every pass that touches the AST.
+ */
+class CompilationUnit {
+public:
+  CompilationUnit() = default;
+  CompilationUnit(const CompilationUnit &) = delete;
+  CompilationUnit &operator=(const CompilationUnit &) = delete;
+
+  std::vector<Token> tokens;
+  Arena arena;
+  std::vector<Stmt *> program;
+  uint32_t num_exprs = 0; // Expression IDs run from 1 to num_exprs.
+};
+
+#endif // _NL_COMPILATION_UNIT_H_
@@ -0,0 +1,372 @@
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
+
+#include "constant-folding.h"
+
+#include "expr.h"
+#include "primitives.h"
+
+static bool fits_int(int64_t value) {
+  return value >= INT32_MIN && value <= INT32_MAX;
+}
+
+static KnownValue int_value(int64_t value) {
+  KnownValue known;
+  known.kind = KnownValue::INT;
+  known.int_value = value;
+  return known;
+}
+
+static KnownValue float_value(double value) {
+  KnownValue known;
+  known.kind = KnownValue::FLOAT;
+  known.float_value = value;
+  return known;
+}
+
+static KnownValue bool_value(bool value) {
+  KnownValue known;
+  known.kind = KnownValue::BOOL;
+  known.int_value = value;
+  return known;
+}
+
+/* Ints are converted to Floats when mixed with them, as the backends do. */
+static double as_float(KnownValue known) {
+  return known.kind == KnownValue::FLOAT ? known.float_value
+                                         : known.int_value;
+}
+
+void ConstantFolding::analyze_program(const std::vector<Stmt *> &program) {
+  assignments_pass = true;
+  enter_scope();
+  analyze(program);
+  exit_scope();
+
+  assignments_pass = false;
+  enter_scope();
+  analyze(program);
+  exit_scope();
+}
+
+void ConstantFolding::analyze(const std::vector<Stmt *> &stmts) {
+  for (const Stmt *stmt : stmts) {
+    analyze(stmt);
+  }
+}
+
+void ConstantFolding::analyze(const Stmt *stmt) { stmt->accept(this); }
+
+void ConstantFolding::analyze(const Expr *expr) { expr->accept(this); }
+
+/* The local a name refers to, or nullptr if it's a parameter, a global, or
+   not a variable at all. */
+const VarStmt *ConstantFolding::lookup(Ident name) const {
+  for (auto scope = scopes.rbegin(); scope != scopes.rend(); ++scope) {
+    auto it = scope->find(name);
+    if (it != scope->end()) {
+      return it->second;
+    }
+  }
+  return nullptr;
+}
+
+void ConstantFolding::fold(const Expr *expr, KnownValue value) {
+  if (!assignments_pass) {
+    values[expr] = value;
+    folded++;
+  }
+}
+
+/* Walks a branch, returning how many scopes it opened. */
+size_t ConstantFolding::analyze_branch(const Stmt *branch) {
+  const size_t start = blocks;
+  if (branch) {
+    analyze(branch);
+  }
+  return blocks - start;
+}
+
+void ConstantFolding::visit(const BlockStmt *stmt) {
+  blocks++;
+  enter_scope();
+  analyze(stmt->block_contents);
+  exit_scope();
+}
+
+void ConstantFolding::visit(const ExprStmt *stmt) {
+  analyze(stmt->expression);
+}
+
+void ConstantFolding::visit(const PrintStmt *stmt) {
+  if (stmt->expression) {
+    analyze(stmt->expression);
+  }
+}
+
+void ConstantFolding::visit(const VarStmt *stmt) {
+  for (const Expr *dim : stmt->tp.dims) {
+    analyze(dim);
+  }
+  if (stmt->expression) {
+    analyze(stmt->expression);
+  }
+
+  // Globals could be assigned by functions walked before their
+  // declaration, so only locals are propagated.
+  scopes.back()[stmt->name.id] = fn_depth > 0 ? stmt : nullptr;
+  if (assignments_pass || assigned.count(stmt) || !stmt->expression ||
+      stmt->tp.is_array()) {
+    return;
+  }
+
+  // The variable's type must be the value's, e.g. not a Float holding an
+  // Int.
+  KnownValue init = value(stmt->expression);
+  static const Ident kind_types[] = {ID_EMPTY, ID_INT, ID_FLOAT, ID_BOOL};
+  if (init &&
+      (stmt->tp.inferred || stmt->tp.name.id == kind_types[init.kind])) {
+    locals[stmt] = init;
+  }
+}
+
+void ConstantFolding::visit(const ClassStmt *stmt) { analyze(stmt->methods); }
+
+void ConstantFolding::visit(const IfStmt *stmt) {
+  analyze(stmt->condition);
+  const size_t then_scopes = analyze_branch(stmt->then_branch);
+  const size_t else_scopes = analyze_branch(stmt->else_branch);
+
+  KnownValue cond = value(stmt->condition);
+  if (!cond) {
+    return;
+  }
+  pruned++;
+  if (cond.int_value && stmt->else_branch) {
+    dead_scopes[stmt->else_branch] = else_scopes;
+  } else if (!cond.int_value) {
+    dead_scopes[stmt->then_branch] = then_scopes;
+  }
+}
+
+void ConstantFolding::visit(const WhileStmt *stmt) {
+  analyze(stmt->condition);
+  const size_t body_scopes = analyze_branch(stmt->body);
+
+  KnownValue cond = value(stmt->condition);
+  if (cond && !cond.int_value) {
+    pruned++;
+    if (stmt->body) {
+      dead_scopes[stmt->body] = body_scopes;
+    }
+  }
+}
+
+void ConstantFolding::visit(const FuncStmt *stmt) {
+  enter_scope();
+  for (const Token &param : stmt->parameters) {
+    scopes.back()[param.id] = nullptr;
+  }
+  fn_depth++;
+  analyze(stmt->body);
+  fn_depth--;
+  exit_scope();
+}
+
+void ConstantFolding::visit(const ReturnStmt *stmt) {
+  if (stmt->value) {
+    analyze(stmt->value);
+  }
+}
+
+void ConstantFolding::visit(const Unary *expr) {
+  analyze(&expr->right);
+  KnownValue right = value(&expr->right);
+  if (!right) {
+    return;
+  }
+
+  if (expr->op.type == BANG) {
+    fold(expr, bool_value(!right.int_value));
+  } else if (right.kind == KnownValue::FLOAT) {
+    fold(expr, float_value(-right.float_value));
+  } else if (fits_int(-int64_t(right.int_value))) {
+    fold(expr, int_value(-int64_t(right.int_value)));
+  }
+}
+
+void ConstantFolding::visit(const Binary *expr) {
+  analyze(&expr->left);
+  analyze(&expr->right);
+  KnownValue l = value(&expr->left), r = value(&expr->right);
+  if (!l || !r) {
+    return;
+  }
+
+  const bool floats =
+      l.kind == KnownValue::FLOAT || r.kind == KnownValue::FLOAT;
+  const double lf = as_float(l), rf = as_float(r);
+  const int64_t li = l.int_value, ri = r.int_value;
+
+  switch (expr->op.type) {
+  case PLUS:
+  case MINUS:
+  case STAR:
+  case SLASH: {
+    if (floats) {
+      switch (expr->op.type) {
+      case PLUS: fold(expr, float_value(lf + rf)); break;
+      case MINUS: fold(expr, float_value(lf - rf)); break;
+      case STAR: fold(expr, float_value(lf * rf)); break;
+      default: fold(expr, float_value(lf / rf)); break;
+      }
+      return;
+    }
+
+    int64_t result;
+    switch (expr->op.type) {
+    case PLUS: result = li + ri; break;
+    case MINUS: result = li - ri; break;
+    case STAR: result = li * ri; break;
+    default:
+      if (ri == 0) {
+        return;
+      }
+      result = li / ri;
+      break;
+    }
+    if (fits_int(result)) {
+      fold(expr, int_value(result));
+    }
+    return;
+  }
+  default:
+    break;
+  }
+
+  // Comparisons. Floats are compared unordered by the backends, but that
+  // only matters for NaN, which is left alone.
+  if (floats && (std::isnan(lf) || std::isnan(rf))) {
+    return;
+  }
+  switch (expr->op.type) {
+  case GREATER:
+    fold(expr, bool_value(floats ? lf > rf : li > ri));
+    return;
+  case GREATER_EQUAL:
+    fold(expr, bool_value(floats ? lf >= rf : li >= ri));
+    return;
+  case LESS:
+    fold(expr, bool_value(floats ? lf < rf : li < ri));
+    return;
+  case LESS_EQUAL:
+    fold(expr, bool_value(floats ? lf <= rf : li <= ri));
+    return;
+  case EQUAL_EQUAL:
+    fold(expr, bool_value(floats ? lf == rf : li == ri));
+    return;
+  case BANG_EQUAL:
+    fold(expr, bool_value(floats ? lf != rf : li != ri));
+    return;
+  default:
+    return;
+  }
+}
+
+void ConstantFolding::visit(const Grouping *expr) {
+  analyze(&expr->expression);
+  if (!assignments_pass) {
+    values[expr] = value(&expr->expression);
+  }
+}
+
+void ConstantFolding::visit(const StrLiteral *) {}
+
+/* Literals are parsed once here, rather than by each backend. */
+void ConstantFolding::visit(const NumLiteral *expr) {
+  if (assignments_pass || expr->nil) {
+    return;
+  }
+  NLType type = expr_types.get(expr);
+  if (type == Primitives::Float()) {
+    values[expr] = float_value(expr->as_double());
+  } else if (type == Primitives::Int()) {
+    errno = 0;
+    const long long parsed = strtoll(expr->value.c_str(), nullptr, 10);
+    if (errno == 0 && fits_int(parsed)) {
+      values[expr] = int_value(parsed);
+    }
+  }
+}
+
+void ConstantFolding::visit(const BoolLiteral *expr) {
+  if (!assignments_pass) {
+    values[expr] = bool_value(expr->value);
+  }
+}
+
+void ConstantFolding::visit(const Variable *expr) {
+  if (assignments_pass) {
+    return;
+  }
+  const VarStmt *local = lookup(expr->name.id);
+  auto it = local ? locals.find(local) : locals.end();
+  if (it != locals.end()) {
+    fold(expr, it->second);
+  }
+}
+
+void ConstantFolding::visit(const SentinelExpr *) {}
+void ConstantFolding::visit(const This *) {}
+
+void ConstantFolding::visit(const Assignment *expr) {
+  analyze(&expr->value);
+  if (assignments_pass) {
+    if (const VarStmt *local = lookup(expr->name.id)) {
+      assigned.insert(local);
+    }
+  }
+}
+
+/* and/or only evaluate their right operand when the left doesn't decide
+   the result, so a known left operand that does decides it alone. */
+void ConstantFolding::visit(const Logical *expr) {
+  analyze(&expr->left);
+  analyze(&expr->right);
+  KnownValue l = value(&expr->left), r = value(&expr->right);
+  if (!l) {
+    return;
+  }
+  const bool decides = expr->op.type == OR ? l.int_value : !l.int_value;
+  if (decides) {
+    fold(expr, l);
+  } else if (r) {
+    fold(expr, r);
+  }
+}
+
+void ConstantFolding::visit(const Call *expr) {
+  analyze(&expr->callee);
+  for (const Expr *arg : expr->args) {
+    analyze(arg);
+  }
+}
+
+void ConstantFolding::visit(const Get *expr) { analyze(&expr->callee); }
+
+void ConstantFolding::visit(const Set *expr) {
+  analyze(&expr->callee);
+  analyze(&expr->value);
+}
+
+void ConstantFolding::visit(const GetIndex *expr) {
+  analyze(&expr->callee);
+  analyze(&expr->index);
+}
+
+void ConstantFolding::visit(const SetIndex *expr) {
+  analyze(&expr->callee);
+  analyze(&expr->index);
+  analyze(&expr->value);
+}
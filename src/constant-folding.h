@@ -0,0 +1,90 @@
+#ifndef _NL_CONSTANT_FOLDING_H_
+#define _NL_CONSTANT_FOLDING_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "expr-map.h"
+#include "expr-types.h"
+#include "interner.h"
+#include "stmt.h"
+#include "visitor.h"
+
+/* The value of an Int, Float or Bool expression known at compile time. */
+struct KnownValue {
+  enum Kind : uint8_t { NONE, INT, FLOAT, BOOL };
+  Kind kind = NONE;
+  int32_t int_value = 0; // Ints, and Bools as 0 or 1.
+  double float_value = 0;
+
+  explicit operator bool() const { return kind != NONE; }
+};
+
+/*
+ * Constant folding and propagation. Finds the expressions whose value is
+ * known at compile time: literals, arithmetic, comparisons, and/or, and
+ * ! on known operands, and reads of locals that are initialized with one
+ * and never assigned. The backends emit such an expression as its value
+ * instead of computing it, and only emit the branch of an if (or none of
+ * a while) that a known condition takes.
+ *
+ * Ints are folded as the LLVM backend computes them, in 32 bits; an
+ * operation that would overflow, or divide by zero, is left to run time.
+ *
+ * Runs after type checking. The result is a side table of every
+ * expression with a known value.
+ */
+class ConstantFolding : public ExprVisitor<void>, public StmtVisitor<void> {
+public:
+  explicit ConstantFolding(const ExprTypes &expr_types)
+      : expr_types(expr_types) {}
+
+  void analyze_program(const std::vector<Stmt *> &program);
+
+  /* The value of an expression, if it is known. */
+  KnownValue value(const Expr *expr) const { return values.get(expr); }
+
+  /* The number of scopes in a branch that is never taken, which the
+     backends skip rather than emit (see ScopeManager::skip). */
+  size_t scopes_in(const Stmt *dead) const {
+    auto it = dead_scopes.find(dead);
+    return it == dead_scopes.end() ? 0 : it->second;
+  }
+
+  size_t num_folded() const { return folded; }
+  size_t num_pruned() const { return pruned; }
+
+  OVERRIDE_EXPR_VISITOR_FNS(void)
+  OVERRIDE_STMT_VISITOR_FNS(void)
+
+private:
+  const ExprTypes &expr_types;
+
+  // Locals are found by walking scopes the way the Resolver does: once to
+  // find the ones ever assigned, then again to fold.
+  bool assignments_pass = true;
+  int fn_depth = 0;
+  std::vector<std::unordered_map<Ident, const VarStmt *>> scopes;
+  std::unordered_set<const VarStmt *> assigned;
+  std::unordered_map<const VarStmt *, KnownValue> locals;
+
+  ExprMap<KnownValue> values;
+  std::unordered_map<const Stmt *, size_t> dead_scopes;
+  size_t blocks = 0; // Walked so far, which is how scopes are numbered.
+  size_t folded = 0;
+  size_t pruned = 0;
+
+  void analyze(const std::vector<Stmt *> &stmts);
+  void analyze(const Stmt *stmt);
+  void analyze(const Expr *expr);
+  void enter_scope() { scopes.emplace_back(); }
+  void exit_scope() { scopes.pop_back(); }
+  const VarStmt *lookup(Ident name) const;
+  void fold(const Expr *expr, KnownValue value);
+  size_t analyze_branch(const Stmt *branch);
+};
+
+#endif // _NL_CONSTANT_FOLDING_H_
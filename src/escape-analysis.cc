@@ -0,0 +1,402 @@
+#include <algorithm>
+
+#include "escape-analysis.h"
+
+#include "expr.h"
+#include "primitives.h"
+
+void EscapeAnalysis::analyze_program(const std::vector<Stmt *> &program) {
+  nodes.push_back({nullptr, 0, {}}); // ESCAPED
+  nodes.push_back({nullptr, 0, {}}); // TAIL_CALLED
+  declare(program);
+  analyze(program);
+
+  for (const Site &site : sites) {
+    if (escapes(site)) {
+      continue;
+    }
+    stack++;
+    const FuncStmt *owner = nodes[site.node].fn;
+    if (site.init) {
+      stack_objects[site.init] = 1;
+      fn_objects[owner].push_back(site.init);
+    } else {
+      stack_arrays[site.array] = site.elems;
+      fn_arrays[owner].push_back(site.array);
+    }
+  }
+}
+
+const std::vector<const Call *> &
+EscapeAnalysis::frame_objects(const FuncStmt *fn) const {
+  static const std::vector<const Call *> none;
+  auto it = fn_objects.find(fn);
+  return it == fn_objects.end() ? none : it->second;
+}
+
+const std::vector<const VarStmt *> &
+EscapeAnalysis::frame_arrays(const FuncStmt *fn) const {
+  static const std::vector<const VarStmt *> none;
+  auto it = fn_arrays.find(fn);
+  return it == fn_arrays.end() ? none : it->second;
+}
+
+/* Finds every function, class and method, and makes nodes for their
+   parameters, so calls can be followed before their callee is walked. */
+void EscapeAnalysis::declare(const std::vector<Stmt *> &program) {
+  for (const Stmt *stmt : program) {
+    if (const auto *func = dynamic_cast<const FuncStmt *>(stmt)) {
+      functions[func->name.id] = func;
+      declare(func, false);
+    } else if (const auto *cls = dynamic_cast<const ClassStmt *>(stmt)) {
+      classes[cls->name.id] = cls;
+      for (const Stmt *m : cls->methods) {
+        const auto *method = static_cast<const FuncStmt *>(m);
+        methods[method->name.id].push_back(method);
+        declare(method, true);
+      }
+    }
+  }
+}
+
+void EscapeAnalysis::declare(const FuncStmt *func, bool method) {
+  const FuncStmt *prev_fn = fn;
+  fn = func;
+  std::vector<size_t> &fn_params = params[func];
+  fn_params.resize(func->parameters.size() + method);
+  for (size_t &param : fn_params) {
+    param = node();
+  }
+  fn = prev_fn;
+}
+
+void EscapeAnalysis::analyze(const std::vector<Stmt *> &stmts) {
+  for (const Stmt *stmt : stmts) {
+    analyze(stmt);
+  }
+}
+
+void EscapeAnalysis::analyze(const Stmt *stmt) { stmt->accept(this); }
+
+std::vector<size_t> EscapeAnalysis::eval(const Expr *expr) {
+  values.clear();
+  expr->accept(this);
+  return std::move(values);
+}
+
+size_t EscapeAnalysis::node() {
+  nodes.push_back({fn, loop_depth, {}});
+  return nodes.size() - 1;
+}
+
+/* The node for a local variable. Variables are told apart by name only,
+   so a redeclaration shares the node, at the outermost depth of the two. */
+size_t EscapeAnalysis::local(Ident name) {
+  auto it = locals.find(name);
+  if (it == locals.end()) {
+    return locals[name] = node();
+  }
+  Node &var = nodes[it->second];
+  var.loop_depth = std::min(var.loop_depth, loop_depth);
+  return it->second;
+}
+
+void EscapeAnalysis::flow(const std::vector<size_t> &from, size_t to,
+                          bool call) {
+  for (size_t n : from) {
+    nodes[n].edges.push_back({to, call});
+  }
+}
+
+/* Arguments (and the receiver, for methods and initializers) flow into
+   the parameters of every callee; without one, they escape. */
+void EscapeAnalysis::call(const Call *expr,
+                          const std::vector<const FuncStmt *> &callees,
+                          const std::vector<size_t> &receiver) {
+  // A tail call's frame replaces the caller's.
+  const bool tail = expr == returned_call;
+  const bool method = !receiver.empty() || expr->callee.is_object_field();
+
+  std::vector<std::vector<size_t>> args;
+  if (method) {
+    args.push_back(receiver);
+  }
+  for (const Expr *arg : expr->args) {
+    args.push_back(eval(arg));
+  }
+
+  for (size_t i = 0; i < args.size(); i++) {
+    if (callees.empty()) {
+      flow(args[i], ESCAPED);
+    }
+    if (tail) {
+      flow(args[i], TAIL_CALLED);
+    }
+    for (const FuncStmt *callee : callees) {
+      const std::vector<size_t> &callee_params = params[callee];
+      flow(args[i], i < callee_params.size() ? callee_params[i] : ESCAPED,
+           true);
+    }
+  }
+}
+
+/* The element count of an array declaration with literal dimensions, if
+   it's small enough for the stack; 0 otherwise. */
+uint32_t EscapeAnalysis::array_elems(const VarStmt *stmt) const {
+  uint32_t elems = 1;
+  for (const Expr *dim : stmt->tp.dims) {
+    const auto *extent = dynamic_cast<const NumLiteral *>(dim);
+    if (!extent || extent->nil || extent->has_decimal_point() ||
+        extent->value[0] == '-' || extent->value.size() > 4) {
+      return 0;
+    }
+    elems *= std::stoul(extent->value);
+    if (elems == 0 || elems > MAX_STACK_ARRAY_ELEMS) {
+      return 0;
+    }
+  }
+  return elems;
+}
+
+/* Searches the graph from an allocation. Variables of its own function are
+   only reached without going through a call; in callees, the object
+   outlives their variables anyway. */
+bool EscapeAnalysis::escapes(const Site &site) const {
+  const Node &alloc = nodes[site.node];
+  std::vector<uint8_t> seen(nodes.size()); // Bit 0: directly, bit 1: by call.
+  std::vector<std::pair<size_t, bool>> work = {{site.node, false}};
+  while (!work.empty()) {
+    auto [n, by_call] = work.back();
+    work.pop_back();
+    if (n == ESCAPED || (n == TAIL_CALLED && !by_call)) {
+      return true;
+    }
+    if (!by_call && n != site.node && nodes[n].fn == alloc.fn &&
+        nodes[n].loop_depth < alloc.loop_depth) {
+      return true;
+    }
+    for (auto [to, call] : nodes[n].edges) {
+      const bool to_by_call = by_call || call;
+      const uint8_t bit = to_by_call ? 2 : 1;
+      if (!(seen[to] & bit)) {
+        seen[to] |= bit;
+        work.push_back({to, to_by_call});
+      }
+    }
+  }
+  return false;
+}
+
+void EscapeAnalysis::visit(const BlockStmt *stmt) {
+  analyze(stmt->block_contents);
+}
+
+void EscapeAnalysis::visit(const ExprStmt *stmt) { eval(stmt->expression); }
+
+void EscapeAnalysis::visit(const PrintStmt *stmt) {
+  if (stmt->expression) {
+    eval(stmt->expression);
+  }
+}
+
+void EscapeAnalysis::visit(const VarStmt *stmt) {
+  for (const Expr *dim : stmt->tp.dims) {
+    eval(dim);
+  }
+  std::vector<size_t> init;
+  if (stmt->expression) {
+    init = eval(stmt->expression);
+  } else if (!stmt->tp.dims.empty()) {
+    const uint32_t elems = array_elems(stmt);
+    const size_t site = node();
+    sites.push_back({site, nullptr, stmt, elems});
+    if (!elems) {
+      flow({site}, ESCAPED);
+    }
+    init = {site};
+  }
+  flow(init, local(stmt->name.id));
+}
+
+void EscapeAnalysis::visit(const ClassStmt *stmt) {
+  const ClassStmt *prev_class = enclosing_class;
+  enclosing_class = stmt;
+  analyze(stmt->methods);
+  enclosing_class = prev_class;
+}
+
+void EscapeAnalysis::visit(const IfStmt *stmt) {
+  eval(stmt->condition);
+  analyze(stmt->then_branch);
+  if (stmt->else_branch) {
+    analyze(stmt->else_branch);
+  }
+}
+
+void EscapeAnalysis::visit(const WhileStmt *stmt) {
+  loop_depth++;
+  eval(stmt->condition);
+  analyze(stmt->body);
+  loop_depth--;
+}
+
+void EscapeAnalysis::visit(const FuncStmt *stmt) {
+  const FuncStmt *prev_fn = fn;
+  auto prev_locals = std::move(locals);
+  const int prev_depth = loop_depth;
+  fn = stmt;
+  locals.clear();
+  loop_depth = 0;
+
+  if (!params.count(stmt)) {
+    declare(stmt, enclosing_class != nullptr);
+  }
+  const std::vector<size_t> &fn_params = params[stmt];
+  const size_t first = enclosing_class ? 1 : 0; // After `this`
+  for (size_t i = 0; i < stmt->parameters.size(); i++) {
+    locals[stmt->parameters[i].id] = fn_params[first + i];
+  }
+  analyze(stmt->body);
+
+  fn = prev_fn;
+  locals = std::move(prev_locals);
+  loop_depth = prev_depth;
+}
+
+void EscapeAnalysis::visit(const ReturnStmt *stmt) {
+  if (!stmt->value) {
+    return;
+  }
+  // Parentheses don't stop a returned call from becoming a tail call.
+  const Expr *value = stmt->value;
+  while (const auto *group = dynamic_cast<const Grouping *>(value)) {
+    value = &group->expression;
+  }
+  returned_call = dynamic_cast<const Call *>(value);
+  std::vector<size_t> result = eval(stmt->value);
+  returned_call = nullptr;
+
+  const bool returns_this =
+      enclosing_class && fn->name.id == ID_INIT &&
+      dynamic_cast<const This *>(stmt->value);
+  if (!returns_this) {
+    flow(result, ESCAPED);
+  }
+}
+
+void EscapeAnalysis::visit(const Unary *expr) {
+  eval(&expr->right);
+  values.clear();
+}
+
+void EscapeAnalysis::visit(const Binary *expr) {
+  eval(&expr->left);
+  eval(&expr->right);
+  values.clear();
+}
+
+void EscapeAnalysis::visit(const Grouping *expr) {
+  values = eval(&expr->expression);
+}
+
+void EscapeAnalysis::visit(const StrLiteral *) {}
+void EscapeAnalysis::visit(const NumLiteral *) {}
+void EscapeAnalysis::visit(const BoolLiteral *) {}
+void EscapeAnalysis::visit(const SentinelExpr *) {}
+
+void EscapeAnalysis::visit(const Variable *expr) {
+  // Otherwise it names a function.
+  auto it = locals.find(expr->name.id);
+  if (it != locals.end()) {
+    values = {it->second};
+  }
+}
+
+void EscapeAnalysis::visit(const This *) {
+  if (enclosing_class && fn) {
+    values = {params[fn][0]};
+  }
+}
+
+void EscapeAnalysis::visit(const Assignment *expr) {
+  std::vector<size_t> value = eval(&expr->value);
+  const size_t var = local(expr->name.id);
+  flow(value, var);
+  values = {var};
+}
+
+void EscapeAnalysis::visit(const Logical *expr) {
+  eval(&expr->left);
+  eval(&expr->right);
+  values.clear();
+}
+
+void EscapeAnalysis::visit(const Call *expr) {
+  const auto *get = dynamic_cast<const Get *>(&expr->callee);
+  const auto *var = dynamic_cast<const Variable *>(&expr->callee);
+
+  if (get && expr_types.get(&get->callee) == Primitives::Class()) {
+    // An initializer: a new object is its `this`, and its result.
+    std::vector<const FuncStmt *> callees;
+    const auto *cls = dynamic_cast<const Variable *>(&get->callee);
+    auto it = cls ? classes.find(cls->name.id) : classes.end();
+    if (it != classes.end()) {
+      for (const Stmt *m : it->second->methods) {
+        const auto *method = static_cast<const FuncStmt *>(m);
+        if (method->name.id == ID_INIT) {
+          callees.push_back(method);
+        }
+      }
+    }
+    const size_t site = node();
+    sites.push_back({site, expr, nullptr, 0});
+    call(expr, callees, {site});
+    values = {site};
+    return;
+  }
+
+  if (get) {
+    std::vector<size_t> receiver = eval(&get->callee);
+    auto it = methods.find(get->name.id);
+    call(expr, it == methods.end() ? std::vector<const FuncStmt *>()
+                                   : it->second,
+         receiver);
+  } else if (var && !locals.count(var->name.id) &&
+             functions.count(var->name.id)) {
+    call(expr, {functions[var->name.id]}, {});
+  } else {
+    eval(&expr->callee);
+    call(expr, {}, {});
+  }
+  // A callee can only return what has escaped.
+  values.clear();
+}
+
+void EscapeAnalysis::visit(const Get *expr) {
+  std::vector<size_t> object = eval(&expr->callee);
+  NLType type = expr_types.get(expr);
+  if (type && type->is_function_type()) {
+    // A method, taken without calling it.
+    flow(object, ESCAPED);
+  }
+  values.clear();
+}
+
+void EscapeAnalysis::visit(const Set *expr) {
+  eval(&expr->callee);
+  flow(eval(&expr->value), ESCAPED);
+  values.clear();
+}
+
+void EscapeAnalysis::visit(const GetIndex *expr) {
+  eval(&expr->callee);
+  eval(&expr->index);
+  values.clear();
+}
+
+void EscapeAnalysis::visit(const SetIndex *expr) {
+  eval(&expr->callee);
+  eval(&expr->index);
+  flow(eval(&expr->value), ESCAPED);
+  values.clear();
+}
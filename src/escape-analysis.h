@@ -0,0 +1,132 @@
+#ifndef _NL_ESCAPE_ANALYSIS_H_
+#define _NL_ESCAPE_ANALYSIS_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "expr-map.h"
+#include "expr-types.h"
+#include "interner.h"
+#include "stmt.h"
+#include "visitor.h"
+
+/*
+ * Escape analysis. Finds the objects (Foo.init() calls) and arrays (var
+ * a : Int[4]) that can't be reached once the function allocating them
+ * returns, which the backends allocate in its stack frame instead of on
+ * the heap.
+ *
+ * It's a flow-insensitive analysis of the whole program. A graph records
+ * where references may be copied to: from an allocation or a variable to
+ * the variables it's assigned to, and from call arguments to the
+ * callee's parameters (for method calls, those of every method with the
+ * name). An allocation escapes if it can reach
+ *
+ *  - a field, an array element, or a return (other than an initializer's
+ *    `return this`, whose result is the allocation itself),
+ *  - a call that can't be resolved, or a tail call made by its function,
+ *    which reuses the function's frame, or
+ *  - a variable of its own function declared outside the innermost loop
+ *    around the allocation. An allocation's stack slot is reused each
+ *    time it runs, so the previous object must be dead by then.
+ *
+ * Arrays are only put on the stack if their dimensions are literals and
+ * they have at most MAX_STACK_ARRAY_ELEMS elements.
+ *
+ * Runs after type checking.
+ */
+class EscapeAnalysis : public ExprVisitor<void>, public StmtVisitor<void> {
+public:
+  static const uint32_t MAX_STACK_ARRAY_ELEMS = 256;
+
+  explicit EscapeAnalysis(const ExprTypes &expr_types)
+      : expr_types(expr_types) {}
+
+  void analyze_program(const std::vector<Stmt *> &program);
+
+  /* Whether the object an initializer call allocates can be put on the
+     stack. */
+  bool on_stack(const Call *init) const { return stack_objects.get(init); }
+
+  /* The number of elements of an array declaration that can be put on
+     the stack, or 0 if it goes on the heap. */
+  uint32_t stack_array_size(const VarStmt *array) const {
+    auto it = stack_arrays.find(array);
+    return it == stack_arrays.end() ? 0 : it->second;
+  }
+
+  /* The stack allocations a function makes, for backends that lay out
+     frames themselves. */
+  const std::vector<const Call *> &frame_objects(const FuncStmt *fn) const;
+  const std::vector<const VarStmt *> &frame_arrays(const FuncStmt *fn) const;
+
+  size_t num_allocs() const { return sites.size(); }
+  size_t num_on_stack() const { return stack; }
+
+  OVERRIDE_EXPR_VISITOR_FNS(void)
+  OVERRIDE_STMT_VISITOR_FNS(void)
+
+private:
+  const ExprTypes &expr_types;
+
+  // A node is an allocation, a variable or parameter of a function,
+  // ESCAPED, or TAIL_CALLED: passed to a tail call, which only objects from
+  // the caller's own frame can't survive. Edges point to where a node's
+  // references may be copied.
+  static const size_t ESCAPED = 0;
+  static const size_t TAIL_CALLED = 1;
+  struct Node {
+    const FuncStmt *fn;
+    int loop_depth;
+    std::vector<std::pair<size_t, bool>> edges; // To, and if into a call.
+  };
+  std::vector<Node> nodes;
+
+  struct Site {
+    size_t node;
+    const Call *init;     // One of these is set.
+    const VarStmt *array;
+    uint32_t elems;
+  };
+  std::vector<Site> sites;
+
+  std::unordered_map<Ident, const FuncStmt *> functions;
+  std::unordered_map<Ident, const ClassStmt *> classes;
+  std::unordered_map<Ident, std::vector<const FuncStmt *>> methods;
+  // Per function, `this` (for methods) and then the parameters.
+  std::unordered_map<const FuncStmt *, std::vector<size_t>> params;
+
+  // The function being walked.
+  const FuncStmt *fn = nullptr;
+  const ClassStmt *enclosing_class = nullptr;
+  std::unordered_map<Ident, size_t> locals;
+  int loop_depth = 0;
+  const Call *returned_call = nullptr;
+
+  // The nodes an expression's value may come from.
+  std::vector<size_t> values;
+
+  ExprMap<uint8_t> stack_objects; // Not bool: ExprMap hands out references.
+  std::unordered_map<const VarStmt *, uint32_t> stack_arrays;
+  std::unordered_map<const FuncStmt *, std::vector<const Call *>> fn_objects;
+  std::unordered_map<const FuncStmt *, std::vector<const VarStmt *>> fn_arrays;
+  size_t stack = 0;
+
+  void declare(const std::vector<Stmt *> &program);
+  void declare(const FuncStmt *func, bool method);
+  void analyze(const std::vector<Stmt *> &stmts);
+  void analyze(const Stmt *stmt);
+  std::vector<size_t> eval(const Expr *expr);
+  size_t node();
+  size_t local(Ident name);
+  void flow(const std::vector<size_t> &from, size_t to, bool call = false);
+  void call(const Call *expr, const std::vector<const FuncStmt *> &callees,
+            const std::vector<size_t> &receiver);
+  uint32_t array_elems(const VarStmt *stmt) const;
+  bool escapes(const Site &site) const;
+};
+
+#endif // _NL_ESCAPE_ANALYSIS_H_
@@ -0,0 +1,39 @@
+#ifndef _NL_EXPR_MAP_H_
+#define _NL_EXPR_MAP_H_
+
+#include <cstddef>
+#include <vector>
+
+#include "expr.h"
+
+/*
+ * Side table of per-expression analysis results, indexed by Expr::id.
+ * The parser numbers expressions densely, so lookups are a bounds check
+ * and an array index rather than a tree walk keyed by pointer.
+ *
+ * Unnumbered expressions (id 0) all share one slot; only sentinels are
+ * left unnumbered, and nothing is recorded against them.
+ */
+template <typename T> class ExprMap {
+public:
+  /* Grows the table as needed; missing entries are value-initialized. */
+  T &operator[](const Expr *expr) {
+    if (expr->id >= slots.size()) {
+      slots.resize(expr->id + 1);
+    }
+    return slots[expr->id];
+  }
+
+  /* The entry for expr, or T() if nothing was recorded. */
+  T get(const Expr *expr) const {
+    return expr->id < slots.size() ? slots[expr->id] : T();
+  }
+
+  /* Makes room for expressions numbered below count. */
+  void reserve(size_t count) { slots.reserve(count); }
+
+private:
+  std::vector<T> slots;
+};
+
+#endif // _NL_EXPR_MAP_H_
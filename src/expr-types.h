@@ -1,12 +1,9 @@
 #ifndef _NL_EXPR_TYPES_H_
 #define _NL_EXPR_TYPES_H_
 
-#include <map>
-#include <memory>
-
-#include "expr.h"
+#include "expr-map.h"
 #include "type.h"
 
-using ExprTypes = std::map<const Expr *, NLType>;
+using ExprTypes = ExprMap<NLType>;
 
 #endif // _NL_EXPR_TYPES_H_
@@ -5,6 +5,7 @@
 #include "type.h"
 #include "visitor.h"
 
+#include <cstdint>
 #include <memory>
 #include <string>
 #include <vector>
@@ -13,6 +14,10 @@ using std::string;
 
 class Expr {
 public:
+  // Dense index into ExprMap side tables, assigned by the parser. Numbering
+  // starts at 1; 0 marks an expression the parser didn't create.
+  uint32_t id = 0;
+
   virtual void accept(ExprVisitor<void> *visitor) const = 0;
   virtual string accept(ExprVisitor<string> *visitor) const = 0;
 
@@ -1,5 +1,6 @@
 #include <iostream>
 #include <map>
+#include <set>
 #include <sstream>
 #include <string>
 #include <vector>
@@ -11,8 +12,9 @@
 #include "symtab.h"
 #include "type.h"
 
-void GlobalHoister::declare(const std::string &type_name) {
-  typetab()->insert(type_name, std::make_shared<Type>(type_name));
+void GlobalHoister::declare(Ident type_name) {
+  typetab().insert(type_name,
+                    std::make_shared<Type>(Interner::str(type_name)));
 }
 
 void GlobalHoister::hoist_program(const std::vector<Stmt *> statements) {
@@ -21,6 +23,12 @@ void GlobalHoister::hoist_program(const std::vector<Stmt *> statements) {
 
   decl_only_pass = false;
   hoist(statements);
+  check_struct_cycles();
+
+  // Every class is complete now, so layouts can be fixed.
+  for (const NLType &cls : classes) {
+    cls->finalize();
+  }
 }
 
 void GlobalHoister::hoist(const std::vector<Stmt *> statements) {
@@ -32,34 +40,41 @@ void GlobalHoister::hoist(const std::vector<Stmt *> statements) {
 void GlobalHoister::hoist(const Stmt *stmt) { stmt->accept(this); }
 
 void GlobalHoister::visit(const ClassStmt *cls) {
-  const std::string cls_name = cls->name.lexeme;
+  const Ident cls_name = cls->name.id;
 
   if (decl_only_pass) {
     declare(cls_name); // store a pointer to this type to hoist later
+    // Fields of any class may be structs declared after it.
+    typetab().get(cls_name)->is_struct = cls->is_struct;
     return;
   }
 
   // Insert a symbol (of Class type)
-  Symbol symbol{cls_name, Primitives::Class()};
-  symtab()->insert(cls_name, symbol);
+  Symbol symbol{cls->name.lexeme(), Primitives::Class()};
+  symtab().insert(cls_name, symbol);
 
   NLType cls_type;
-  if (typetab()->contains(cls_name)) {
-    cls_type = typetab()->get(cls_name);
+  if (typetab().contains(cls_name)) {
+    cls_type = typetab().get(cls_name);
   } else {
-    cls_type = std::make_shared<Type>(cls_name);
-    typetab()->insert(cls_name, cls_type);
+    cls_type = std::make_shared<Type>(cls->name.lexeme());
+    typetab().insert(cls_name, cls_type);
   }
+  classes.push_back(cls_type);
 
   // Supertype
   if (cls->superclass) {
-    std::string supercls_name = cls->superclass->lexeme;
-    if (!typetab()->contains(supercls_name)) {
+    Ident supercls_name = cls->superclass->id;
+    if (!typetab().contains(supercls_name)) {
       Neeilang::error(*cls->superclass, "Unknown superclass");
       return;
     }
 
-    NLType supercls = typetab()->get(supercls_name);
+    NLType supercls = typetab().get(supercls_name);
+    if (supercls->is_struct) {
+      Neeilang::error(*cls->superclass, "Structs cannot be extended");
+      return;
+    }
 
     // Circular inheritance is an error.
     if (supercls->subclass_of(cls_type.get())) {
@@ -72,23 +87,32 @@ void GlobalHoister::visit(const ClassStmt *cls) {
 
   // Fields
   for (size_t i = 0; i < cls->fields.size(); i++) {
-    std::string field_name = cls->fields[i].lexeme;
-    std::string field_type_name = cls->field_types[i].name.lexeme;
+    const std::string &field_name = cls->fields[i].lexeme();
+    Ident field_type_name = cls->field_types[i].name.id;
 
-    if (!typetab()->contains(field_type_name)) {
+    if (!typetab().contains(field_type_name)) {
       Neeilang::error(cls->field_types[i].name, "Unknown type in field");
       return;
     }
 
-    NLType field_type = typetab()->get(field_type_name);
+    NLType field_type = typetab().get(field_type_name);
+
+    field_type = array_of(field_type, cls->field_types[i]);
 
-    TypeParse field_tp = cls->field_types[i];
-    if (field_tp.is_array()) {
-      field_type = Primitives::Array(field_type, field_tp.array_dims());
+    // Structs hold no references, so the collector never looks in them.
+    if (cls->is_struct && field_type != Primitives::Int() &&
+        field_type != Primitives::Float() &&
+        field_type != Primitives::Bool() && !field_type->is_struct) {
+      Neeilang::error(cls->field_types[i].name,
+                      "Struct fields must be Int, Float, Bool or structs");
+      return;
     }
 
     cls_type->fields.push_back(Field{field_name, field_type});
   }
+  if (cls->is_struct) {
+    structs.push_back(cls);
+  }
 
   // Methods
   NLType old_encl_class = encl_class;
@@ -99,13 +123,53 @@ void GlobalHoister::visit(const ClassStmt *cls) {
   encl_class = old_encl_class;
 }
 
-void GlobalHoister::hoist_type(const std::string &type) {
-  if (typetab()->contains(type))
+/* A struct stored inline in itself, directly or through other structs,
+ would be infinitely large. */
+void GlobalHoister::check_struct_cycles() {
+  for (const ClassStmt *cls : structs) {
+    const Type *start = typetab().get(cls->name.id).get();
+    std::vector<const Type *> pending = {start};
+    std::set<const Type *> seen;
+    while (!pending.empty()) {
+      const Type *t = pending.back();
+      pending.pop_back();
+      for (const Field &field : t->fields) {
+        if (field.type.get() == start) {
+          Neeilang::error(cls->name, "Struct contains itself");
+          pending.clear();
+          break;
+        }
+        if (field.type->is_struct && seen.insert(field.type.get()).second) {
+          pending.push_back(field.type.get());
+        }
+      }
+    }
+  }
+}
+
+void GlobalHoister::hoist_type(Ident type) {
+  if (typetab().contains(type))
     return;
 
   // This could be an array type.
 }
 
+/* The type tp names, given the type its name resolved to: an array of
+ elem_type if tp has dimensions. */
+NLType GlobalHoister::array_of(NLType elem_type, const TypeParse &tp) {
+  if (!tp.is_array()) {
+    if (tp.soa) {
+      Neeilang::error(tp.name, "Only arrays can be soa");
+    }
+    return elem_type;
+  }
+  // Object elements are references, which a column per field can't give.
+  if (tp.soa && !elem_type->is_struct) {
+    Neeilang::error(tp.name, "Only arrays of structs can be soa");
+  }
+  return Primitives::Array(elem_type, tp.array_dims(), tp.soa);
+}
+
 void GlobalHoister::visit(const FuncStmt *stmt) {
   // Need types to be declared in first pass, since they
   // may be used in the function.
@@ -113,38 +177,31 @@ void GlobalHoister::visit(const FuncStmt *stmt) {
     return;
   }
 
-  const std::string fn_name = stmt->name.lexeme;
-  const std::string return_type_name = stmt->return_type.name.lexeme;
-  hoist_type(return_type_name);
+  const std::string &fn_name = stmt->name.lexeme();
+  hoist_type(stmt->return_type.name.id);
 
   std::shared_ptr<FuncType> functype = std::make_shared<FuncType>();
   functype->name = fn_name; // TODO: Constructor this.
 
   bool had_error = false;
 
-  if (!typetab()->contains(stmt->return_type.name.lexeme)) {
+  if (!typetab().contains(stmt->return_type.name.id)) {
     Neeilang::error(stmt->return_type.name,
-                    "Unknown return type " + stmt->return_type.name.lexeme);
+                    "Unknown return type " + stmt->return_type.name.lexeme());
     had_error = true;
   } else {
-    functype->return_type = typetab()->get(stmt->return_type.name.lexeme);
-    if (stmt->return_type.is_array()) {
-      functype->return_type = Primitives::Array(functype->return_type,
-                                                stmt->return_type.array_dims());
-    }
+    functype->return_type = array_of(
+        typetab().get(stmt->return_type.name.id), stmt->return_type);
   }
 
   for (TypeParse param_tp : stmt->parameter_types) {
-    hoist_type(param_tp.name.lexeme);
-    if (!typetab()->contains(param_tp.name.lexeme)) {
+    hoist_type(param_tp.name.id);
+    if (!typetab().contains(param_tp.name.id)) {
       Neeilang::error(param_tp.name, "Unknown parameter type");
       had_error = true;
     } else {
-      NLType param_type = typetab()->get(param_tp.name.lexeme);
-      if (param_tp.is_array()) {
-        param_type = Primitives::Array(param_type, param_tp.array_dims());
-      }
-      functype->arg_types.push_back(param_type);
+      functype->arg_types.push_back(
+          array_of(typetab().get(param_tp.name.id), param_tp));
     }
   }
 
@@ -157,9 +214,9 @@ void GlobalHoister::visit(const FuncStmt *stmt) {
     encl_class->methods.push_back(functype);
   } else {
     // Regular (global) function
-    const std::string fn_key = TypeTableUtil::fn_key(stmt);
+    const Ident fn_key = TypeTableUtil::fn_key(stmt);
     declare(fn_key);
-    typetab()->get(fn_key)->functype = functype;
+    typetab().get(fn_key)->functype = functype;
   }
 
   hoist(stmt->body);
@@ -179,11 +236,13 @@ void GlobalHoister::visit(const VarStmt *stmt) {
     return;
   }
 
-  const std::string type = stmt->tp.name.lexeme;
+  const Ident type = stmt->tp.name.id;
 
   hoist_type(type);
-  if (!typetab()->contains(type)) {
+  if (!typetab().contains(type)) {
     Neeilang::error(stmt->tp.name, "Unknown type in variable declaration.");
+  } else {
+    array_of(typetab().get(type), stmt->tp);
   }
 }
 
@@ -21,11 +21,11 @@
 class GlobalHoister : public StmtVisitor<void> {
 public:
   GlobalHoister(ScopeManager &sm) : sm(sm) {
-    typetab()->insert("String", Primitives::String());
-    typetab()->insert("Int", Primitives::Int());
-    typetab()->insert("Float", Primitives::Float());
-    typetab()->insert("Bool", Primitives::Bool());
-    typetab()->insert("Void", Primitives::Void());
+    typetab().insert(ID_STRING, Primitives::String());
+    typetab().insert(ID_INT, Primitives::Int());
+    typetab().insert(ID_FLOAT, Primitives::Float());
+    typetab().insert(ID_BOOL, Primitives::Bool());
+    typetab().insert(ID_VOID, Primitives::Void());
   }
 
   void hoist_program(const std::vector<Stmt *> statements);
@@ -33,17 +33,21 @@ public:
   OVERRIDE_STMT_VISITOR_FNS(void)
 
 private:
-  ScopeManager sm;
+  ScopeManager &sm;
   bool decl_only_pass;
   NLType encl_class;
+  std::vector<NLType> classes; // Finalized once hoisting is done.
+  std::vector<const ClassStmt *> structs;
 
   void hoist(const std::vector<Stmt *> statements);
   void hoist(const Stmt *stmt);
-  void hoist_type(const std::string &type);
-  void declare(const std::string &type_name);
+  void hoist_type(Ident type);
+  NLType array_of(NLType elem_type, const TypeParse &tp);
+  void declare(Ident type_name);
+  void check_struct_cycles();
 
-  std::shared_ptr<TypeTable> typetab() { return sm.current().typetab; }
-  std::shared_ptr<SymbolTable> symtab() { return sm.current().symtab; }
+  TypeTable &typetab() { return sm.types; }
+  SymbolTable &symtab() { return sm.symbols; }
 };
 
 #endif //_NL_GLOBAL_HOISTER_H_
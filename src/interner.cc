@@ -0,0 +1,106 @@
+#include <cassert>
+#include <deque>
+#include <vector>
+
+#include "interner.h"
+
+namespace {
+
+/*
+ * Open-addressed table of (hash, id) pairs with linear probing. Every
+ * token the scanner sees but does not recognise on its own goes through
+ * here, so this avoids the node-per-entry layout of std::unordered_map:
+ * a probe touches one slot, plus the candidate string on a hash match.
+ */
+struct InternTable {
+  struct Slot {
+    uint32_t hash;
+    Ident id; // NO_ID if empty
+  };
+
+  static const Ident NO_ID = ~0u;
+
+  // A deque never relocates its elements, so references handed out by
+  // Interner::str stay valid as the table grows.
+  std::deque<std::string> strings;
+  std::vector<Slot> slots;
+  size_t mask;
+
+  InternTable() : slots(1024, Slot{0, NO_ID}), mask(1023) {
+    static const char *well_known[] = {
+        "",       "and",    "class", "else",  "false", "fn",     "lambda",
+        "for",    "if",     "nil",   "or",    "print", "return", "struct",
+        "super",  "this",   "true",  "var",   "while", "init",   "String",
+        "Int",    "Float",  "Bool",  "Void",  "size",   "soa"};
+    static_assert(sizeof(well_known) / sizeof(well_known[0]) ==
+                      NUM_WELL_KNOWN_IDENTS,
+                  "well-known identifier table out of sync");
+
+    for (const char *name : well_known) {
+      intern(name);
+    }
+  }
+
+  // FNV-1a. Lexemes are short, so a byte loop is as fast as anything.
+  static uint32_t hash(std::string_view text) {
+    uint32_t h = 2166136261u;
+    for (unsigned char c : text) {
+      h = (h ^ c) * 16777619u;
+    }
+    return h;
+  }
+
+  Ident intern(std::string_view text) {
+    const uint32_t h = hash(text);
+    size_t i = h & mask;
+    for (; slots[i].id != NO_ID; i = (i + 1) & mask) {
+      if (slots[i].hash == h && strings[slots[i].id] == text) {
+        return slots[i].id;
+      }
+    }
+
+    Ident id = strings.size();
+    strings.emplace_back(text);
+    slots[i] = Slot{h, id};
+
+    // Keep the load factor under 1/2 so probe runs stay short.
+    if (strings.size() * 2 > slots.size()) {
+      grow();
+    }
+    return id;
+  }
+
+  void grow() {
+    std::vector<Slot> old(slots.size() * 2, Slot{0, NO_ID});
+    old.swap(slots);
+    mask = slots.size() - 1;
+    for (const Slot &slot : old) {
+      if (slot.id == NO_ID)
+        continue;
+      size_t i = slot.hash & mask;
+      while (slots[i].id != NO_ID) {
+        i = (i + 1) & mask;
+      }
+      slots[i] = slot;
+    }
+  }
+};
+
+InternTable &table() {
+  static InternTable table;
+  return table;
+}
+
+} // namespace
+
+namespace Interner {
+
+Ident intern(std::string_view text) { return table().intern(text); }
+
+const std::string &str(Ident id) {
+  InternTable &t = table();
+  assert(id < t.strings.size() && "Unknown identifier");
+  return t.strings[id];
+}
+
+} // namespace Interner
@@ -0,0 +1,62 @@
+#ifndef _NL_INTERNER_H_
+#define _NL_INTERNER_H_
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+/*
+ * Every distinct lexeme is stored exactly once and named by a small
+ * integer, so identifiers can be copied and compared as integers.
+ */
+using Ident = uint32_t;
+
+namespace Interner {
+/* Returns the ID of text, interning a copy of it if it's new. */
+Ident intern(std::string_view text);
+
+/* The text of an interned ID. Valid for the lifetime of the process. */
+const std::string &str(Ident id);
+} // namespace Interner
+
+/*
+ * Names the compiler itself cares about are interned up front, in this
+ * order, so they can be compared against without a lookup.
+ */
+enum WellKnownIdent : Ident {
+  ID_EMPTY,
+
+  // Reserved words, in the same order as their TokenTypes.
+  ID_AND,
+  ID_CLASS,
+  ID_ELSE,
+  ID_FALSE,
+  ID_FN,
+  ID_LAMBDA,
+  ID_FOR,
+  ID_IF,
+  ID_NIL,
+  ID_OR,
+  ID_PRINT,
+  ID_RETURN,
+  ID_STRUCT,
+  ID_SUPER,
+  ID_THIS,
+  ID_TRUE,
+  ID_VAR,
+  ID_WHILE,
+
+  // Built-in names.
+  ID_INIT,
+  ID_STRING,
+  ID_INT,
+  ID_FLOAT,
+  ID_BOOL,
+  ID_VOID,
+  ID_SIZE, // Of arrays.
+  ID_SOA,  // Array layout annotation.
+
+  NUM_WELL_KNOWN_IDENTS
+};
+
+#endif // _NL_INTERNER_H_
@@ -1,18 +1,24 @@
-#include <fstream>
 #include <iostream>
 #include <memory>
-#include <sstream>
 #include <string>
 #include <vector>
 
+#include "array-bounds.h"
 #include "ast-printer.h"
+#include "class-hierarchy.h"
+#include "compilation-unit.h"
+#include "constant-folding.h"
+#include "escape-analysis.h"
 #include "global-hoister.h"
 #include "neeilang.h"
 #include "parser.h"
+#include "pass-timer.h"
 #include "reachability.h"
 #include "resolver.h"
 #include "scanner.h"
 #include "scope-manager.h"
+#include "source-buffer.h"
+#include "stats.h"
 #include "token.h"
 #include "type-checker.h"
 
@@ -23,39 +29,94 @@
 #endif
 
 bool Neeilang::had_error = false;
+int Neeilang::program_status = 0;
 
-void Neeilang::run_file(const char *path) {
-  const std::ifstream file(path);
-  std::stringstream src_buffer;
+void Neeilang::run_file(const char *path, const Options &options) {
+  SourceBuffer source;
+  if (!source.load(path)) {
+    std::cerr << "Could not read '" << path << "'" << std::endl;
+    exit(66); // cannot open input
+  }
+
+  if (options.time_passes || !options.trace_file.empty()) {
+    PassTimers::enable();
+  }
 
-  src_buffer << file.rdbuf();
+  run(source.text(), options);
 
-  run(src_buffer.str());
+  if (options.time_passes) {
+    PassTimers::print_report(std::cerr);
+  }
+  if (!options.trace_file.empty() &&
+      !PassTimers::write_trace(options.trace_file.c_str())) {
+    std::cerr << "Could not write '" << options.trace_file << "'"
+              << std::endl;
+  }
 
   if (had_error)
     exit(65); // data format error
+  if (program_status)
+    exit(program_status);
 }
 
-void Neeilang::run(const std::string &source) {
-  Scanner scanner(source);
-  const std::vector<Token> tokens = scanner.scan_tokens();
+void Neeilang::run(std::string_view source, const Options &options) {
+  CompilationUnit unit;
+  const double lex_start = Stats::now_ms();
 
-  // for (Token t : tokens) {
+  {
+    PassTimer timer("Lexing");
+    Scanner scanner(source);
+    unit.tokens = scanner.scan_tokens();
+  }
+
+  const double parse_start = Stats::now_ms();
+
+  if (options.stop_after == Options::LEX) {
+    if (options.stats) {
+      std::cerr << "lex time       : " << parse_start - lex_start << " ms"
+                << std::endl
+                << "tokens         : " << unit.tokens.size() << std::endl;
+    }
+    return;
+  }
+
+  // for (Token t : unit.tokens) {
   //   std::cout << t.str() << std::endl;
   // }
 
-  Parser parser(tokens);
-  std::vector<Stmt *> program = parser.parse();
+  {
+    PassTimer timer("Parsing");
+    Parser parser(unit.tokens, unit.arena);
+    unit.program = parser.parse();
+    unit.num_exprs = parser.expr_count();
+  }
+  std::vector<Stmt *> &program = unit.program;
+
+  if (options.stats) {
+    std::cerr << "lex time       : " << parse_start - lex_start << " ms"
+              << std::endl
+              << "parse time     : " << Stats::now_ms() - parse_start
+              << " ms" << std::endl
+              << "tokens         : " << unit.tokens.size() << std::endl
+              << "AST nodes      : " << unit.arena.objects() << std::endl
+              << "AST bytes      : " << unit.arena.bytes_used() << " ("
+              << unit.arena.bytes_reserved() << " reserved)" << std::endl
+              << "peak RSS       : " << Stats::peak_rss_kb() << " KiB"
+              << std::endl;
+  }
 
-  if (had_error) {
+  if (had_error || options.stop_after == Options::PARSE) {
     return;
   }
 
   // AstPrinter printer;
   // std::cerr << printer.print(program);
 
-  Resolver resolver;
-  resolver.resolve_program(program);
+  {
+    PassTimer timer("Name resolution");
+    Resolver resolver(unit.num_exprs);
+    resolver.resolve_program(program);
+  }
 
   if (had_error) {
     return;
@@ -63,39 +124,100 @@ void Neeilang::run(const std::string &source) {
 
   ScopeManager scope_manager;
 
-  GlobalHoister hoister(scope_manager);
-  hoister.hoist_program(program);
+  {
+    PassTimer timer("Global hoisting");
+    GlobalHoister hoister(scope_manager);
+    hoister.hoist_program(program);
+  }
 
   if (had_error) {
     return;
   }
 
-  NL::Reachability dce;
-  dce.analyze_program(program);
+  {
+    PassTimer timer("Reachability analysis");
+    NL::Reachability dce;
+    dce.analyze_program(program);
+  }
 
   if (had_error) {
     return;
   }
 
-  TypeChecker type_checker(scope_manager);
-  type_checker.check(program);
+  TypeChecker type_checker(scope_manager, unit.num_exprs);
+  {
+    PassTimer timer("Type checking");
+    type_checker.check(program);
+  }
 
   if (had_error) {
     return; // Compilation halted due to type errors.
   }
 
+  ConstantFolding consts(type_checker.get_expr_types());
+  {
+    PassTimer timer("Constant folding");
+    consts.analyze_program(program);
+  }
+
+  ClassHierarchy cha(scope_manager, type_checker.get_expr_types());
+  {
+    PassTimer timer("Class hierarchy analysis");
+    cha.analyze_program(program);
+  }
+
+  ArrayBounds bounds(type_checker.get_expr_types());
+  {
+    PassTimer timer("Bounds check elimination");
+    bounds.analyze_program(program);
+  }
+
+  EscapeAnalysis escapes(type_checker.get_expr_types());
+  {
+    PassTimer timer("Escape analysis");
+    escapes.analyze_program(program);
+  }
+
+  if (options.stats) {
+    std::cerr << "folded exprs   : " << consts.num_folded() << " ("
+              << consts.num_pruned() << " branches pruned)" << std::endl
+              << "bounds checks  : " << bounds.num_checks() << " ("
+              << bounds.num_eliminated() << " eliminated)" << std::endl
+              << "allocations    : " << escapes.num_allocs() << " ("
+              << escapes.num_on_stack() << " on the stack)" << std::endl;
+  }
+
+  PassTimer timer("Code generation");
 #ifdef TARGET_X86
-  x86_64::CodeGen codegen(type_checker.get_expr_types(), scope_manager);
+  x86_64::CodeGen codegen(type_checker.get_expr_types(), scope_manager, consts,
+                          cha, bounds, escapes);
   codegen.generate(program);
   codegen.dump();
 #else
-  CodeGen codegen(scope_manager, type_checker.get_expr_types());
+  CodeGen codegen(scope_manager, type_checker.get_expr_types(), consts, cha,
+                  bounds, escapes);
+  if (!options.profile_generate.empty()) {
+    codegen.instrument_calls(options.profile_generate);
+  }
+  if (!options.profile_use.empty() &&
+      !codegen.use_profile(options.profile_use)) {
+    had_error = true;
+    return;
+  }
   codegen.generate(program);
 
   if (!had_error)
   {
+    codegen.optimize(options.opt_level);
     // codegen.print();
-    codegen.write_bitcode();
+    if (options.run != Options::NO_RUN) {
+      if (!codegen.run_jit(options.run == Options::RUN_LAZY,
+                           program_status)) {
+        had_error = true;
+      }
+    } else if (!codegen.write_output(options.emit, options.output_file)) {
+      had_error = true;
+    }
   }
 #endif
 }
@@ -108,7 +230,7 @@ void Neeilang::error(Token token, const std::string &message) {
   if (token.type == END_OF_FILE) {
     report(token.line, " at end", message);
   } else {
-    report(token.line, " at '" + token.lexeme + "'", message);
+    report(token.line, " at '" + token.lexeme() + "'", message);
   }
 }
 
@@ -2,14 +2,17 @@
 #define _NL_NEEILANG_H_
 
 #include <string>
+#include <string_view>
 
+#include "options.h"
 #include "token.h"
 
 class Neeilang {
 public:
-  static void run_file(const char *path);
+  static void run_file(const char *path, const Options &options = Options());
 
-  static void run(const std::string &source);
+  static void run(std::string_view source,
+                  const Options &options = Options());
 
   static void error(int line, const std::string &message);
 
@@ -17,6 +20,7 @@ public:
 
 private:
   static bool had_error;
+  static int program_status; // What main returned, with --run.
 
   static void report(int line, const std::string &occurrence,
                      const std::string &message);
@@ -0,0 +1,38 @@
+#ifndef _NL_OPTIONS_H_
+#define _NL_OPTIONS_H_
+
+#include <string>
+
+/* Settings controlled from the command line. */
+struct Options {
+  // --stop-after=<phase> : end compilation early (for benchmarking).
+  enum Phase { ALL, LEX, PARSE };
+
+  bool stats = false; // --stats : report front-end memory/timing to stderr
+  Phase stop_after = ALL;
+
+  bool time_passes = false; // --time-passes : per-pass time/allocation report
+  std::string trace_file;   // --trace=<file> : Chrome trace-event JSON
+
+  unsigned opt_level = 0; // -O<0-3> : LLVM optimization level
+
+  // --emit=<kind> : what the LLVM backend writes (the x86-64 backend always
+  // prints assembly).
+  enum Emit { BITCODE, IR, ASSEMBLY, OBJECT, EXECUTABLE };
+  Emit emit = BITCODE;
+  std::string output_file; // -o <file> : defaults to out.bc, out.ll, ...
+
+  // --run[=eager] : JIT-compile the program and run it instead of writing
+  // any output. Functions are compiled on first call unless eager.
+  enum Run { NO_RUN, RUN_LAZY, RUN_EAGER };
+  Run run = NO_RUN;
+
+  // --profile-generate[=<file>] : make the program count the receiver
+  // classes of its virtual calls and write them to file (default.nlprof)
+  // when it exits. --profile-use=<file> : compile with those counts,
+  // calling the usual receiver's method directly when its vtable matches.
+  std::string profile_generate;
+  std::string profile_use;
+};
+
+#endif // _NL_OPTIONS_H_
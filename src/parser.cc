@@ -1,6 +1,7 @@
 #include <memory>
 #include <vector>
 
+#include "arena.h"
 #include "neeilang.h"
 #include "parser.h"
 #include "stmt.h"
@@ -26,6 +27,8 @@ Stmt *Parser::declaration() {
     return func_statement("function");
   if (match({CLASS}))
     return class_declaration();
+  if (match({STRUCT}))
+    return class_declaration(true);
   if (match({VAR})) {
     return var_declaration();
   } else {
@@ -33,8 +36,14 @@ Stmt *Parser::declaration() {
   }
 }
 
-TypeParse Parser::parse_type(const std::string &msg) {
+TypeParse Parser::parse_type(std::string_view msg) {
   TypeParse tp;
+  // 'soa' is only special before a type name, so it stays usable as one.
+  if (check(IDENTIFIER) && peek().id == ID_SOA &&
+      peek_ahead().type == IDENTIFIER) {
+    advance();
+    tp.soa = true;
+  }
   tp.name = consume(IDENTIFIER, msg);
 
   while (match({LEFT_BRACKET})) {
@@ -66,19 +75,21 @@ Stmt *Parser::var_declaration() {
   }
   consume(SEMICOLON, "Expect ';' after variable declaration.");
 
-  return new VarStmt(name, tp, initializer);
+  return arena.make<VarStmt>(name, tp, initializer);
 }
 
-Stmt *Parser::class_declaration() {
-  Token name = consume(IDENTIFIER, "Expect class name.");
-  const std::string *prev_outer_class = outer_class;
-  outer_class = &name.lexeme;
+Stmt *Parser::class_declaration(bool is_struct) {
+  Token name = consume(IDENTIFIER, is_struct ? "Expect struct name."
+                                             : "Expect class name.");
+  Ident prev_outer_class = outer_class;
+  outer_class = name.id;
 
   Token *superclass = nullptr;
 
-  if (match({LESS})) {
+  // Structs can't be extended, nor extend anything.
+  if (!is_struct && match({LESS})) {
     consume(IDENTIFIER, "Expect superclass name.");
-    superclass = new Token(previous());
+    superclass = arena.make<Token>(previous());
   }
 
   consume(LEFT_BRACE, "Expect '{' before class body.");
@@ -92,6 +103,8 @@ Stmt *Parser::class_declaration() {
       VarStmt *stmt = static_cast<VarStmt *>(var_declaration());
       fields.push_back(stmt->name);
       field_types.push_back(stmt->tp);
+    } else if (is_struct) {
+      throw error(peek(), "Structs can only have fields.");
     } else {
       methods.push_back(func_statement("method"));
     }
@@ -100,7 +113,8 @@ Stmt *Parser::class_declaration() {
   consume(RIGHT_BRACE, "Expect '}' after class body.");
 
   outer_class = prev_outer_class;
-  return new ClassStmt(name, superclass, fields, field_types, methods);
+  return arena.make<ClassStmt>(name, superclass, fields, field_types, methods,
+                               is_struct);
 }
 
 Stmt *Parser::statement() {
@@ -125,7 +139,7 @@ Stmt *Parser::statement() {
 Stmt *Parser::print_statement(const Token keyword) {
   const Expr *value = expression();
   consume(SEMICOLON, "Expect ';' after value.");
-  return new PrintStmt(keyword, value);
+  return arena.make<PrintStmt>(keyword, value);
 }
 
 Stmt *Parser::return_statement() {
@@ -137,7 +151,7 @@ Stmt *Parser::return_statement() {
   }
 
   consume(SEMICOLON, "Expect ';' after return value.");
-  return new ReturnStmt(keyword, value);
+  return arena.make<ReturnStmt>(keyword, value);
 }
 
 Stmt *Parser::block_statement() {
@@ -149,7 +163,7 @@ Stmt *Parser::block_statement() {
 
   consume(RIGHT_BRACE, "Expect '}' after block.");
 
-  return new BlockStmt(stmts);
+  return arena.make<BlockStmt>(stmts);
 }
 
 Stmt *Parser::if_statement(Token keyword) {
@@ -160,7 +174,7 @@ Stmt *Parser::if_statement(Token keyword) {
   Stmt *then_branch = statement();
   Stmt *else_branch = match({ELSE}) ? statement() : nullptr;
 
-  return new IfStmt(keyword, condition, then_branch, else_branch);
+  return arena.make<IfStmt>(keyword, condition, then_branch, else_branch);
 }
 
 Stmt *Parser::while_statement(Token while_tok) {
@@ -170,7 +184,7 @@ Stmt *Parser::while_statement(Token while_tok) {
 
   consume(LEFT_BRACE, "Expect '{' after while condition.");
   Stmt *body = block_statement();
-  return new WhileStmt(while_tok, condition, body);
+  return arena.make<WhileStmt>(while_tok, condition, body);
 }
 
 /*
@@ -206,17 +220,18 @@ Stmt *Parser::for_statement(Token for_tok) {
 
   // Construct block stmt with initializer + desugared while-loop
   if (increment) {
-    body = new BlockStmt({body, new ExprStmt(increment, rparen)});
+    body = arena.make<BlockStmt>(std::vector<Stmt *>{
+        body, arena.make<ExprStmt>(increment, rparen)});
   }
 
   if (!condition) {
-    condition = new BoolLiteral(true);
+    condition = make_expr<BoolLiteral>(true);
   }
 
-  body = new WhileStmt(for_tok, condition, body);
+  body = arena.make<WhileStmt>(for_tok, condition, body);
 
   if (initializer) {
-    body = new BlockStmt({initializer, body});
+    body = arena.make<BlockStmt>(std::vector<Stmt *>{initializer, body});
   }
 
   return body;
@@ -247,8 +262,8 @@ Stmt *Parser::func_statement(std::string kind) {
 
   TypeParse return_type;
 
-  if (outer_class && name.lexeme == "init") {
-    return_type.name = Token(IDENTIFIER, *outer_class, "", -1);
+  if (outer_class != ID_EMPTY && name.id == ID_INIT) {
+    return_type.name = Token(IDENTIFIER, 0, 0, outer_class, -1);
     consume(LEFT_BRACE, "Expect '{' before init body. Note: Return type is not "
                         "declared for init methods");
   } else {
@@ -260,13 +275,14 @@ Stmt *Parser::func_statement(std::string kind) {
   std::vector<Stmt *> body;
   body.push_back(block_statement());
 
-  return new FuncStmt(name, parameters, parameter_types, return_type, body);
+  return arena.make<FuncStmt>(name, parameters, parameter_types, return_type,
+                              body);
 }
 
 Stmt *Parser::expression_statement() {
   Expr *value = expression();
-  Token &sc = consume(SEMICOLON, "Expect ';' after expression.");
-  return new ExprStmt(value, sc);
+  const Token &sc = consume(SEMICOLON, "Expect ';' after expression.");
+  return arena.make<ExprStmt>(value, sc);
 }
 
 Expr *Parser::expression() { return assignment(); }
@@ -283,13 +299,14 @@ Expr *Parser::assignment() {
 
     if (expr->lvalue()) {
       Variable *variable = dynamic_cast<Variable *>(expr);
-      return new Assignment(variable->name, *value);
+      return make_expr<Assignment>(variable->name, *value);
     } else if (expr->is_object_field()) {
       Get *get = static_cast<Get *>(expr);
-      return new Set(get->callee, get->name, *value);
+      return make_expr<Set>(get->callee, get->name, *value);
     } else if (expr->is_indexed()) {
       GetIndex *get = static_cast<GetIndex *>(expr);
-      return new SetIndex(get->callee, get->bracket, get->index, *value);
+      return make_expr<SetIndex>(get->callee, get->bracket, get->index,
+                                  *value);
     }
 
     Neeilang::error(equals, "Invalid assignment target.");
@@ -306,7 +323,7 @@ Expr *Parser::logical_or() {
   while (match({OR})) {
     Token op = previous();
     Expr *right = logical_and();
-    expr = new Logical(*expr, op, *right);
+    expr = make_expr<Logical>(*expr, op, *right);
   }
 
   return expr;
@@ -318,7 +335,7 @@ Expr *Parser::logical_and() {
   while (match({AND})) {
     Token op = previous();
     Expr *right = equality();
-    expr = new Logical(*expr, op, *right);
+    expr = make_expr<Logical>(*expr, op, *right);
   }
 
   return expr;
@@ -330,13 +347,13 @@ Expr *Parser::equality() {
   while (match({BANG_EQUAL, EQUAL_EQUAL})) {
     Token op = previous();
     Expr *right = comparison();
-    expr = (new Binary(*expr, op, *right));
+    expr = make_expr<Binary>(*expr, op, *right);
   }
 
   return expr;
 }
 
-bool Parser::match(const std::vector<TokenType> &types) {
+bool Parser::match(std::initializer_list<TokenType> types) {
   for (const TokenType &type : types) {
     if (check(type)) {
       advance();
@@ -353,7 +370,7 @@ bool Parser::check(const TokenType &type) {
   return peek().type == type;
 }
 
-Token &Parser::advance() {
+const Token &Parser::advance() {
   if (!at_end())
     current++;
   return previous();
@@ -362,9 +379,9 @@ Token &Parser::advance() {
 bool Parser::at_end() { return peek().type == END_OF_FILE; }
 
 /* Current (unconsumed) token */
-Token &Parser::peek() { return tokens[current]; }
+const Token &Parser::peek() { return tokens[current]; }
 
-Token &Parser::peek_ahead() {
+const Token &Parser::peek_ahead() {
   if (peek().type != END_OF_FILE) {
     return tokens[current + 1];
   }
@@ -372,15 +389,15 @@ Token &Parser::peek_ahead() {
 }
 
 /* Most recently consumed token */
-Token &Parser::previous() { return tokens[current - 1]; }
+const Token &Parser::previous() { return tokens[current - 1]; }
 
 Expr *Parser::comparison() {
   Expr *expr = addition();
 
   while (match({GREATER, GREATER_EQUAL, LESS, LESS_EQUAL})) {
-    Token &op = previous();
+    const Token &op = previous();
     Expr *right = addition();
-    expr = (new Binary(*expr, op, *right));
+    expr = make_expr<Binary>(*expr, op, *right);
   }
 
   return expr;
@@ -390,9 +407,9 @@ Expr *Parser::addition() {
   Expr *expr = multiplication();
 
   while (match({MINUS, PLUS})) {
-    Token &op = previous();
+    const Token &op = previous();
     Expr *right = multiplication();
-    expr = (new Binary(*expr, op, *right));
+    expr = make_expr<Binary>(*expr, op, *right);
   }
 
   return expr;
@@ -402,9 +419,9 @@ Expr *Parser::multiplication() {
   Expr *expr = unary();
 
   while (match({STAR, SLASH})) {
-    Token &op = previous();
+    const Token &op = previous();
     Expr *right = unary();
-    expr = (new Binary(*expr, op, *right));
+    expr = make_expr<Binary>(*expr, op, *right);
   }
 
   return expr;
@@ -412,9 +429,9 @@ Expr *Parser::multiplication() {
 
 Expr *Parser::unary() {
   if (match({BANG, MINUS})) {
-    Token &op = previous();
+    const Token &op = previous();
     Expr *right = unary(); /* Unary is right-recursive */
-    return (new Unary(op, *right));
+    return make_expr<Unary>(op, *right);
   }
 
   return call();
@@ -438,7 +455,7 @@ Expr *Parser::call() {
       expr = finish_index_get(expr);
     } else if (match({DOT})) {
       Token name = consume(IDENTIFIER, "Expect property name after '.'.");
-      expr = new Get(*expr, name);
+      expr = make_expr<Get>(*expr, name);
     } else {
       break;
     }
@@ -450,7 +467,7 @@ Expr *Parser::call() {
 Expr *Parser::finish_index_get(Expr *expr) {
   Expr *index = expression();
   Token bracket = consume(RIGHT_BRACKET, "Expect ']' after index");
-  return new GetIndex(*expr, bracket, *index);
+  return make_expr<GetIndex>(*expr, bracket, *index);
 }
 
 Expr *Parser::finish_call(Expr *callee) {
@@ -467,44 +484,45 @@ Expr *Parser::finish_call(Expr *callee) {
 
   Token paren = consume(RIGHT_PAREN, "Expect ')' after arguments.");
 
-  return new Call(*callee, paren, args);
+  return make_expr<Call>(*callee, paren, args);
 }
 
 Expr *Parser::primary() {
   if (match({THIS}))
-    return new This(previous());
+    return make_expr<This>(previous());
   if (match({FALSE}))
-    return new BoolLiteral(false);
+    return make_expr<BoolLiteral>(false);
   if (match({TRUE}))
-    return new BoolLiteral(true);
+    return make_expr<BoolLiteral>(true);
   if (match({NIL}))
-    return new StrLiteral("nil", true);
+    return make_expr<StrLiteral>("nil", true);
   if (match({NUMBER})) {
-    return new NumLiteral(previous().literal);
+    return make_expr<NumLiteral>(previous().literal());
   }
   if (match({STRING}))
-    return new StrLiteral(previous().literal);
+    return make_expr<StrLiteral>(previous().literal());
   if (match({IDENTIFIER}))
-    return new Variable(previous());
+    return make_expr<Variable>(previous());
   if (match({LEFT_PAREN})) {
     Expr *expr = expression();
     consume(RIGHT_PAREN, "Expect ')' after expression.");
-    return (new Grouping(*expr));
+    return make_expr<Grouping>(*expr);
   }
   throw error(peek(), "Expect expression.");
 }
 
 /* Error handling and recovery */
 
-Token &Parser::consume(TokenType type, std::string msg) {
+const Token &Parser::consume(TokenType type, std::string_view msg) {
   if (check(type))
     return advance();
   throw error(peek(), msg); /* Report error with current token */
 }
 
-ParseErr Parser::error(Token token, std::string msg) {
-  Neeilang::error(token, msg);
-  return ParseErr(msg);
+ParseErr Parser::error(const Token &token, std::string_view msg) {
+  const std::string message(msg);
+  Neeilang::error(token, message);
+  return ParseErr(message);
 }
 void Parser::synchronize() {
   advance();
@@ -512,6 +530,7 @@ void Parser::synchronize() {
   while (!at_end()) {
     switch (peek().type) {
     case CLASS:
+    case STRUCT:
     case FN:
     case IF:
     case FOR:
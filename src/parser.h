@@ -1,10 +1,15 @@
 #ifndef _NL_PARSER_H_
 #define _NL_PARSER_H_
 
+#include <cstdint>
+#include <initializer_list>
 #include <memory>
 #include <stdexcept>
+#include <string_view>
+#include <utility>
 #include <vector>
 
+#include "arena.h"
 #include "expr.h"
 #include "stmt.h"
 #include "token.h"
@@ -18,24 +23,37 @@ public:
 
 class Parser {
 public:
-  Parser(const std::vector<Token> &tokens) : tokens(tokens) {}
+  Parser(const std::vector<Token> &tokens, Arena &arena)
+      : tokens(tokens), arena(arena) {}
   std::vector<Stmt *> parse();
 
+  /* Expressions are numbered 1..expr_count(). */
+  uint32_t expr_count() const { return num_exprs; }
+
 private:
   int current = 0; // next token to be used
-  std::vector<Token> tokens;
+  const std::vector<Token> &tokens;
+  Arena &arena; // owns every node built by this parser
+  uint32_t num_exprs = 0;
+
+  // Expressions are allocated through here so that they get their ID.
+  template <typename T, typename... Args> T *make_expr(Args &&... args) {
+    T *expr = arena.make<T>(std::forward<Args>(args)...);
+    expr->id = ++num_exprs;
+    return expr;
+  }
 
-  bool match(const std::vector<TokenType> &);
+  bool match(std::initializer_list<TokenType> types);
   bool check(const TokenType &type);
   bool at_end();
-  const std::string *outer_class = nullptr;
+  Ident outer_class = ID_EMPTY;
 
-  Token &advance();
-  Token &consume(TokenType type, std::string msg);
-  Token &peek();
-  Token &peek_ahead();
-  Token &previous();
-  TypeParse parse_type(const std::string &msg);
+  const Token &advance();
+  const Token &consume(TokenType type, std::string_view msg);
+  const Token &peek();
+  const Token &peek_ahead();
+  const Token &previous();
+  TypeParse parse_type(std::string_view msg);
 
   Expr *assignment();
   Expr *logical_or();
@@ -53,7 +71,7 @@ private:
 
   Stmt *declaration();
   Stmt *var_declaration();
-  Stmt *class_declaration();
+  Stmt *class_declaration(bool is_struct = false);
   Stmt *statement();
   Stmt *print_statement(Token keyword);
   Stmt *block_statement();
@@ -64,7 +82,7 @@ private:
   Stmt *return_statement();
   Stmt *func_statement(std::string kind);
 
-  ParseErr error(Token token, std::string msg);
+  ParseErr error(const Token &token, std::string_view msg);
   void synchronize();
 };
 
@@ -0,0 +1,161 @@
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+
+#include "pass-timer.h"
+#include "stats.h"
+
+namespace {
+
+struct PassRecord {
+  const char *name;
+  int depth; // Number of enclosing timers.
+  double start_ms;
+  double end_ms;
+  uint64_t start_allocs;
+  uint64_t allocs;
+  uint64_t start_bytes;
+  uint64_t bytes;
+};
+
+bool timing_enabled = false;
+int depth = 0;
+double epoch_ms = 0;
+std::vector<PassRecord> records;
+
+// A pass that runs several times at the same nesting level is reported
+// once, with its totals.
+struct PassTotal {
+  const char *name;
+  int depth;
+  double ms;
+  uint64_t allocs;
+  uint64_t bytes;
+};
+
+std::vector<PassTotal> totals() {
+  std::vector<PassTotal> out;
+  for (const PassRecord &r : records) {
+    PassTotal *total = nullptr;
+    for (PassTotal &t : out) {
+      if (t.depth == r.depth && std::string(t.name) == r.name) {
+        total = &t;
+        break;
+      }
+    }
+    if (!total) {
+      out.push_back({r.name, r.depth, 0, 0, 0});
+      total = &out.back();
+    }
+    total->ms += r.end_ms - r.start_ms;
+    total->allocs += r.allocs;
+    total->bytes += r.bytes;
+  }
+  return out;
+}
+
+std::string json_escape(const char *s) {
+  std::string out;
+  for (; *s; s++) {
+    if (*s == '"' || *s == '\\')
+      out += '\\';
+    out += *s;
+  }
+  return out;
+}
+
+} // namespace
+
+PassTimer::PassTimer(const char *name) {
+  if (!timing_enabled)
+    return;
+
+  record = records.size();
+  records.push_back({name, depth++, Stats::now_ms(), 0, Stats::allocations(),
+                     0, Stats::bytes_allocated(), 0});
+}
+
+PassTimer::~PassTimer() {
+  if (record == NOT_RECORDING)
+    return;
+
+  PassRecord &r = records[record];
+  r.end_ms = Stats::now_ms();
+  r.allocs = Stats::allocations() - r.start_allocs;
+  r.bytes = Stats::bytes_allocated() - r.start_bytes;
+  depth--;
+}
+
+namespace PassTimers {
+
+void enable() {
+  timing_enabled = true;
+  epoch_ms = Stats::now_ms();
+}
+
+bool enabled() { return timing_enabled; }
+
+void print_report(std::ostream &os) {
+  const std::vector<PassTotal> passes = totals();
+
+  double total_ms = 0;
+  uint64_t total_allocs = 0;
+  uint64_t total_bytes = 0;
+  for (const PassTotal &p : passes) {
+    if (p.depth == 0) {
+      total_ms += p.ms;
+      total_allocs += p.allocs;
+      total_bytes += p.bytes;
+    }
+  }
+
+  const char *rule = "===-----------------------------------------------------"
+                     "--------------------===";
+  os << rule << "\n"
+     << "                      ... Pass execution timing report ...\n"
+     << rule << "\n"
+     << "  Total Execution Time: " << std::fixed << std::setprecision(4)
+     << total_ms / 1000 << " seconds (" << total_allocs
+     << " allocations, " << total_bytes / 1024 << " KiB)\n\n"
+     << "   ---Wall Time---   --Allocations--   ---Alloc KiB---  --- Name ---"
+     << "\n";
+
+  for (const PassTotal &p : passes) {
+    const double pct = total_ms > 0 ? 100 * p.ms / total_ms : 0;
+    os << "   " << std::setw(7) << std::setprecision(4) << p.ms / 1000 << " ("
+       << std::setw(5) << std::setprecision(1) << pct << "%)"
+       << "   " << std::setw(15) << p.allocs << "   " << std::setw(15)
+       << p.bytes / 1024 << "  " << std::string(2 * p.depth, ' ') << p.name
+       << "\n";
+  }
+
+  os << "   " << std::setw(7) << std::setprecision(4) << total_ms / 1000
+     << " (100.0%)   " << std::setw(15) << total_allocs << "   "
+     << std::setw(15) << total_bytes / 1024 << "  Total\n"
+     << std::defaultfloat << std::flush;
+}
+
+bool write_trace(const char *path) {
+  std::ofstream out(path);
+  if (!out)
+    return false;
+
+  // Complete ("X") events, timestamps in microseconds since enable().
+  out << "{\"traceEvents\":[";
+  for (size_t i = 0; i < records.size(); i++) {
+    const PassRecord &r = records[i];
+    char times[64];
+    snprintf(times, sizeof(times), "\"ts\":%.3f,\"dur\":%.3f",
+             (r.start_ms - epoch_ms) * 1000, (r.end_ms - r.start_ms) * 1000);
+    out << (i ? ",\n" : "\n") << "{\"name\":\"" << json_escape(r.name)
+        << "\",\"cat\":\"pass\",\"ph\":\"X\",\"pid\":1,\"tid\":1," << times
+        << ",\"args\":{\"allocations\":" << r.allocs
+        << ",\"bytes\":" << r.bytes << "}}";
+  }
+  out << "\n],\"displayTimeUnit\":\"ms\"}\n";
+  return static_cast<bool>(out);
+}
+
+} // namespace PassTimers
@@ -0,0 +1,47 @@
+#ifndef _NL_PASS_TIMER_H_
+#define _NL_PASS_TIMER_H_
+
+#include <cstddef>
+#include <ostream>
+
+/*
+ * Scoped timer for a compiler pass. Wall time and heap allocations are
+ * recorded from construction to destruction. Timers nest, so backends
+ * can time their sub-steps inside the enclosing "Code generation" pass.
+ *
+ *   {
+ *     PassTimer timer("Type checking");
+ *     type_checker.check(program);
+ *   }
+ *
+ * Nothing is recorded unless PassTimers::enable() has been called.
+ */
+class PassTimer {
+public:
+  explicit PassTimer(const char *name);
+  ~PassTimer();
+
+  PassTimer(const PassTimer &) = delete;
+  PassTimer &operator=(const PassTimer &) = delete;
+
+private:
+  static const size_t NOT_RECORDING = ~(size_t)0;
+  size_t record = NOT_RECORDING;
+};
+
+namespace PassTimers {
+
+void enable();
+
+bool enabled();
+
+/* Prints per-pass times and allocations, in the style of -time-passes. */
+void print_report(std::ostream &os);
+
+/* Writes every timed pass as Chrome trace-event JSON (chrome://tracing,
+   Perfetto). Returns false if path can't be written. */
+bool write_trace(const char *path);
+
+} // namespace PassTimers
+
+#endif // _NL_PASS_TIMER_H_
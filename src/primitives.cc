@@ -34,17 +34,18 @@ NLType Void() {
   return type;
 }
 
-NLType Array(NLType elem_type, int dims) {
-  static std::map <NLType, std::map<int, NLType>> array_types;
-  auto t =  array_types[elem_type][dims];
+NLType Array(NLType elem_type, int dims, bool soa) {
+  static std::map <NLType, std::map<int, NLType>> array_types[2];
+  auto t =  array_types[soa][elem_type][dims];
   if (!t) {
     std::stringstream name;
-    name << elem_type->name;
+    name << (soa ? "soa " : "") << elem_type->name;
     for (int i = 0; i < dims; i++) { name << "[]" ; }   
     t = std::make_shared<Type>(name.str());
     t->dims = dims;
     t->underlying_type = elem_type;
-    array_types[elem_type][dims] = t;
+    t->soa = soa;
+    array_types[soa][elem_type][dims] = t;
   }
   return t;
 }
@@ -4,7 +4,7 @@
 #include "type.h"
 
 namespace Primitives {
-NLType Array(NLType elem_type, int dims);
+NLType Array(NLType elem_type, int dims, bool soa = false);
 NLType Class();
 NLType String();
 NLType Int();
@@ -53,7 +53,7 @@ void Reachability::visit(const FuncStmt *stmt) {
   analyze(stmt->body);
 
   // init() doesn't have a return statement.
-  bool is_init = in_class && stmt->name.lexeme == "init";
+  bool is_init = in_class && stmt->name.id == ID_INIT;
   if (is_init)
     return;
 
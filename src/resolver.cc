@@ -52,8 +52,8 @@ void Resolver::visit(const VarStmt *stmt) {
 }
 
 void Resolver::visit(const Variable *expr) {
-  if (!scopes.empty() && scopes.back()->map.count(expr->name.lexeme) > 0 &&
-      scopes.back()->map.at(expr->name.lexeme) == false) {
+  if (!scopes.empty() && scopes.back()->map.count(expr->name.id) > 0 &&
+      scopes.back()->map.at(expr->name.id) == false) {
     Neeilang::error(expr->name,
                     "Cannot read local variable in its own initializer.");
   }
@@ -102,14 +102,14 @@ void Resolver::visit(const ClassStmt *stmt) {
    * Whenever 'this' is encountered in a method, it will resolve to a
    * "local variable” in an implicit scope just outside the method body.
    */
-  scopes.back()->map.insert(std::pair<std::string, bool>("this", true));
+  scopes.back()->map.insert({ID_THIS, true});
 
   for (const Stmt *method : stmt->methods) {
     FunctionType declaration = METHOD;
 
     const FuncStmt *method_fn = static_cast<const FuncStmt *>(method);
 
-    if (method_fn->name.lexeme == "init") {
+    if (method_fn->name.id == ID_INIT) {
       declaration = INITIALIZER;
     }
 
@@ -123,7 +123,7 @@ void Resolver::visit(const ClassStmt *stmt) {
 
 void Resolver::resolve_local(const Expr *expr, const Token name) {
   for (int i = scopes.size() - 1; i >= 0; i--) {
-    if (scopes[i]->map.count(name.lexeme) > 0) {
+    if (scopes[i]->map.count(name.id) > 0) {
       // Tell the rest of the compiler the ordinality of the scope
       // in which this variable should be resolved.
       scope_mappings[expr] = scopes[i]->id;
@@ -167,28 +167,28 @@ void Resolver::define(const Token name) {
     return;
 
   // mark as initialized & available for use
-  std::map<std::string, bool> &scope = scopes.back()->map;
+  auto &scope = scopes.back()->map;
 
-  if (scope.count(name.lexeme) > 0) {
-    scope.erase(name.lexeme);
+  if (scope.count(name.id) > 0) {
+    scope.erase(name.id);
   }
 
-  scope.insert(std::pair<std::string, bool>(name.lexeme, true));
+  scope.insert({name.id, true});
 }
 
 void Resolver::declare(const Token name) {
   if (scopes.empty())
     return;
 
-  if (scopes.back()->map.count(name.lexeme) > 0) {
+  if (scopes.back()->map.count(name.id) > 0) {
     Neeilang::error(name,
                     "Variable with this name already declared in this scope.");
   }
 
   // mark as declared but uninitialized for use
-  std::map<std::string, bool> &scope = scopes.back()->map;
+  auto &scope = scopes.back()->map;
   ;
-  scope.insert(std::pair<std::string, bool>(name.lexeme, false));
+  scope.insert({name.id, false});
 }
 
 // Other syntax tree nodes
@@ -1,10 +1,11 @@
 #ifndef _NL_RESOLVER_H_
 #define _NL_RESOLVER_H_
 
-#include <map>
+#include <unordered_map>
 #include <string>
 #include <vector>
 
+#include "expr-map.h"
 #include "scope-manager.h"
 #include "token.h"
 #include "visitable.h"
@@ -26,19 +27,22 @@ enum ClassType { NOT_IN_CLASS, IN_CLASS };
 
 // true in map == 'is finished being initialized in this scope'
 struct ScopeMap {
-  std::map<std::string, bool> map;
+  std::unordered_map<Ident, bool> map;
   size_t id = 0;
 };
 
 class Resolver : public ExprVisitor<void>, public StmtVisitor<void> {
 public:
-  Resolver() { scopes.push_back(&globals); }
+  Resolver(size_t num_exprs = 0) {
+    scopes.push_back(&globals);
+    scope_mappings.reserve(num_exprs + 1);
+  }
   void resolve_program(const std::vector<Stmt *> program);
 
   //  private:
   ScopeMap globals;
   std::vector<ScopeMap *> scopes;
-  std::map<const Expr *, size_t> scope_mappings;
+  ExprMap<size_t> scope_mappings;
 
   ClassType current_class = NOT_IN_CLASS;
   FunctionType current_function = NOT_IN_FN;
@@ -2,139 +2,335 @@
 #include "neeilang.h"
 #include "token.h"
 
-#include <map>
+#include <array>
+#include <cstdint>
+#include <cstring>
 #include <sstream>
 #include <string>
+#include <string_view>
+#include <utility>
 #include <vector>
 
-const std::map<std::string, TokenType> Scanner::keywords = {
-    {"and", AND},     {"class", CLASS}, {"else", ELSE},     {"false", FALSE},
-    {"for", FOR},     {"fn", FN},       {"lambda", LAMBDA}, {"if", IF},
-    {"nil", NIL},     {"or", OR},       {"print", PRINT},   {"return", RETURN},
-    {"super", SUPER}, {"this", THIS},   {"true", TRUE},     {"var", VAR},
-    {"while", WHILE}};
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
-Scanner::Scanner(const std::string &source) : source(source) {}
+// Reserved words are pre-interned in TokenType order, so a keyword's
+// TokenType also gives us its ID.
+static_assert(ID_WHILE - ID_AND == WHILE - AND,
+              "Keyword IDs must mirror keyword TokenTypes");
+
+namespace {
+
+/*
+ * Character classes. Each byte of input is classified with a single
+ * table load instead of a chain of comparisons.
+ */
+enum CharClass : uint8_t {
+  CC_SPACE = 1 << 0,   // ' ', '\t', '\r'
+  CC_NEWLINE = 1 << 1, // '\n'
+  CC_DIGIT = 1 << 2,   // '0' - '9'
+  CC_ALPHA = 1 << 3,   // 'a' - 'z', 'A' - 'Z', '_'
+  CC_PUNCT = 1 << 4,   // Starts a fixed-spelling token.
+};
+
+const uint8_t CC_IDENT = CC_ALPHA | CC_DIGIT;
+const uint8_t CC_BLANK = CC_SPACE | CC_NEWLINE;
+
+constexpr std::array<uint8_t, 256> make_char_classes() {
+  std::array<uint8_t, 256> classes{};
+  classes[' '] = classes['\t'] = classes['\r'] = CC_SPACE;
+  classes['\n'] = CC_NEWLINE;
+  for (int c = '0'; c <= '9'; c++)
+    classes[c] = CC_DIGIT;
+  for (int c = 'a'; c <= 'z'; c++)
+    classes[c] = classes[c - 'a' + 'A'] = CC_ALPHA;
+  classes['_'] = CC_ALPHA;
+  for (unsigned char c : std::string_view("(){}[],.-+;:*!=<>"))
+    classes[c] = CC_PUNCT;
+  return classes;
+}
+
+constexpr std::array<uint8_t, 256> char_classes = make_char_classes();
+
+inline uint8_t char_class(char c) {
+  return char_classes[static_cast<unsigned char>(c)];
+}
+
+/*
+ * Tokens whose spelling is a single character. '!', '=', '<' and '>' map
+ * to their one-character form; the '='-suffixed form is always the next
+ * TokenType.
+ */
+constexpr std::array<TokenType, 256> make_punct_tokens() {
+  std::array<TokenType, 256> types{};
+  for (auto &type : types)
+    type = END_OF_FILE;
+  types['('] = LEFT_PAREN;
+  types[')'] = RIGHT_PAREN;
+  types['{'] = LEFT_BRACE;
+  types['}'] = RIGHT_BRACE;
+  types['['] = LEFT_BRACKET;
+  types[']'] = RIGHT_BRACKET;
+  types[','] = COMMA;
+  types['.'] = DOT;
+  types['-'] = MINUS;
+  types['+'] = PLUS;
+  types[';'] = SEMICOLON;
+  types[':'] = COLON;
+  types['*'] = STAR;
+  types['!'] = BANG;
+  types['='] = EQUAL;
+  types['<'] = LESS;
+  types['>'] = GREATER;
+  return types;
+}
+
+constexpr std::array<TokenType, 256> punct_tokens = make_punct_tokens();
+
+static_assert(BANG_EQUAL == BANG + 1 && EQUAL_EQUAL == EQUAL + 1 &&
+                  LESS_EQUAL == LESS + 1 && GREATER_EQUAL == GREATER + 1,
+              "Two-character operators must follow their prefix");
+
+/*
+ * Perfect hash for the 18 reserved words: (7 * first + 8 * last + length)
+ * is distinct modulo 32 for every keyword. A hit still needs a full
+ * compare.
+ */
+struct KeywordSlot {
+  const char *text;
+  TokenType type;
+};
+
+constexpr unsigned keyword_hash(const char *text, size_t len) {
+  return (7u * static_cast<unsigned char>(text[0]) +
+          8u * static_cast<unsigned char>(text[len - 1]) + len) &
+         31u;
+}
+
+constexpr std::array<KeywordSlot, 32> make_keyword_table() {
+  const KeywordSlot keywords[] = {
+      {"and", AND},       {"class", CLASS},   {"else", ELSE},
+      {"false", FALSE},   {"fn", FN},         {"lambda", LAMBDA},
+      {"for", FOR},       {"if", IF},         {"nil", NIL},
+      {"or", OR},         {"print", PRINT},   {"return", RETURN},
+      {"struct", STRUCT}, {"super", SUPER},   {"this", THIS},
+      {"true", TRUE},     {"var", VAR},       {"while", WHILE}};
+
+  std::array<KeywordSlot, 32> table{};
+  for (const KeywordSlot &kw : keywords) {
+    size_t len = std::char_traits<char>::length(kw.text);
+    table[keyword_hash(kw.text, len)] = kw;
+  }
+  return table;
+}
+
+constexpr std::array<KeywordSlot, 32> keyword_table = make_keyword_table();
+
+const size_t MIN_KEYWORD_LEN = 2;
+const size_t MAX_KEYWORD_LEN = 6;
+
+TokenType keyword_type(std::string_view text) {
+  if (text.size() < MIN_KEYWORD_LEN || text.size() > MAX_KEYWORD_LEN)
+    return IDENTIFIER;
+
+  const KeywordSlot &slot = keyword_table[keyword_hash(text.data(), text.size())];
+  if (slot.text && text.compare(slot.text) == 0)
+    return slot.type;
+  return IDENTIFIER;
+}
+
+/*
+ * Run scanners: each returns a pointer to the first byte in [p, end) that
+ * is not part of the run. Most runs in real code are short (a name, a
+ * single space), so the first few bytes are checked with the class table;
+ * longer runs are finished 16 bytes per iteration with SSE2.
+ */
+const int SHORT_RUN = 8;
+
+#if defined(__SSE2__)
+// Bytes of chunk in [lo, lo + n), using a signed compare on biased bytes.
+inline __m128i in_range(__m128i chunk, char lo, char n) {
+  const __m128i bias = _mm_set1_epi8(static_cast<char>(-128 - lo));
+  return _mm_cmplt_epi8(_mm_add_epi8(chunk, bias),
+                        _mm_set1_epi8(static_cast<char>(-128 + n)));
+}
+
+inline unsigned first_unset(int mask) {
+  return __builtin_ctz(~static_cast<unsigned>(mask));
+}
+#endif
+
+const char *skip_ident_chars(const char *p, const char *end) {
+  for (int i = 0; i < SHORT_RUN; i++, p++) {
+    if (p == end || !(char_class(*p) & CC_IDENT))
+      return p;
+  }
+#if defined(__SSE2__)
+  while (end - p >= 16) {
+    __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+    __m128i lower = _mm_or_si128(chunk, _mm_set1_epi8(0x20));
+    __m128i ident = _mm_or_si128(
+        _mm_or_si128(in_range(lower, 'a', 26), in_range(chunk, '0', 10)),
+        _mm_cmpeq_epi8(chunk, _mm_set1_epi8('_')));
+    int mask = _mm_movemask_epi8(ident);
+    if (mask != 0xFFFF)
+      return p + first_unset(mask);
+    p += 16;
+  }
+#endif
+  while (p < end && (char_class(*p) & CC_IDENT))
+    p++;
+  return p;
+}
+
+const char *skip_digits(const char *p, const char *end) {
+  for (int i = 0; i < SHORT_RUN; i++, p++) {
+    if (p == end || !(char_class(*p) & CC_DIGIT))
+      return p;
+  }
+#if defined(__SSE2__)
+  while (end - p >= 16) {
+    __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+    int mask = _mm_movemask_epi8(in_range(chunk, '0', 10));
+    if (mask != 0xFFFF)
+      return p + first_unset(mask);
+    p += 16;
+  }
+#endif
+  while (p < end && (char_class(*p) & CC_DIGIT))
+    p++;
+  return p;
+}
+
+// Also counts the newlines skipped over.
+const char *skip_blanks(const char *p, const char *end, int &lines) {
+  for (int i = 0; i < SHORT_RUN; i++, p++) {
+    if (p == end || !(char_class(*p) & CC_BLANK))
+      return p;
+    if (*p == '\n')
+      lines++;
+  }
+#if defined(__SSE2__)
+  while (end - p >= 16) {
+    __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+    __m128i newline = _mm_cmpeq_epi8(chunk, _mm_set1_epi8('\n'));
+    __m128i blank = _mm_or_si128(
+        _mm_or_si128(newline, _mm_cmpeq_epi8(chunk, _mm_set1_epi8(' '))),
+        _mm_or_si128(_mm_cmpeq_epi8(chunk, _mm_set1_epi8('\t')),
+                     _mm_cmpeq_epi8(chunk, _mm_set1_epi8('\r'))));
+    int mask = _mm_movemask_epi8(blank);
+    int newlines = _mm_movemask_epi8(newline);
+    if (mask != 0xFFFF) {
+      unsigned n = first_unset(mask);
+      lines += __builtin_popcount(newlines & ((1u << n) - 1));
+      return p + n;
+    }
+    lines += __builtin_popcount(newlines);
+    p += 16;
+  }
+#endif
+  for (; p < end && (char_class(*p) & CC_BLANK); p++) {
+    if (*p == '\n')
+      lines++;
+  }
+  return p;
+}
+
+} // namespace
+
+Scanner::Scanner(std::string_view source) : source(source) {}
 
 std::vector<Token> Scanner::scan_tokens() {
+  // Typical programs average a token every 3-4 bytes; reserving up front
+  // avoids repeatedly copying the token vector while it grows.
+  tokens.reserve(source.length() / 3 + 1);
+
   while (!is_at_end()) {
     // Invariant: All lexemes before current have been scanned
     start = current;
     scan_token();
   }
 
-  tokens.push_back(Token(END_OF_FILE, "", "", line));
-  return tokens;
+  tokens.push_back(Token(END_OF_FILE, current, 0, ID_EMPTY, line));
+  return std::move(tokens);
 }
 
 bool Scanner::is_at_end() { return current >= source.length(); }
-#include <iostream>
+
 void Scanner::scan_token() {
-  char c = advance();
-
-  switch (c) {
-  case '(':
-    add_token(LEFT_PAREN);
-    break;
-  case ')':
-    add_token(RIGHT_PAREN);
-    break;
-  case '{':
-    add_token(LEFT_BRACE);
-    break;
-  case '}':
-    add_token(RIGHT_BRACE);
-    break;
-  case '[':
-    add_token(LEFT_BRACKET);
-    break;
-  case ']':
-    add_token(RIGHT_BRACKET);
-    break;
-  case ',':
-    add_token(COMMA);
-    break;
-  case '.':
-    add_token(DOT);
-    break;
-  case '-':
-    add_token(MINUS);
-    break;
-  case '+':
-    add_token(PLUS);
-    break;
-  case ';':
-    add_token(SEMICOLON);
-    break;
-  case ':':
-    add_token(COLON);
-    break;
-  case '*':
-    add_token(STAR);
-    break;
-  case '!':
-    add_token(match('=') ? BANG_EQUAL : BANG);
-    break;
-  case '=':
-    add_token(match('=') ? EQUAL_EQUAL : EQUAL);
-    break;
-  case '<':
-    add_token(match('=') ? LESS_EQUAL : LESS);
-    break;
-  case '>':
-    add_token(match('=') ? GREATER_EQUAL : GREATER);
-    break;
-  case '/':
-    if (match('/')) { // A '//' single-line comment
-      while (peek() != '\n' && !is_at_end())
-        advance();
-    } else if (match('*')) { // A /* multi-line comment
-      bool in_comment = true;
-      while (in_comment && !is_at_end()) {
-        while (!match('*') && !is_at_end()) {
-          if (peek() == '\n')
-            line++;
-          advance();
-        }
-        // Matched a * - comment ends if we match a /
-        in_comment = !match('/');
-      }
-    } else {
-      add_token(SLASH);
+  const char c = source[current];
+  const uint8_t cls = char_class(c);
+
+  if (cls & CC_BLANK) {
+    current = offset_of(skip_blanks(pos(), end(), line));
+  } else if (cls & CC_ALPHA) {
+    identifier();
+  } else if (cls & CC_DIGIT) {
+    number();
+  } else if (cls & CC_PUNCT) {
+    TokenType type = punct_tokens[static_cast<unsigned char>(c)];
+    advance();
+    if ((type == BANG || type == EQUAL || type == LESS || type == GREATER) &&
+        match('=')) {
+      type = static_cast<TokenType>(type + 1);
     }
-    break;
-  case ' ':
-  case '\r':
-  case '\t':
-    // Ignore whitespace.
-    break;
-  case '\n':
-    line++;
-    break;
-  case '"':
+    add_token(type);
+  } else if (c == '/') {
+    advance();
+    comment_or_slash();
+  } else if (c == '"') {
+    advance();
     string();
-    break; // string literals
-  default:
-    if (is_digit(c)) {
-      number();
-    } else if (is_alpha(c)) {
-      identifier();
-    } else {
-      std::ostringstream msg;
-      msg << "Unexpected character '" << c << "'";
-      Neeilang::error(line, msg.str());
+  } else {
+    advance();
+    std::ostringstream msg;
+    msg << "Unexpected character '" << c << "'";
+    Neeilang::error(line, msg.str());
+  }
+}
+
+void Scanner::comment_or_slash() {
+  if (match('/')) { // A '//' single-line comment
+    const void *nl = memchr(pos(), '\n', end() - pos());
+    current = nl ? offset_of(static_cast<const char *>(nl)) : source.length();
+  } else if (match('*')) { // A /* multi-line comment
+    bool in_comment = true;
+    while (in_comment && !is_at_end()) {
+      while (!match('*') && !is_at_end()) {
+        if (peek() == '\n')
+          line++;
+        advance();
+      }
+      // Matched a * - comment ends if we match a /
+      in_comment = !match('/');
     }
-    break;
+  } else {
+    add_token(SLASH);
   }
 }
 
 char Scanner::advance() { return source[current++]; }
 
-void Scanner::add_token(TokenType type) { add_token(type, ""); }
+void Scanner::add_token(TokenType type) {
+  // Punctuation always has the same spelling, so only intern it once.
+  static Ident fixed_ids[END_OF_FILE] = {};
+
+  std::string_view text = source.substr(start, current - start);
+  Ident id;
+  if (type < IDENTIFIER) {
+    if (!fixed_ids[type]) {
+      fixed_ids[type] = Interner::intern(text);
+    }
+    id = fixed_ids[type];
+  } else {
+    id = Interner::intern(text);
+  }
+  add_token(type, id);
+}
 
-void Scanner::add_token(TokenType type, std::string literal) {
-  std::string text = source.substr(start, current - start);
-  tokens.push_back(Token(type, text, literal, line));
+void Scanner::add_token(TokenType type, Ident id) {
+  tokens.push_back(Token(type, start, current - start, id, line));
 }
 
 bool Scanner::match(char expected) {
@@ -168,27 +364,19 @@ void Scanner::string() {
   // The closing ".
   advance();
 
-  // Trim the surrounding quotes.
-  int str_start = start + 1;
-  std::string value = source.substr(str_start, current - 1 - str_start);
-  add_token(STRING, value);
+  add_token(STRING);
 }
 
-bool Scanner::is_digit(char c) { return c >= '0' && c <= '9'; }
-
 void Scanner::number() {
-  while (is_digit(peek()))
-    advance();
+  current = offset_of(skip_digits(pos(), end()));
 
   // Look for a fractional part.
-  if (peek() == '.' && is_digit(peek_next())) {
+  if (peek() == '.' && (char_class(peek_next()) & CC_DIGIT)) {
     advance(); // Consume the "."
-    while (is_digit(peek()))
-      advance();
+    current = offset_of(skip_digits(pos(), end()));
   }
 
-  std::string value = source.substr(start, current - start);
-  add_token(NUMBER, value);
+  add_token(NUMBER);
 }
 
 char Scanner::peek_next() {
@@ -198,18 +386,14 @@ char Scanner::peek_next() {
 }
 
 void Scanner::identifier() {
-  while (is_alphanumeric(peek()))
-    advance();
+  current = offset_of(skip_ident_chars(pos(), end()));
+  std::string_view text = source.substr(start, current - start);
 
   // See if the identifier is a reserved word.
-  std::string text = source.substr(start, current - start);
-
-  TokenType type = keywords.count(text) ? keywords.at(text) : IDENTIFIER;
-  add_token(type);
-}
-
-bool Scanner::is_alpha(char c) {
-  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+  TokenType type = keyword_type(text);
+  if (type != IDENTIFIER) {
+    add_token(type, ID_AND + (type - AND));
+  } else {
+    add_token(IDENTIFIER, Interner::intern(text));
+  }
 }
-
-bool Scanner::is_alphanumeric(char c) { return is_alpha(c) || is_digit(c); }
@@ -1,22 +1,28 @@
 #ifndef _NL_SCANNER_H_
 #define _NL_SCANNER_H_
 
-#include <map>
 #include <string>
+#include <string_view>
 #include <vector>
 
+#include "interner.h"
 #include "token.h"
 
+/*
+ * Table-driven scanner: every character is classified with one lookup,
+ * and runs of blanks, identifier characters and digits are skipped in
+ * 16-byte chunks where SSE2 is available.
+ */
 class Scanner {
 public:
-  Scanner(const std::string &source);
+  /* The scanner lexes source in place; it must outlive the tokens. */
+  Scanner(std::string_view source);
 
   std::vector<Token> scan_tokens();
 
 private:
-  const std::string source;
+  const std::string_view source;
   std::vector<Token> tokens;
-  static const std::map<std::string, TokenType> keywords;
 
   size_t start = 0;
   size_t current = 0;
@@ -24,11 +30,10 @@ private:
 
   bool is_at_end();
 
-  bool is_alpha(char c);
-
-  bool is_alphanumeric(char c);
-
-  bool is_digit(char c);
+  // Raw views of the remaining input, for the run scanners.
+  const char *pos() const { return source.data() + current; }
+  const char *end() const { return source.data() + source.size(); }
+  size_t offset_of(const char *p) const { return p - source.data(); }
 
   bool match(char expected);
 
@@ -40,10 +45,12 @@ private:
 
   void add_token(TokenType type);
 
-  void add_token(TokenType type, std::string literal);
+  void add_token(TokenType type, Ident id);
 
   void scan_token();
 
+  void comment_or_slash();
+
   void string();
 
   void number();
@@ -2,24 +2,42 @@
 #define _NL_SCOPE_MANAGER_H_
 
 #include <cstddef> // for size_t
+#include <vector>
 
 #include "scope.h"
+#include "symtab.h"
+#include "type-table.h"
 
+/*
+ * Tracks which scope each pass is in. Passes enter and exit scopes in
+ * program order, so scope IDs are handed out in the same sequence every
+ * time; reset() rewinds to the global scope for the next pass. Symbols
+ * and types are looked up relative to the current scope.
+ */
 struct ScopeManager {
   std::vector<Scope> scopes;
   std::size_t curr_scope = 0;
   std::size_t next_id = 1;
 
+  SymbolTable symbols;
+  TypeTable types;
+
   explicit ScopeManager() {
     // Create the 'global' scope, with id 0.
     scopes.push_back(Scope(curr_scope));
   }
 
-  Scope current() { return scopes[curr_scope]; }
+  // Every pass shares the one set of tables.
+  ScopeManager(const ScopeManager &) = delete;
+  ScopeManager &operator=(const ScopeManager &) = delete;
+
+  const Scope &current() const { return scopes[curr_scope]; }
 
-  Scope globals() { return scopes[0]; }
+  const Scope &globals() const { return scopes[0]; }
 
   void reset() {
+    symbols.pop_to_global();
+    types.pop_to_global();
     curr_scope = 0;
     next_id = 1;
   }
@@ -27,14 +45,22 @@ struct ScopeManager {
   void enter() {
     if (scopes.size() > next_id) {
       curr_scope = next_id++;
-      return;
+    } else {
+      scopes.push_back(Scope(next_id++, curr_scope));
+      curr_scope = scopes.back().id;
     }
-    Scope new_scope = current().create_child(next_id++);
-    scopes.push_back(new_scope);
-    curr_scope = new_scope.id;
+    symbols.push_scope(curr_scope);
+    types.push_scope(curr_scope);
+  }
+
+  void exit() {
+    symbols.pop_scope();
+    types.pop_scope();
+    curr_scope = current().parent;
   }
 
-  void exit() { curr_scope = current().parent; }
+  // Passes over the next count scopes, for code a pass doesn't walk.
+  void skip(std::size_t count) { next_id += count; }
 };
 
 #endif // _NL_SCOPE_MANAGER_H_
@@ -0,0 +1,144 @@
+#ifndef _NL_SCOPED_TABLE_H_
+#define _NL_SCOPED_TABLE_H_
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "interner.h"
+
+/*
+ * ScopedTable maps identifiers to values with lexical scoping. Since
+ * keys are interned (and so densely numbered), the table is a flat array
+ * indexed by Ident whose entries are the innermost visible binding of
+ * that name. Each binding links to the one it shadows, so a lookup is a
+ * single index no matter how deeply scopes nest.
+ *
+ * Scopes are entered and exited in the same order on every pass over the
+ * program, and each one remembers what was bound in it. Re-entering a
+ * scope on a later pass makes all of its bindings visible again, just as
+ * if the scope's table had been kept around.
+ */
+template <typename V> class ScopedTable {
+public:
+  static constexpr size_t GLOBAL_SCOPE = 0;
+
+  ScopedTable() { push_scope(GLOBAL_SCOPE); }
+
+  /* Binds k in the innermost open scope, replacing any binding of k
+     made in that same scope. */
+  void insert(Ident k, const V &v) {
+    const uint32_t scope = open.back().scope;
+    const int32_t top = top_of(k);
+    if (top != NONE && visible[top].scope == scope) {
+      bindings[scope][visible[top].index].value = v;
+      return;
+    }
+
+    std::vector<Binding> &log = log_of(scope);
+    log.push_back({k, v});
+    push_visible(k, scope, log.size() - 1);
+  }
+
+  bool contains(Ident k) const { return top_of(k) != NONE; }
+
+  /* The innermost binding of k, or V() if it isn't bound. */
+  V get(Ident k) const {
+    const int32_t top = top_of(k);
+    if (top == NONE) {
+      return V();
+    }
+    return value_of(visible[top]);
+  }
+
+  /* The binding of k in the global scope, ignoring any shadowing. */
+  V get_global(Ident k) const {
+    for (int32_t i = top_of(k); i != NONE; i = visible[i].shadowed) {
+      if (visible[i].scope == GLOBAL_SCOPE) {
+        return value_of(visible[i]);
+      }
+    }
+    return V();
+  }
+
+  /* Opens scope id, re-binding anything bound in it on earlier passes. */
+  void push_scope(size_t id) {
+    open.push_back({static_cast<uint32_t>(id), visible.size()});
+    if (id < bindings.size()) {
+      const std::vector<Binding> &log = bindings[id];
+      for (size_t i = 0; i < log.size(); i++) {
+        push_visible(log[i].key, id, i);
+      }
+    }
+  }
+
+  /* Closes the innermost scope; its bindings are kept for later passes. */
+  void pop_scope() {
+    assert(open.size() > 1 && "Can't close the global scope");
+    const size_t first = open.back().first_visible;
+    while (visible.size() > first) {
+      const VisibleBinding &b = visible.back();
+      heads[bindings[b.scope][b.index].key] = b.shadowed;
+      visible.pop_back();
+    }
+    open.pop_back();
+  }
+
+  /* Closes every scope but the global one. */
+  void pop_to_global() {
+    while (open.size() > 1) {
+      pop_scope();
+    }
+  }
+
+private:
+  static constexpr int32_t NONE = -1;
+
+  // What a scope binds, in insertion order.
+  struct Binding {
+    Ident key;
+    V value;
+  };
+
+  // A binding of an open scope, and the outer binding it shadows.
+  struct VisibleBinding {
+    uint32_t scope;
+    uint32_t index; // into bindings[scope]
+    int32_t shadowed;
+  };
+
+  struct OpenScope {
+    uint32_t scope;
+    size_t first_visible;
+  };
+
+  std::vector<std::vector<Binding>> bindings; // Indexed by scope ID.
+  std::vector<VisibleBinding> visible;        // Stack, in binding order.
+  std::vector<int32_t> heads; // Innermost visible binding, by Ident.
+  std::vector<OpenScope> open;
+
+  int32_t top_of(Ident k) const { return k < heads.size() ? heads[k] : NONE; }
+
+  const V &value_of(const VisibleBinding &b) const {
+    return bindings[b.scope][b.index].value;
+  }
+
+  std::vector<Binding> &log_of(size_t scope) {
+    if (scope >= bindings.size()) {
+      bindings.resize(scope + 1);
+    }
+    return bindings[scope];
+  }
+
+  void push_visible(Ident k, size_t scope, size_t index) {
+    if (k >= heads.size()) {
+      heads.resize(k + 1, NONE);
+    }
+    visible.push_back({static_cast<uint32_t>(scope),
+                       static_cast<uint32_t>(index), heads[k]});
+    heads[k] = visible.size() - 1;
+  }
+};
+
+#endif // _NL_SCOPED_TABLE_H_
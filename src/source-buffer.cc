@@ -0,0 +1,71 @@
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "source-buffer.h"
+
+SourceBuffer::~SourceBuffer() {
+  if (mapping) {
+    munmap(mapping, size);
+  }
+}
+
+bool SourceBuffer::load(const char *path) {
+  if (strcmp(path, "-") == 0) {
+    return read_all(STDIN_FILENO);
+  }
+
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    return false;
+  }
+
+  if (!S_ISREG(st.st_mode) || st.st_size == 0) {
+    // Pipes, FIFOs, character devices etc. can't be mapped (and empty
+    // files needn't be).
+    bool ok = read_all(fd);
+    close(fd);
+    return ok;
+  }
+
+  void *addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd); // The mapping keeps the file alive.
+
+  if (addr == MAP_FAILED) {
+    return false;
+  }
+
+  madvise(addr, st.st_size, MADV_SEQUENTIAL);
+  mapping = addr;
+  data = static_cast<const char *>(addr);
+  size = st.st_size;
+  return true;
+}
+
+bool SourceBuffer::read_all(int fd) {
+  char chunk[64 * 1024];
+  ssize_t n;
+
+  while ((n = read(fd, chunk, sizeof(chunk))) != 0) {
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      return false;
+    }
+    contents.append(chunk, n);
+  }
+
+  data = contents.data();
+  size = contents.size();
+  return true;
+}
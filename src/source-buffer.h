@@ -0,0 +1,35 @@
+#ifndef _NL_SOURCE_BUFFER_H_
+#define _NL_SOURCE_BUFFER_H_
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+/*
+ * Read-only program text. Regular files are memory-mapped and lexed in
+ * place; stdin, pipes and other unmappable inputs are read into a buffer
+ * owned by this object. Tokens hold spans into text(), so the buffer
+ * must outlive them.
+ */
+class SourceBuffer {
+public:
+  SourceBuffer() = default;
+  SourceBuffer(const SourceBuffer &) = delete;
+  SourceBuffer &operator=(const SourceBuffer &) = delete;
+  ~SourceBuffer();
+
+  /* Loads path, or stdin if path is "-". Returns false on failure. */
+  bool load(const char *path);
+
+  std::string_view text() const { return std::string_view(data, size); }
+
+private:
+  bool read_all(int fd);
+
+  const char *data = nullptr;
+  size_t size = 0;
+  void *mapping = nullptr;
+  std::string contents; // Backing store when the input isn't mapped.
+};
+
+#endif // _NL_SOURCE_BUFFER_H_
@@ -0,0 +1,54 @@
+#include <chrono>
+#include <cstdlib>
+#include <new>
+
+#include <sys/resource.h>
+
+#include "stats.h"
+
+namespace {
+// The compiler is single-threaded, so plain counters are enough.
+uint64_t num_allocations = 0;
+uint64_t num_bytes_allocated = 0;
+
+void *counted_alloc(size_t size) {
+  num_allocations++;
+  num_bytes_allocated += size;
+  if (void *p = std::malloc(size ? size : 1)) {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+} // namespace
+
+// Replacing the global allocation functions lets every pass (and LLVM)
+// be charged for its allocations. They must stay visible so that shared
+// libraries bind to them too. The default operator delete calls free(),
+// which matches the malloc() above.
+#define NL_VISIBLE __attribute__((visibility("default")))
+
+NL_VISIBLE void *operator new(size_t size) { return counted_alloc(size); }
+NL_VISIBLE void *operator new[](size_t size) { return counted_alloc(size); }
+
+namespace Stats {
+
+long peak_rss_kb() {
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0) {
+    return -1;
+  }
+  return usage.ru_maxrss; // Already in KiB on Linux.
+}
+
+double now_ms() {
+  using namespace std::chrono;
+  return duration<double, std::milli>(
+             steady_clock::now().time_since_epoch())
+      .count();
+}
+
+uint64_t allocations() { return num_allocations; }
+
+uint64_t bytes_allocated() { return num_bytes_allocated; }
+
+} // namespace Stats
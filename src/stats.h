@@ -0,0 +1,23 @@
+#ifndef _NL_STATS_H_
+#define _NL_STATS_H_
+
+#include <cstddef>
+#include <cstdint>
+
+namespace Stats {
+
+/* Peak resident set size of this process, in KiB. */
+long peak_rss_kb();
+
+/* Monotonic wall clock, in milliseconds. */
+double now_ms();
+
+/* Number of calls to global operator new so far, and the bytes they
+   requested. Frees aren't subtracted: these measure allocation traffic,
+   not live memory. */
+uint64_t allocations();
+uint64_t bytes_allocated();
+
+} // namespace Stats
+
+#endif // _NL_STATS_H_
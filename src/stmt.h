@@ -97,7 +97,7 @@ public:
       : name(name), parameters(parameters), parameter_types(parameter_types),
         return_type(return_type), body(body) {}
 
-  bool is_void() const { return return_type.name.lexeme == "Void"; }
+  bool is_void() const { return return_type.name.id == ID_VOID; }
 
   const Token name;
   const std::vector<Token> parameters;
@@ -119,15 +119,16 @@ class ClassStmt : public StmtCRTP<ClassStmt> {
 public:
   explicit ClassStmt(Token name, Token *superclass, std::vector<Token> fields,
                      std::vector<TypeParse> field_types,
-                     std::vector<Stmt *> methods)
+                     std::vector<Stmt *> methods, bool is_struct = false)
       : name(name), superclass(superclass), fields(fields),
-        field_types(field_types), methods(methods) {}
+        field_types(field_types), methods(methods), is_struct(is_struct) {}
 
   const Token name;
   const Token *superclass = nullptr;
   const std::vector<Token> fields;
   const std::vector<TypeParse> field_types;
   const std::vector<Stmt *> methods;
+  const bool is_struct; // A value type, declared with 'struct'.
 };
 
 #endif // _NL_STMT_H_
@@ -4,7 +4,8 @@
 #include <memory>
 #include <string>
 
-#include "cactus-table.h"
+#include "interner.h"
+#include "scoped-table.h"
 #include "type.h"
 
 struct Symbol {
@@ -12,6 +13,6 @@ struct Symbol {
   NLType type;
 };
 
-using SymbolTable = CactusTable<const std::string, Symbol>;
+using SymbolTable = ScopedTable<Symbol>;
 
 #endif // _NL_SYMTAB_H_
@@ -17,10 +17,18 @@ static std::vector<std::string> token_names{
 
     "AND",           "CLASS",       "ELSE",       "FALSE",       "FN",
     "LAMBDA",        "FOR",         "IF",         "NIL",         "OR",
-    "PRINT",         "RETURN",      "SUPER",      "THIS",        "TRUE",
-    "VAR",           "WHILE",       "EOF"};
+    "PRINT",         "RETURN",      "STRUCT",     "SUPER",       "THIS",
+    "TRUE",          "VAR",         "WHILE",      "EOF"};
+
+std::string Token::literal() const {
+  const std::string &text = lexeme();
+  if (type == STRING) {
+    return text.substr(1, text.size() - 2);
+  }
+  return text;
+}
 
 std::string Token::str() const {
-  return token_names[type] + " " + lexeme +
-         ((type == NUMBER || type == STRING) ? " " + literal : "");
+  return token_names[type] + " " + lexeme() +
+         ((type == NUMBER || type == STRING) ? " " + literal() : "");
 }
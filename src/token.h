@@ -1,8 +1,11 @@
 #ifndef _NL_TOKEN_H_
 #define _NL_TOKEN_H_
 
+#include <cstdint>
 #include <string>
 
+#include "interner.h"
+
 enum TokenType {
   // Single-character tokens.
   LEFT_PAREN,
@@ -48,6 +51,7 @@ enum TokenType {
   OR,
   PRINT,
   RETURN,
+  STRUCT,
   SUPER,
   THIS,
   TRUE,
@@ -56,25 +60,27 @@ enum TokenType {
   END_OF_FILE
 };
 
+/*
+ * Tokens don't own any text. They record where the lexeme sits in the
+ * source buffer and its interned ID, so they are cheap to copy around.
+ */
 class Token {
 public:
-  TokenType type;
-  std::string lexeme;
-  std::string literal;
-  int line;
+  TokenType type = END_OF_FILE;
+  uint32_t offset = 0; // span of the lexeme in the source
+  uint32_t length = 0;
+  Ident id = ID_EMPTY; // interned lexeme
+  int line = 0;
 
   Token() {}
 
-  Token(TokenType type, const std::string &lexeme, const std::string &literal,
-        int line)
-      : type(type), lexeme(lexeme), literal(literal), line(line) {}
+  Token(TokenType type, uint32_t offset, uint32_t length, Ident id, int line)
+      : type(type), offset(offset), length(length), id(id), line(line) {}
+
+  const std::string &lexeme() const { return Interner::str(id); }
 
-  Token(const Token &token) {
-    this->type = token.type;
-    this->lexeme = token.lexeme;
-    this->literal = token.literal;
-    this->line = token.line;
-  }
+  /* Value of a literal: string contents without quotes, or the number. */
+  std::string literal() const;
 
   std::string str() const;
 };
@@ -30,10 +30,10 @@ void TypeChecker::visit(const BlockStmt *stmt) {
 }
 
 void TypeChecker::visit(const VarStmt *stmt) {
-  auto var_name = stmt->name.lexeme;
+  Ident var_name = stmt->name.id;
   NLType var_type;
 
-  if (types()->contains(var_name)) {
+  if (types().contains(var_name)) {
     Neeilang::error(stmt->name, "Variable cannot have the name of a type");
     return;
   }
@@ -51,7 +51,7 @@ void TypeChecker::visit(const VarStmt *stmt) {
       var_type = inferred_type;
     }
   } else {
-    var_type = types()->get(stmt->tp.name.lexeme);
+    var_type = types().get(stmt->tp.name.id);
     if (!var_type) {
       Neeilang::error(stmt->tp.name, "Unknown type");
       return;
@@ -65,7 +65,8 @@ void TypeChecker::visit(const VarStmt *stmt) {
                                              dim_type->name);
         }
       }
-      var_type = Primitives::Array(var_type, stmt->tp.array_dims());
+      var_type =
+          Primitives::Array(var_type, stmt->tp.array_dims(), stmt->tp.soa);
     }
 
     if (stmt->expression) {
@@ -80,21 +81,21 @@ void TypeChecker::visit(const VarStmt *stmt) {
     }
   }
 
-  Symbol symbol{var_name, var_type};
-  symbols()->insert(var_name, symbol);
-  types()->insert(var_name, var_type);
+  Symbol symbol{stmt->name.lexeme(), var_type};
+  symbols().insert(var_name, symbol);
+  types().insert(var_name, var_type);
 }
 
 void TypeChecker::visit(const Variable *expr) {
-  auto name = expr->name.lexeme;
-  if (symbols()->contains(name)) {
-    expr_types[expr] = symbols()->get(name).type;
+  Ident name = expr->name.id;
+  if (symbols().contains(name)) {
+    expr_types[expr] = symbols().get(name).type;
     return;
   }
 
-  auto fn_key = TypeTableUtil::fn_key(expr->name.lexeme);
-  if (types()->contains(fn_key)) {
-    expr_types[expr] = types()->get(fn_key);
+  Ident fn_key = TypeTableUtil::fn_key(name);
+  if (types().contains(fn_key)) {
+    expr_types[expr] = types().get(fn_key);
     return;
   }
 
@@ -110,7 +111,7 @@ void TypeChecker::visit(const Assignment *expr) {
   }
 
   // The variable being assigned to.
-  Symbol var = symbols()->get(expr->name.lexeme);
+  Symbol var = symbols().get(expr->name.id);
   auto left = var.type;
 
   if (!right->subclass_of(left.get())) {
@@ -136,19 +137,20 @@ void TypeChecker::visit(const FuncStmt *stmt) {
   auto prev_enclosing_fn = enclosing_fn;
 
   enclosing_fn = nullptr;
-  auto fn_key = TypeTableUtil::fn_key(stmt->name.lexeme);
+  Ident fn_key = TypeTableUtil::fn_key(stmt->name.id);
   if (enclosing_class) {
-    enclosing_fn = enclosing_class->get_method(stmt->name.lexeme);
-  } else if (types()->contains(fn_key)) {
-    enclosing_fn = types()->get(fn_key)->functype;
+    enclosing_fn = enclosing_class->get_method(stmt->name.id);
+  } else if (types().contains(fn_key)) {
+    enclosing_fn = types().get(fn_key)->functype;
   }
 
   assert(enclosing_fn && "FuncType not found for function");
 
   sm.enter();
   for (size_t i = 0; i < stmt->parameters.size(); i++) {
-    auto argname = stmt->parameters[i].lexeme;
-    symbols()->insert(argname, Symbol{argname, enclosing_fn->arg_types[i]});
+    const Token &param = stmt->parameters[i];
+    symbols().insert(param.id,
+                      Symbol{param.lexeme(), enclosing_fn->arg_types[i]});
   }
 
   check(stmt->body);
@@ -159,12 +161,11 @@ void TypeChecker::visit(const FuncStmt *stmt) {
 
 void TypeChecker::visit(const ClassStmt *stmt) {
   // Hoister should already have checked field types.
-  const std::string name = stmt->name.lexeme;
-  Symbol symbol{name, Primitives::Class()};
-  symbols()->insert(name, symbol);
+  Symbol symbol{stmt->name.lexeme(), Primitives::Class()};
+  symbols().insert(stmt->name.id, symbol);
 
   auto prev_enclosing_class = enclosing_class;
-  enclosing_class = types()->get(stmt->name.lexeme);
+  enclosing_class = types().get(stmt->name.id);
 
   sm.enter();
   check(stmt->methods);
@@ -246,6 +247,11 @@ void TypeChecker::visit(const Binary *expr) {
   switch (expr->op.type) {
   case EQUAL_EQUAL:
   case BANG_EQUAL: {
+    if (left->is_struct || right->is_struct) {
+      Neeilang::error(expr->op, "Structs cannot be compared");
+      expr_types[expr] = TypeError();
+      return;
+    }
     expr_types[expr] = Primitives::Bool();
     return;
   }
@@ -370,12 +376,19 @@ void TypeChecker::visit(const Get *expr) {
     // This isn't necesarily bad, but we want to ensure other forms are allowed
     // in previous passes.
     // Change callee from Class type to real type.
-    callee_type = types()->get(callee->name.lexeme);
+    callee_type = types().get(callee->name.id);
+  }
+
+  const std::string &field_name = expr->name.lexeme();
+  const Ident field = expr->name.id;
+
+  // Arrays have a read-only size.
+  if (callee_type->is_array_type() && field == ID_SIZE) {
+    expr_types[expr] = Primitives::Int();
+    return;
   }
 
-  auto field_name = expr->name.lexeme;
-  if (!callee_type->has_field(field_name) &&
-      !callee_type->has_method(field_name)) {
+  if (!callee_type->has_field(field) && !callee_type->has_method(field)) {
 
     std::ostringstream msg;
     msg << "Type " << callee_type->name << " does not have field or method '"
@@ -387,16 +400,30 @@ void TypeChecker::visit(const Get *expr) {
   }
 
   // TODO : Check that this is an l-value.
-  if (callee_type->has_field(field_name)) {
-    expr_types[expr] = callee_type->get_field(field_name).type;
+  if (callee_type->has_field(field)) {
+    expr_types[expr] = callee_type->get_field(field).type;
   } else {
     NLType method_type =
         NLTypeUtil::create(callee_type->name + "::" + field_name);
-    method_type->functype = callee_type->get_method(field_name);
+    method_type->functype = callee_type->get_method(field);
     expr_types[expr] = method_type;
   }
 }
 
+/* Whether a struct-typed expression names storage that a field can be set
+ in, rather than a temporary copy (e.g. a call's result). */
+static bool is_struct_lvalue(const Expr *expr, const ExprTypes &types) {
+  if (const auto *group = dynamic_cast<const Grouping *>(expr)) {
+    return is_struct_lvalue(&group->expression, types);
+  }
+  if (const auto *get = dynamic_cast<const Get *>(expr)) {
+    return !types.get(&get->callee)->is_struct ||
+           is_struct_lvalue(&get->callee, types);
+  }
+  return dynamic_cast<const Variable *>(expr) ||
+         dynamic_cast<const GetIndex *>(expr);
+}
+
 void TypeChecker::visit(const Set *expr) {
   auto expr_type = check(&expr->value);
   auto callee_type = check(&expr->callee);
@@ -406,8 +433,8 @@ void TypeChecker::visit(const Set *expr) {
     return;
   }
 
-  auto field_name = expr->name.lexeme;
-  if (!callee_type->has_field(field_name)) {
+  const std::string &field_name = expr->name.lexeme();
+  if (!callee_type->has_field(expr->name.id)) {
 
     std::ostringstream msg;
     msg << "Type " << callee_type->name << " does not have field '"
@@ -418,7 +445,14 @@ void TypeChecker::visit(const Set *expr) {
     return;
   }
 
-  NLType field_type = callee_type->get_field(field_name).type;
+  if (callee_type->is_struct && !is_struct_lvalue(&expr->callee, expr_types)) {
+    Neeilang::error(expr->name, "Cannot set a field of a temporary " +
+                                    callee_type->name);
+    expr_types[expr] = TypeError();
+    return;
+  }
+
+  NLType field_type = callee_type->get_field(expr->name.id).type;
   if (!expr_type->subclass_of(field_type.get())) {
     std::ostringstream msg;
     msg << "Incompatible types in Set expression. Expected " << field_type->name
@@ -521,8 +555,15 @@ bool TypeChecker::has_type_error(const std::vector<NLType> &types) {
   return false;
 }
 
+NLType TypeChecker::check_indexed(const Expr *callee) {
+  indexed_callee = callee;
+  return check(callee);
+}
+
 void TypeChecker::visit(const GetIndex *expr) {
-  NLType lhs_type = check(&expr->callee);
+  const bool partial_ok = expr == indexed_callee;
+  indexed_callee = nullptr;
+  NLType lhs_type = check_indexed(&expr->callee);
   NLType idx_type = check(&expr->index);
 
   if (has_type_error({lhs_type, idx_type})) {
@@ -538,6 +579,13 @@ void TypeChecker::visit(const GetIndex *expr) {
       expr_types[expr] = Primitives::TypeError();
       return;
     }
+    if (lhs_type->dims > 1 && !partial_ok) {
+      Neeilang::error(expr->bracket, "Expected " +
+                                         std::to_string(lhs_type->dims) +
+                                         " indices into " + lhs_type->name);
+      expr_types[expr] = Primitives::TypeError();
+      return;
+    }
     expr_types[expr] = Arrays::next_enclosed_type(lhs_type);
   } else {
     Neeilang::error(expr->bracket,
@@ -547,7 +595,7 @@ void TypeChecker::visit(const GetIndex *expr) {
 }
 
 void TypeChecker::visit(const SetIndex *expr) {
-  NLType lhs_type = check(&expr->callee);
+  NLType lhs_type = check_indexed(&expr->callee);
   NLType idx_type = check(&expr->index);
   NLType rhs_type = check(&expr->value);
 
@@ -563,6 +611,13 @@ void TypeChecker::visit(const SetIndex *expr) {
       expr_types[expr] = Primitives::TypeError();
       return;
     }
+    if (lhs_type->dims > 1) {
+      Neeilang::error(expr->bracket, "Expected " +
+                                         std::to_string(lhs_type->dims) +
+                                         " indices into " + lhs_type->name);
+      expr_types[expr] = Primitives::TypeError();
+      return;
+    }
     NLType elem_type = Arrays::next_enclosed_type(lhs_type);
     if (!rhs_type->subclass_of(elem_type.get())) {
       std::ostringstream msg;
@@ -1,11 +1,11 @@
 #ifndef _NL_TYPE_CHECKER_H_
 #define _NL_TYPE_CHECKER_H_
 
-#include <map>
 #include <memory>
 #include <string>
 #include <vector>
 
+#include "expr-types.h"
 #include "expr.h"
 #include "scope-manager.h"
 #include "stmt.h"
@@ -15,7 +15,9 @@
 
 class TypeChecker : public ExprVisitor<void>, public StmtVisitor<void> {
 public:
-  TypeChecker(ScopeManager &sm) : sm(sm) {}
+  TypeChecker(ScopeManager &sm, size_t num_exprs = 0) : sm(sm) {
+    expr_types.reserve(num_exprs + 1);
+  }
 
   void check(const std::vector<Stmt *> stmts);
   void check(const Stmt *stmt);
@@ -28,16 +30,21 @@ public:
   bool match(const Expr *expr, const std::vector<NLType> &types);
   bool has_type_error(const std::vector<NLType> &types);
 
-  std::shared_ptr<TypeTable> types() { return sm.current().typetab; }
-  std::shared_ptr<SymbolTable> symbols() { return sm.current().symtab; }
-  std::map<const Expr *, NLType>& get_expr_types() { return expr_types; }
+  TypeTable &types() { return sm.types; }
+  SymbolTable &symbols() { return sm.symbols; }
+  const ExprTypes &get_expr_types() const { return expr_types; }
 
   ScopeManager &sm;
 
 private:
-  std::map<const Expr *, NLType> expr_types;
+  ExprTypes expr_types;
   NLType enclosing_class;
   std::shared_ptr<FuncType> enclosing_fn;
+  // The callee of the GetIndex or SetIndex being checked, which may index
+  // a multi-dimensional array partially.
+  const Expr *indexed_callee = nullptr;
+
+  NLType check_indexed(const Expr *callee);
 };
 
 #endif //_NL_TYPE_CHECKER_H_
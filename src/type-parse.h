@@ -12,6 +12,7 @@ struct TypeParse {
   Token name;
   std::vector<const Expr *> dims;
   bool inferred = false;
+  bool soa = false; // Structure-of-arrays layout, for arrays of structs.
 
   bool is_array() const { return dims.size() > 0; }
   unsigned array_dims() const { return dims.size(); }
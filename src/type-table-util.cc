@@ -1,10 +1,23 @@
+#include <unordered_map>
+
 #include "type-table.h"
 
 namespace TypeTableUtil {
-std::string fn_key(const FuncStmt *func) {
+Ident fn_key(const FuncStmt *func) {
   // TODO : should account for methods by encoding class name in key.
-  return fn_key(func->name.lexeme);
+  return fn_key(func->name.id);
 }
 
-std::string fn_key(const std::string func) { return "$fn_" + func; }
+Ident fn_key(Ident func) {
+  static std::unordered_map<Ident, Ident> keys;
+
+  auto it = keys.find(func);
+  if (it != keys.end()) {
+    return it->second;
+  }
+
+  Ident key = Interner::intern("$fn_" + Interner::str(func));
+  keys.emplace(func, key);
+  return key;
+}
 } // namespace TypeTableUtil
@@ -4,15 +4,17 @@
 #include <memory>
 #include <string>
 
-#include "cactus-table.h"
+#include "interner.h"
+#include "scoped-table.h"
 #include "stmt.h"
 #include "type.h"
 
-using TypeTable = CactusTable<const std::string, NLType>;
+using TypeTable = ScopedTable<NLType>;
 
 namespace TypeTableUtil {
-std::string fn_key(const FuncStmt *func);
-std::string fn_key(const std::string func);
+/* Functions are keyed by their name with a '$fn_' prefix. */
+Ident fn_key(const FuncStmt *func);
+Ident fn_key(Ident func);
 } // namespace TypeTableUtil
 
 #endif // _NL_TYPE_TABLE_H_
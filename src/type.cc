@@ -2,101 +2,114 @@
 
 struct FuncType;
 
-bool Type::has_field(const std::string &name) {
-  if (supertype && supertype->has_field(name)) {
-    return true;
+void Type::finalize() {
+  if (finalized)
+    return;
+  finalized = true;
+
+  if (supertype) {
+    supertype->finalize();
+    vtable = supertype->vtable;
+    vtable_owners = supertype->vtable_owners;
+    vtable_slots = supertype->vtable_slots;
+    all_fields = supertype->all_fields;
+    field_slots = supertype->field_slots;
   }
 
-  for (auto field : fields) {
-    if (field.name == name) {
-      return true;
+  // An overriding method takes over its parent's slot.
+  for (const std::shared_ptr<FuncType> &m : methods) {
+    const Ident name = Interner::intern(m->name);
+    auto slot = vtable_slots.find(name);
+    if (slot == vtable_slots.end()) {
+      slot = vtable_slots.emplace(name, vtable.size()).first;
+      vtable.push_back(m);
+      vtable_owners.push_back(this);
+    } else {
+      vtable[slot->second] = m;
+      vtable_owners[slot->second] = this;
     }
+    own_methods.emplace(name, OwnMethod{m, slot->second});
   }
 
-  return false;
+  // Fields always get a new slot, but a name that is already taken by
+  // a superclass keeps referring to the superclass's field.
+  for (const Field &field : fields) {
+    field_slots.emplace(Interner::intern(field.name), all_fields.size());
+    all_fields.push_back(field);
+  }
 }
 
-Field Type::get_field(const std::string &name) {
-  if (supertype && supertype->has_field(name)) {
-    return supertype->get_field(name);
-  }
+bool Type::has_field(Ident name) {
+  ensure_finalized();
+  return field_slots.count(name) > 0;
+}
 
-  assert(has_field(name));
+bool Type::has_field(const std::string &name) {
+  return has_field(Interner::intern(name));
+}
 
-  for (auto field : fields) {
-    if (field.name == name) {
-      return field;
-    }
-  }
+Field Type::get_field(Ident name) {
+  assert(has_field(name));
+  return all_fields[field_slots.at(name)];
+}
 
-  // Unreachable
-  return Field();
+Field Type::get_field(const std::string &name) {
+  return get_field(Interner::intern(name));
 }
 
 int Type::num_fields() {
-  int offset = supertype ? supertype->num_fields() : 0;
-  return offset + fields.size();
+  ensure_finalized();
+  return all_fields.size();
 }
 
-int Type::field_idx(const std::string &name) {
+const std::vector<Field> &Type::get_fields() {
+  ensure_finalized();
+  return all_fields;
+}
 
+int Type::field_idx(Ident name) {
   assert(has_field(name));
+  return field_slots.at(name);
+}
 
-  if (supertype && supertype->has_field(name)) {
-    return supertype->field_idx(name);
-  }
-
-  int offset = supertype ? supertype->num_fields() : 0;
+int Type::field_idx(const std::string &name) {
+  return field_idx(Interner::intern(name));
+}
 
-  for (size_t i = 0; i < fields.size(); i++) {
-    if (fields[i].name == name) {
-      return offset + i;
-    }
-  }
-  return -1; // Unreachable
+bool Type::has_method(Ident name) {
+  ensure_finalized();
+  return own_methods.count(name) > 0;
 }
 
 bool Type::has_method(const std::string &name) {
-  for (auto method : methods) {
-    if (method->name == name)
-      return true;
-  }
-  return false;
+  return has_method(Interner::intern(name));
 }
 
-std::shared_ptr<FuncType> Type::get_method(const std::string &name) {
+std::shared_ptr<FuncType> Type::get_method(Ident name) {
   assert(has_method(name));
-  for (auto method : methods) {
-    if (method->name == name)
-      return method;
-  }
-  return std::make_shared<FuncType>(); // Unreachable
+  return own_methods.at(name).method;
 }
 
-std::vector<std::shared_ptr<FuncType>> Type::get_methods() {
-  if (!supertype) {
-    return methods;
-  }
+std::shared_ptr<FuncType> Type::get_method(const std::string &name) {
+  return get_method(Interner::intern(name));
+}
 
-  std::vector<std::shared_ptr<FuncType>> all_methods;
-  auto super_methods = supertype->get_methods();
-  for (auto sm : super_methods) {
-    all_methods.push_back(sm);
-  }
+const Type *Type::method_owner(int slot) {
+  ensure_finalized();
+  return vtable_owners[slot];
+}
 
-  for (std::shared_ptr<FuncType> m : methods) {
-    bool overridden = false;
-    for (size_t i = 0; i < all_methods.size(); i++) {
-      if (m->name == all_methods[i]->name) {
-        overridden = true;
-        all_methods[i] = m;
-        break;
-      }
-    }
-    if (!overridden) {
-      all_methods.push_back(m);
-    }
-  }
+int Type::method_idx(Ident name) {
+  ensure_finalized();
+  auto it = own_methods.find(name);
+  return it == own_methods.end() ? -1 : it->second.slot;
+}
+
+int Type::method_idx(const std::string &name) {
+  return method_idx(Interner::intern(name));
+}
 
-  return all_methods;
+const std::vector<std::shared_ptr<FuncType>> &Type::get_methods() {
+  ensure_finalized();
+  return vtable;
 }
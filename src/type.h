@@ -4,10 +4,12 @@
 #include <cassert>
 #include <memory>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include "field.h"
 #include "functype.h"
+#include "interner.h"
 #include "nltype.h"
 
 struct FuncType;
@@ -18,7 +20,7 @@ public:
 
   bool superclass_of(const Type *other) const {
     if (dims > 0) {
-      return other->dims == dims &&
+      return other->dims == dims && other->soa == soa &&
              underlying_type->superclass_of(other->underlying_type.get());
     }
 
@@ -35,30 +37,47 @@ public:
 
   bool is_function_type() { return functype != nullptr; }
 
+  /*
+   * Computes the class layout: the flattened vtable (inherited slots
+   * first, overrides replacing them in place), field offsets, and
+   * name -> slot tables. The supertype is finalized first. Must be called
+   * once fields, methods and supertype are final; the GlobalHoister does
+   * this for every class. Types that are never finalized explicitly (e.g.
+   * primitives) are finalized on their first layout query.
+   */
+  void finalize();
+  bool is_finalized() const { return finalized; }
+
   int num_methods() { return get_methods().size(); }
 
   int num_fields();
 
-  std::vector<std::shared_ptr<FuncType>> get_methods();
+  /* Every field, inherited ones first, by slot. */
+  const std::vector<Field> &get_fields();
 
-  int method_idx(const std::string &name) {
-    auto m = get_method(name);
-    auto methods = get_methods();
+  /* The vtable: every method callable on this type, by slot. */
+  const std::vector<std::shared_ptr<FuncType>> &get_methods();
 
-    for (size_t i = 0; i < methods.size(); i++) {
-      if (methods[i] == m)
-        return i;
-    }
+  /* The class whose implementation fills vtable slot. */
+  const Type *method_owner(int slot);
 
-    return -1;
-  }
+  /* Vtable slot of a method declared by this class, or -1. */
+  int method_idx(Ident name);
+  int method_idx(const std::string &name);
 
   bool is_array_type() { return dims > 0; }
 
+  bool has_field(Ident name);
   bool has_field(const std::string &name);
+  Field get_field(Ident name);
   Field get_field(const std::string &name);
+  int field_idx(Ident name);
   int field_idx(const std::string &name);
+
+  /* Methods declared (not inherited) by this class. */
+  bool has_method(Ident name);
   bool has_method(const std::string &name);
+  std::shared_ptr<FuncType> get_method(Ident name);
   std::shared_ptr<FuncType> get_method(const std::string &name);
 
   std::string name;
@@ -66,8 +85,33 @@ public:
   std::vector<Field> fields;
   std::vector<std::shared_ptr<FuncType>> methods;
   int dims = 0;
+  // Structs are value types: no vtable or header, stored inline and copied
+  // on assignment. Their fields are all numeric or structs themselves.
+  bool is_struct = false;
+  // Arrays of structs: each field is stored in its own column rather than
+  // each element whole, which makes field-by-field loops denser.
+  bool soa = false;
   std::shared_ptr<Type> underlying_type = nullptr;
   std::shared_ptr<FuncType> functype = nullptr;
+
+private:
+  struct OwnMethod {
+    std::shared_ptr<FuncType> method;
+    int slot;
+  };
+
+  bool finalized = false;
+  std::vector<std::shared_ptr<FuncType>> vtable;
+  std::vector<const Type *> vtable_owners;
+  std::unordered_map<Ident, int> vtable_slots;     // Including inherited.
+  std::unordered_map<Ident, OwnMethod> own_methods;
+  std::vector<Field> all_fields;                   // Inherited fields first.
+  std::unordered_map<Ident, int> field_slots;
+
+  void ensure_finalized() {
+    if (!finalized)
+      finalize();
+  }
 };
 
 #endif // _NL_TYPE_H_